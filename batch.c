@@ -0,0 +1,305 @@
+/*
+ * CS 261: Parallel multi-file processing
+ *
+ * Name: Aiden Smith
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+/* One input file */
+typedef struct job {
+    int worker;         // worker that ran it (-1: not started)
+    off_t start, end;   // its output, in the worker's output file
+    bool done;
+    int status;         // exit status once done
+} job_t;
+
+/*
+ * A long-lived worker process. Its stdout is a temporary file that it
+ * appends every file's output to; the parent sends it file numbers on cmd
+ * and it answers each with a result_t on res.
+ */
+typedef struct worker {
+    pid_t pid;
+    FILE *out;          // output file (shared with the worker)
+    off_t tail;         // end of the output of its last finished file
+    int cmd, res;       // pipe ends held by the parent
+    int job;            // file being run (-1: idle)
+} worker_t;
+
+/* Reply from a worker after one file */
+typedef struct result {
+    int job;
+    int status;
+    off_t start, end;
+} result_t;
+
+/* Read exactly len bytes, retrying short reads; false at end of file */
+static bool read_all (int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Worker side: run files as they are handed out until the pipe closes */
+static void worker_loop (worker_t *w, int cmd, int res, char **files,
+        batch_fn_t fn, const void *arg)
+{
+    dup2(fileno(w->out), STDOUT_FILENO);
+    int i;
+    while (read_all(cmd, &i, sizeof(i))) {
+        result_t r = { .job = i };
+        r.start = lseek(STDOUT_FILENO, 0, SEEK_END);
+        r.status = fn(files[i], arg);
+        fflush(stdout);
+        r.end = lseek(STDOUT_FILENO, 0, SEEK_END);
+        if (write(res, &r, sizeof(r)) != sizeof(r)) {
+            break;
+        }
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Start worker w, appending to its output file if it already has one;
+   returns false if it could not be started */
+static bool start_worker (worker_t *w, worker_t *pool, int nworkers,
+        char **files, batch_fn_t fn, const void *arg)
+{
+    int cmd[2], res[2];
+    w->pid = -1;
+    w->job = -1;
+    if (w->out == NULL && (w->out = tmpfile()) == NULL) {
+        return false;
+    }
+    if (pipe(cmd) < 0) {
+        return false;
+    }
+    if (pipe(res) < 0) {
+        close(cmd[0]);
+        close(cmd[1]);
+        return false;
+    }
+
+    fflush(stdout);     // don't let the worker inherit buffered output
+    w->pid = fork();
+    if (w->pid == 0) {
+        // the other workers' pipes stay with the parent
+        for (int k = 0; k < nworkers; k++) {
+            if (&pool[k] != w && pool[k].pid > 0) {
+                close(pool[k].cmd);
+                close(pool[k].res);
+            }
+        }
+        close(cmd[1]);
+        close(res[0]);
+        worker_loop(w, cmd[0], res[1], files, fn, arg);
+    }
+    close(cmd[0]);
+    close(res[1]);
+    if (w->pid < 0) {
+        close(cmd[1]);
+        close(res[0]);
+        return false;
+    }
+    w->cmd = cmd[1];
+    w->res = res[0];
+    return true;
+}
+
+/* Stop a worker: close its pipes and wait for it to exit */
+static void stop_worker (worker_t *w)
+{
+    close(w->cmd);
+    close(w->res);
+    waitpid(w->pid, NULL, 0);
+    w->pid = -1;
+}
+
+/* Copy a finished job's output to stdout */
+static void emit_job (job_t *job, worker_t *pool)
+{
+    char buf[64 * 1024];
+    if (job->worker < 0) {
+        return;
+    }
+    int fd = fileno(pool[job->worker].out);
+    for (off_t at = job->start; at < job->end; ) {
+        off_t want = job->end - at;
+        if (want > (off_t)sizeof(buf)) {
+            want = sizeof(buf);
+        }
+        ssize_t n = pread(fd, buf, want, at);
+        if (n <= 0) {
+            break;
+        }
+        fwrite(buf, 1, n, stdout);
+        at += n;
+    }
+}
+
+/* Write out the finished files at the front of the queue, in input order */
+static void emit_ready (job_t *jobs, worker_t *pool, int nfiles,
+        int *next_emit, int *status)
+{
+    while (*next_emit < nfiles && jobs[*next_emit].done) {
+        emit_job(&jobs[*next_emit], pool);
+        if (jobs[*next_emit].status != EXIT_SUCCESS) {
+            *status = EXIT_FAILURE;
+        }
+        (*next_emit)++;
+    }
+}
+
+int batch_run (char **files, int nfiles, int jobs, batch_fn_t fn,
+        const void *arg)
+{
+    int status = EXIT_SUCCESS;
+
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (cpus > 0) ? cpus : 1;
+    }
+    if (jobs > nfiles) {
+        jobs = nfiles;
+    }
+
+    // a single file or worker needs no pool
+    if (jobs <= 1) {
+        for (int i = 0; i < nfiles; i++) {
+            if (fn(files[i], arg) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+            }
+        }
+        return status;
+    }
+
+    job_t *queue = calloc(nfiles, sizeof(job_t));
+    worker_t *pool = calloc(jobs, sizeof(worker_t));
+    struct pollfd *fds = calloc(jobs, sizeof(struct pollfd));
+    if (queue == NULL || pool == NULL || fds == NULL) {
+        free(queue);
+        free(pool);
+        free(fds);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < nfiles; i++) {
+        queue[i].worker = -1;
+    }
+    for (int k = 0; k < jobs; k++) {
+        pool[k].pid = -1;
+    }
+    for (int k = 0; k < jobs; k++) {
+        start_worker(&pool[k], pool, jobs, files, fn, arg);
+    }
+
+    int next_start = 0, next_emit = 0;
+    while (next_emit < nfiles) {
+
+        // keep every worker busy, but don't run too far ahead of the output
+        int busy = 0;
+        for (int k = 0; k < jobs; k++) {
+            worker_t *w = &pool[k];
+            if (w->pid > 0 && w->job < 0 && next_start < nfiles &&
+                    next_start < next_emit + BATCH_AHEAD) {
+                if (write(w->cmd, &next_start, sizeof(int)) == sizeof(int)) {
+                    w->job = next_start++;
+                }
+            }
+            if (w->pid > 0 && w->job >= 0) {
+                fds[busy].fd = w->res;
+                fds[busy].events = POLLIN;
+                busy++;
+            }
+        }
+
+        if (busy == 0) {
+            // no worker could be started: run the next file in place, once
+            // everything before it has been written
+            emit_ready(queue, pool, nfiles, &next_emit, &status);
+            if (next_emit == next_start && next_start < nfiles) {
+                fflush(stdout);
+                queue[next_start].status = fn(files[next_start], arg);
+                queue[next_start].done = true;
+                next_start++;
+            }
+            emit_ready(queue, pool, nfiles, &next_emit, &status);
+            continue;
+        }
+
+        if (poll(fds, busy, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        for (int k = 0; k < jobs; k++) {
+            worker_t *w = &pool[k];
+            if (w->pid <= 0 || w->job < 0) {
+                continue;
+            }
+            int f = 0;
+            while (f < busy && fds[f].fd != w->res) {
+                f++;
+            }
+            if (f == busy || fds[f].revents == 0) {
+                continue;
+            }
+
+            job_t *job = &queue[w->job];
+            result_t r;
+            job->worker = k;
+            job->done = true;
+            if (read_all(w->res, &r, sizeof(r)) && r.job == w->job) {
+                job->start = r.start;
+                job->end = r.end;
+                job->status = r.status;
+                w->tail = r.end;
+                w->job = -1;
+                continue;
+            }
+
+            // the worker died on this file: keep what it wrote, count the
+            // file as failed and start a fresh worker on the same output
+            struct stat st;
+            job->start = w->tail;
+            job->end = fstat(fileno(w->out), &st) == 0 ? st.st_size : w->tail;
+            job->status = EXIT_FAILURE;
+            w->tail = job->end;
+            stop_worker(w);
+            start_worker(w, pool, jobs, files, fn, arg);
+        }
+        emit_ready(queue, pool, nfiles, &next_emit, &status);
+    }
+
+    fflush(stdout);
+    for (int k = 0; k < jobs; k++) {
+        if (pool[k].pid > 0) {
+            stop_worker(&pool[k]);
+        }
+        if (pool[k].out != NULL) {
+            fclose(pool[k].out);
+        }
+    }
+    free(queue);
+    free(pool);
+    free(fds);
+    return status;
+}
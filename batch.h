@@ -0,0 +1,27 @@
+#ifndef __CS261_BATCH__
+#define __CS261_BATCH__
+
+/* Most finished files whose output may wait for an earlier, slower file */
+#define BATCH_AHEAD 256
+
+/* Process one file, printing to stdout; returns an exit status */
+typedef int (*batch_fn_t) (const char *filename, const void *arg);
+
+/**
+ * @brief Process a list of files on a pool of long-lived worker processes,
+ * which take one file at a time. Each file's output is captured separately
+ * and written to stdout in input order, so the combined output is the same
+ * as processing the files one at a time. A failure on one file does not
+ * stop the others; a worker that crashes is replaced.
+ *
+ * @param files Names of the files to process
+ * @param nfiles Number of files
+ * @param jobs Most files processed at once (0: one per online CPU)
+ * @param fn Function that processes one file
+ * @param arg Argument passed through to fn
+ * @returns EXIT_SUCCESS if every file succeeded, EXIT_FAILURE otherwise
+ */
+int batch_run (char **files, int nfiles, int jobs, batch_fn_t fn,
+        const void *arg);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * CS 261: Control-flow graph recovery
+ *
+ * Name: Aiden Smith
+ */
+
+#include <string.h>
+
+#include "cfg.h"
+#include "outbuf.h"
+#include "p3-disas.h"
+
+static const char *const edge_names[] = {
+    "fall", "jump", "call", "return"
+};
+
+static inline void cfg_set (uint64_t *bits, address_t addr)
+{
+    bits[addr / 64] |= 1ULL << (addr % 64);
+}
+
+/* Worklist of block leaders still to be explored */
+typedef struct {
+    uint16_t addrs[MEMSIZE];
+    int count;
+} worklist_t;
+
+/* Mark addr as the start of a block, queueing it the first time */
+static void add_leader (y86_cfg_t *cfg, worklist_t *work, address_t addr)
+{
+    if (addr < MEMSIZE && !cfg_test(cfg->leaders, addr)) {
+        cfg_set(cfg->leaders, addr);
+        work->addrs[work->count++] = addr;
+    }
+}
+
+/*
+ * Decode forward from a leader until control leaves the straight line,
+ * marking every instruction reached and queueing the successors.
+ */
+static void explore (y86_cfg_t *cfg, worklist_t *work, const byte_t *memory,
+        address_t pc)
+{
+    address_t start = pc;
+
+    while (pc < MEMSIZE) {
+        if (cfg_test(cfg->visited, pc)) {
+            // joined code that is already decoded: split its block here
+            if (pc != start) {
+                add_leader(cfg, work, pc);
+            }
+            return;
+        }
+
+        y86_stat_t stat;
+        y86_inst_t inst = decode(memory, pc, &stat);
+        if (stat != AOK) {
+            return;
+        }
+        cfg_set(cfg->visited, pc);
+
+        switch (inst.icode) {
+            case JUMP:
+                add_leader(cfg, work, inst.valC.dest);
+                if (inst.ifun.jump != JMP) {
+                    add_leader(cfg, work, inst.valP);
+                }
+                return;
+            case CALL:
+                add_leader(cfg, work, inst.valC.dest);
+                add_leader(cfg, work, inst.valP);
+                return;
+            case RET:
+            case HALT:
+                return;
+            default:
+                break;
+        }
+        pc = inst.valP;
+    }
+}
+
+static void add_succ (y86_bblock_t *blk, address_t target, y86_edge_t kind)
+{
+    blk->succs[blk->nsuccs].target = target;
+    blk->succs[blk->nsuccs].kind = kind;
+    blk->nsuccs++;
+}
+
+/* Collect the instructions of the block starting at a leader */
+static void build_block (y86_cfg_t *cfg, const byte_t *memory, address_t pc)
+{
+    y86_bblock_t *blk = &cfg->blocks[cfg->nblocks];
+    memset(blk, 0, sizeof(*blk));
+    blk->start = pc;
+    blk->last = pc;
+    blk->end = pc;
+
+    while (true) {
+        y86_stat_t stat = ADR;
+        y86_inst_t inst;
+        if (pc < MEMSIZE) {
+            inst = decode(memory, pc, &stat);
+        }
+        if (stat != AOK) {
+            blk->invalid = true;
+            break;
+        }
+        blk->ninsts++;
+        blk->last = pc;
+        blk->end = inst.valP;
+
+        if (inst.icode == JUMP) {
+            add_succ(blk, inst.valC.dest, EDGE_JUMP);
+            if (inst.ifun.jump != JMP) {
+                add_succ(blk, inst.valP, EDGE_FALL);
+            }
+            break;
+        } else if (inst.icode == CALL) {
+            add_succ(blk, inst.valC.dest, EDGE_CALL);
+            add_succ(blk, inst.valP, EDGE_RETURN);
+            break;
+        } else if (inst.icode == RET || inst.icode == HALT) {
+            break;
+        }
+
+        pc = inst.valP;
+        if (cfg_test(cfg->leaders, pc)) {
+            add_succ(blk, pc, EDGE_FALL);
+            break;
+        }
+    }
+
+    cfg->nedges += blk->nsuccs;
+    cfg->block_at[blk->start] = ++cfg->nblocks;
+}
+
+void cfg_build (y86_cfg_t *cfg, const byte_t *memory, const address_t *roots,
+        int nroots)
+{
+    static worklist_t work;
+
+    memset(cfg, 0, sizeof(*cfg));
+    work.count = 0;
+
+    // find every reachable instruction and block leader
+    for (int i = 0; i < nroots; i++) {
+        add_leader(cfg, &work, roots[i]);
+    }
+    while (work.count > 0) {
+        address_t pc = work.addrs[--work.count];
+        explore(cfg, &work, memory, pc);
+    }
+
+    // then cut the code into blocks in address order
+    for (int w = 0; w < CFG_WORDS; w++) {
+        for (uint64_t bits = cfg->leaders[w]; bits != 0; bits &= bits - 1) {
+            build_block(cfg, memory, w * 64 + __builtin_ctzll(bits));
+        }
+    }
+}
+
+y86_bblock_t *cfg_block_at (y86_cfg_t *cfg, address_t addr)
+{
+    if (addr >= MEMSIZE || cfg->block_at[addr] == 0) {
+        return NULL;
+    }
+    return &cfg->blocks[cfg->block_at[addr] - 1];
+}
+
+/**********************************************************************
+ *                              OUTPUT
+ *********************************************************************/
+
+void cfg_print (y86_cfg_t *cfg, const byte_t *memory, elf_hdr_t *hdr)
+{
+    static outbuf_t out;
+    ob_init(&out, stdout);
+
+    ob_printf(&out, "Control flow graph: %d blocks, %d edges\n",
+              cfg->nblocks, cfg->nedges);
+
+    for (int b = 0; b < cfg->nblocks; b++) {
+        y86_bblock_t *blk = &cfg->blocks[b];
+
+        if (blk->start == hdr->e_entry) {
+            ob_printf(&out, "  0x%03lx:                               | _start:\n",
+                      blk->start);
+        }
+        ob_printf(&out, "  0x%03lx:                               | .L%03lx:\n",
+                  blk->start, blk->start);
+
+        address_t pc = blk->start;
+        for (int i = 0; i < blk->ninsts; i++) {
+            y86_stat_t stat;
+            y86_inst_t inst = decode(memory, pc, &stat);
+            char *line = ob_reserve(&out, Y86_LINELEN);
+            ob_commit(&out, format_code_line(line, memory, pc, &inst));
+            pc = inst.valP;
+        }
+        if (blk->invalid) {
+            ob_printf(&out, "  0x%03lx:                               |   # invalid "
+                      "instruction\n", pc);
+        }
+
+        // successors, e.g. "# -> .L120 (jump), .L113 (fall)"
+        if (blk->nsuccs > 0) {
+            ob_printf(&out, "%39s|   # ->", "");
+            for (int s = 0; s < blk->nsuccs; s++) {
+                ob_printf(&out, "%s .L%03lx (%s)", s ? "," : "",
+                          blk->succs[s].target, edge_names[blk->succs[s].kind]);
+            }
+            ob_putc(&out, '\n');
+        }
+    }
+    ob_flush(&out);
+}
+
+void cfg_print_dot (y86_cfg_t *cfg, const byte_t *memory, elf_hdr_t *hdr)
+{
+    static outbuf_t out;
+    ob_init(&out, stdout);
+
+    ob_puts(&out, "digraph cfg {\n");
+    ob_puts(&out, "    node [shape=box, fontname=\"monospace\"];\n");
+
+    for (int b = 0; b < cfg->nblocks; b++) {
+        y86_bblock_t *blk = &cfg->blocks[b];
+
+        ob_printf(&out, "    L%03lx [label=\"", blk->start);
+        if (blk->start == hdr->e_entry) {
+            ob_puts(&out, "_start\\l");
+        }
+
+        address_t pc = blk->start;
+        for (int i = 0; i < blk->ninsts; i++) {
+            y86_stat_t stat;
+            y86_inst_t inst = decode(memory, pc, &stat);
+            char text[Y86_TEXTLEN];
+            format_inst(text, &inst);
+            ob_printf(&out, "0x%03lx: %s\\l", pc, text);
+            pc = inst.valP;
+        }
+        if (blk->invalid) {
+            ob_printf(&out, "0x%03lx: (invalid)\\l", pc);
+        }
+        ob_puts(&out, "\"];\n");
+
+        for (int s = 0; s < blk->nsuccs; s++) {
+            ob_printf(&out, "    L%03lx -> L%03lx [label=\"%s\"%s];\n",
+                      blk->start, blk->succs[s].target,
+                      edge_names[blk->succs[s].kind],
+                      blk->succs[s].kind == EDGE_RETURN ? ", style=dashed" : "");
+        }
+    }
+    ob_puts(&out, "}\n");
+    ob_flush(&out);
+}
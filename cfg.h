@@ -0,0 +1,97 @@
+#ifndef __CS261_CFG__
+#define __CS261_CFG__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "elf.h"
+#include "y86.h"
+
+/* Kinds of control-flow edges */
+typedef enum {
+    EDGE_FALL,      // falls through to the next instruction
+    EDGE_JUMP,      // jXX target (taken branch or unconditional jump)
+    EDGE_CALL,      // call target
+    EDGE_RETURN     // instruction after a call, where the callee returns
+} y86_edge_t;
+
+/* Bitmap with one bit per address */
+#define CFG_WORDS (MEMSIZE / 64)
+
+/*
+ * Basic block: a run of instructions entered only at its first instruction
+ * and left only after its last one.
+ */
+typedef struct y86_bblock {
+    address_t start;            // address of the first instruction
+    address_t end;              // address just past the last instruction
+    address_t last;             // address of the last instruction
+    uint16_t ninsts;            // number of instructions
+    bool invalid;               // ends at an undecodable instruction
+    uint8_t nsuccs;             // number of successor edges
+    struct {
+        address_t target;
+        y86_edge_t kind;
+    } succs[2];
+} y86_bblock_t;
+
+/*
+ * Control-flow graph recovered by following jumps, calls and fall-through
+ * edges from a set of root addresses. Bytes that are never reached are not
+ * treated as code, so data embedded in a code segment stays out of the
+ * listing.
+ */
+typedef struct y86_cfg {
+    uint64_t visited[CFG_WORDS];    // first byte of each reached instruction
+    uint64_t leaders[CFG_WORDS];    // first instruction of each block
+    uint16_t block_at[MEMSIZE];     // block index + 1 for each block start
+    y86_bblock_t blocks[MEMSIZE];   // blocks in address order
+    int nblocks;
+    int nedges;
+} y86_cfg_t;
+
+static inline bool cfg_test (const uint64_t *bits, address_t addr)
+{
+    return addr < MEMSIZE && ((bits[addr / 64] >> (addr % 64)) & 1);
+}
+
+/**
+ * @brief Build the control-flow graph of the code reachable from the roots
+ *
+ * @param cfg Graph to fill in
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param roots Addresses where execution may begin (entry point, symbols)
+ * @param nroots Number of roots
+ */
+void cfg_build (y86_cfg_t *cfg, const byte_t *memory, const address_t *roots,
+        int nroots);
+
+/**
+ * @brief Find the block that starts at an address
+ *
+ * @param cfg Graph to search
+ * @param addr Address of a block's first instruction
+ * @returns Pointer to the block, or NULL if no block starts there
+ */
+y86_bblock_t *cfg_block_at (y86_cfg_t *cfg, address_t addr);
+
+/**
+ * @brief Print the recovered code block by block, in the format of
+ * disassemble_code(), with each block's successors
+ *
+ * @param cfg Graph to print
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param hdr Mini-ELF header (for the entry point label)
+ */
+void cfg_print (y86_cfg_t *cfg, const byte_t *memory, elf_hdr_t *hdr);
+
+/**
+ * @brief Print the graph in Graphviz DOT format
+ *
+ * @param cfg Graph to print
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param hdr Mini-ELF header (for the entry point label)
+ */
+void cfg_print_dot (y86_cfg_t *cfg, const byte_t *memory, elf_hdr_t *hdr);
+
+#endif
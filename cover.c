@@ -0,0 +1,236 @@
+/*
+ * CS 261: Basic-block coverage
+ *
+ * Name: Aiden Smith
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "cover.h"
+#include "p2-load.h"
+#include "p3-disas.h"
+
+/* Most symbols listed as functions */
+#define COVER_MAXSYMS 1024
+
+/* Blocks listed by cover_print() */
+#define COVER_LIST 10
+
+static inline bool bit_test (const uint64_t *bits, address_t i)
+{
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void bit_set (uint64_t *bits, address_t i)
+{
+    bits[i / 64] |= 1ULL << (i % 64);
+}
+
+void cover_init (y86_cover_t *c, const byte_t *memory,
+        const address_t *roots, int nroots)
+{
+    memset(c, 0, sizeof(*c));
+    cfg_build(&c->cfg, memory, roots, nroots);
+    for (int b = 0; b < c->cfg.nblocks; b++) {
+        const y86_bblock_t *blk = &c->cfg.blocks[b];
+        for (address_t a = blk->start; a < blk->end && a < MEMSIZE; a++) {
+            c->block_of[a] = b + 1;
+        }
+
+        y86_stat_t stat;
+        y86_inst_t inst = decode(memory, blk->last, &stat);
+        if (stat == AOK && inst.icode == JUMP && inst.ifun.jump != JMP) {
+            bit_set(c->branches, blk->last);
+        }
+    }
+}
+
+/**********************************************************************
+ *                            TRACEFILES
+ *********************************************************************/
+
+/* Fold one line of an earlier record for the same program into c */
+static void merge_line (y86_cover_t *c, const char *line)
+{
+    unsigned long addr, hits;
+    int dir;
+    char count[24];
+
+    if (sscanf(line, "DA:%lu,%lu", &addr, &hits) == 2) {
+        if (hits > 0 && addr < MEMSIZE && c->block_of[addr] != 0) {
+            bit_set(c->hit, c->block_of[addr] - 1);
+        }
+    } else if (sscanf(line, "BRDA:%lu,%*d,%d,%23s", &addr, &dir, count) == 3) {
+        if (addr < MEMSIZE && strcmp(count, "-") != 0 && atol(count) > 0) {
+            bit_set(dir == 0 ? c->taken : c->fallen, addr);
+        }
+    }
+}
+
+/* Write the record for one program */
+static void write_record (const y86_cover_t *c, FILE *out,
+        const char *program, FILE *file, elf_hdr_t *hdr)
+{
+    static elf_sym_t syms[COVER_MAXSYMS];
+    const y86_cfg_t *cfg = &c->cfg;
+    int found = 0, hit = 0;
+
+    fprintf(out, "SF:%s\n", program);
+
+    // code symbols that start a block are the functions
+    int nsyms = file != NULL ? read_symbols(file, hdr, syms, COVER_MAXSYMS) : 0;
+    char name[64];
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < nsyms; i++) {
+            address_t addr = syms[i].st_value;
+            if (addr >= MEMSIZE || cfg->block_at[addr] == 0 ||
+                    !read_symbol_name(file, hdr, &syms[i], name, sizeof(name))) {
+                continue;
+            }
+            bool entered = bit_test(c->hit, cfg->block_at[addr] - 1);
+            if (pass == 0) {
+                fprintf(out, "FN:%" PRIu64 ",%s\n", addr, name);
+                found++;
+                hit += entered;
+            } else {
+                fprintf(out, "FNDA:%d,%s\n", entered, name);
+            }
+        }
+    }
+    fprintf(out, "FNF:%d\nFNH:%d\n", found, hit);
+
+    // both directions of every conditional jump
+    found = hit = 0;
+    for (int b = 0; b < cfg->nblocks; b++) {
+        const y86_bblock_t *blk = &cfg->blocks[b];
+        if (!bit_test(c->branches, blk->last)) {
+            continue;
+        }
+        bool entered = bit_test(c->hit, b);
+        bool dirs[2] = { bit_test(c->taken, blk->last),
+                         bit_test(c->fallen, blk->last) };
+        for (int d = 0; d < 2; d++) {
+            if (entered) {
+                fprintf(out, "BRDA:%" PRIu64 ",0,%d,%d\n", blk->last, d,
+                        dirs[d]);
+            } else {
+                fprintf(out, "BRDA:%" PRIu64 ",0,%d,-\n", blk->last, d);
+            }
+            found++;
+            hit += dirs[d];
+        }
+    }
+    fprintf(out, "BRF:%d\nBRH:%d\n", found, hit);
+
+    // every instruction, covered if its block was entered
+    found = hit = 0;
+    for (int b = 0; b < cfg->nblocks; b++) {
+        const y86_bblock_t *blk = &cfg->blocks[b];
+        bool entered = bit_test(c->hit, b);
+        for (address_t a = blk->start; a < blk->end; a++) {
+            if (cfg_test(cfg->visited, a)) {
+                fprintf(out, "DA:%" PRIu64 ",%d\n", a, entered);
+                found++;
+                hit += entered;
+            }
+        }
+    }
+    fprintf(out, "LF:%d\nLH:%d\nend_of_record\n", found, hit);
+}
+
+bool cover_merge (y86_cover_t *c, const char *path, const char *program,
+        FILE *file, elf_hdr_t *hdr)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    FILE *trace = fdopen(fd, "r+");
+    if (trace == NULL) {
+        close(fd);
+        return false;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        fclose(trace);
+        return false;
+    }
+
+    // read back this program's record and keep the others as they are
+    char *others = NULL;
+    size_t len = 0;
+    FILE *keep = open_memstream(&others, &len);
+    char line[1024];
+    bool ours = false;
+    while (keep != NULL && fgets(line, sizeof(line), trace) != NULL) {
+        if (strncmp(line, "SF:", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            ours = strcmp(line + 3, program) == 0;
+            strcat(line, "\n");
+        }
+        if (!ours) {
+            fputs(line, keep);
+        } else if (strncmp(line, "end_of_record", 13) == 0) {
+            ours = false;
+        } else {
+            merge_line(c, line);
+        }
+    }
+    if (keep == NULL || fclose(keep) != 0) {
+        fclose(trace);
+        return false;
+    }
+
+    rewind(trace);
+    bool ok = ftruncate(fd, 0) == 0;
+    fwrite(others, 1, len, trace);
+    write_record(c, trace, program, file, hdr);
+    ok = fflush(trace) == 0 && ok && !ferror(trace);
+    fclose(trace);              // releases the lock
+    free(others);
+    return ok;
+}
+
+/**********************************************************************
+ *                              REPORTS
+ *********************************************************************/
+
+void cover_print (const y86_cover_t *c)
+{
+    const y86_cfg_t *cfg = &c->cfg;
+    int blocks = 0, dirs = 0, branches = 0;
+
+    for (int b = 0; b < cfg->nblocks; b++) {
+        blocks += bit_test(c->hit, b);
+    }
+    for (address_t a = 0; a < MEMSIZE; a++) {
+        if (bit_test(c->branches, a)) {
+            branches++;
+            dirs += bit_test(c->taken, a) + bit_test(c->fallen, a);
+        }
+    }
+
+    printf("Coverage: %d of %d blocks, %d of %d branch directions\n",
+           blocks, cfg->nblocks, dirs, 2 * branches);
+    int listed = 0;
+    for (int b = 0; b < cfg->nblocks; b++) {
+        if (bit_test(c->hit, b)) {
+            continue;
+        }
+        if (listed++ == COVER_LIST) {
+            printf("  ... and %d more blocks not entered\n",
+                   cfg->nblocks - blocks - COVER_LIST);
+            break;
+        }
+        printf("  not entered: 0x%03" PRIx64 "-0x%03" PRIx64 "\n",
+               cfg->blocks[b].start, cfg->blocks[b].end);
+    }
+    if (c->unknown > 0) {
+        printf("  %" PRIu64 " entries into code outside the graph\n",
+               c->unknown);
+    }
+}
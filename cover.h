@@ -0,0 +1,105 @@
+#ifndef __CS261_COVER__
+#define __CS261_COVER__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cfg.h"
+#include "elf.h"
+#include "y86.h"
+
+/*
+ * Basic-block coverage (EXEC_COVER). Blocks are those of the control-flow
+ * graph recovered from the entry point and symbols, numbered in address
+ * order. The run loop does nothing until control enters a block, either by
+ * a transfer or by running off the end of the current one; it then sets
+ * the block's bit and, after a conditional jump, the bit for the direction
+ * it went. Coverage is kept as bitmaps, so runs merge by OR.
+ */
+
+/* Block end given for code outside the graph: never reached by falling
+   through, so only the next transfer is looked at */
+#define COVER_NONE UINT64_MAX
+
+typedef struct y86_cover {
+    y86_cfg_t cfg;
+    uint16_t block_of[MEMSIZE];         // block index + 1 for each address
+    uint64_t hit[MEMSIZE / 64];         // blocks entered, by index
+    uint64_t branches[CFG_WORDS];       // conditional jumps, by address
+    uint64_t taken[CFG_WORDS];          // conditional jumps taken, by address
+    uint64_t fallen[CFG_WORDS];         // and not taken
+    uint64_t unknown;                   // entries into code outside the graph
+} y86_cover_t;
+
+/**
+ * @brief Recover the blocks of a loaded program and clear the coverage
+ *
+ * @param c Coverage to set up
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param roots Addresses where execution may begin (entry point, symbols)
+ * @param nroots Number of roots
+ */
+void cover_init (y86_cover_t *c, const byte_t *memory,
+        const address_t *roots, int nroots);
+
+/**
+ * @brief Note that control entered the block holding pc (called by the run
+ * loop)
+ *
+ * @param c Coverage
+ * @param pc Address control went to
+ * @returns Address just past the block, or COVER_NONE
+ */
+static inline address_t cover_enter (y86_cover_t *c, address_t pc)
+{
+    uint16_t id = pc < MEMSIZE ? c->block_of[pc] : 0;
+    if (id == 0) {
+        c->unknown++;
+        return COVER_NONE;
+    }
+    id--;
+    c->hit[id / 64] |= 1ULL << (id % 64);
+    return c->cfg.blocks[id].end;
+}
+
+/**
+ * @brief Note the direction a conditional jump went (called by the run
+ * loop)
+ *
+ * @param c Coverage
+ * @param pc Address of the jump
+ * @param taken True if it jumped
+ */
+static inline void cover_branch (y86_cover_t *c, address_t pc, bool taken)
+{
+    uint64_t *bits = taken ? c->taken : c->fallen;
+    bits[pc / 64] |= 1ULL << (pc % 64);
+}
+
+/**
+ * @brief Merge the coverage with what an lcov tracefile holds for the same
+ * program, and write the result back as the program's record. The file is
+ * locked meanwhile, so parallel runs can share it; records of other
+ * programs are kept. Line numbers are instruction addresses, and code
+ * symbols become functions.
+ *
+ * @param c Coverage of this run (the merged coverage afterwards)
+ * @param path Tracefile, created if missing
+ * @param program Program file name, used as the record's source file
+ * @param file Open Mini-ELF file, for symbols
+ * @param hdr Its header
+ * @returns False if the tracefile could not be read or written
+ */
+bool cover_merge (y86_cover_t *c, const char *path, const char *program,
+        FILE *file, elf_hdr_t *hdr);
+
+/**
+ * @brief Print how many blocks and branch directions were covered, and
+ * the blocks that were not
+ *
+ * @param c Coverage
+ */
+void cover_print (const y86_cover_t *c);
+
+#endif
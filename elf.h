@@ -95,4 +95,18 @@ typedef struct __attribute__((__packed__)) elf_phdr {
     uint32_t magic;         /* DEADBEEF */
 } elf_phdr_t;
 
+/*
+   Symbol table entry: the symbol's name as an offset into the string table
+   and its virtual address. The symbol table runs from e_symtab up to the
+   string table (or to the end of the file if there is no string table).
+   +---------------+
+   |  0  1 |  2  3 |
+   | name  | value |
+   +---------------+
+*/
+typedef struct __attribute__((__packed__)) elf_sym {
+    uint16_t st_name;       /* offset of the name in the string table */
+    uint16_t st_value;      /* virtual address of the symbol */
+} elf_sym_t;
+
 #endif
@@ -0,0 +1,812 @@
+/*
+ * CS 261: Predecoded execution engine
+ *
+ * Name: Aiden Smith
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "p3-disas.h"
+
+/**********************************************************************
+ *                        INSTRUCTION CACHE
+ *********************************************************************/
+
+y86_engine_t *engine_new (void)
+{
+    y86_engine_t *eng = calloc(1, sizeof(y86_engine_t));
+    if (eng == NULL) {
+        return NULL;
+    }
+    eng->maxblocks = 64;
+    eng->maxinsts = 256;
+    eng->blocks = malloc(eng->maxblocks * sizeof(y86_block_t));
+    eng->insts = malloc(eng->maxinsts * sizeof(y86_pinst_t));
+    if (eng->blocks == NULL || eng->insts == NULL) {
+        engine_free(eng);
+        return NULL;
+    }
+    return eng;
+}
+
+void engine_free (y86_engine_t *eng)
+{
+    if (eng != NULL) {
+        free(eng->blocks);
+        free(eng->insts);
+        free(eng);
+    }
+}
+
+void engine_set_trap (y86_engine_t *eng, y86_trap_fn_t trap, void *ctx)
+{
+    eng->trap = trap;
+    eng->trap_ctx = ctx;
+}
+
+void engine_flush (y86_engine_t *eng)
+{
+    memset(eng->block_at, 0, sizeof(eng->block_at));
+    memset(eng->code_pages, 0, sizeof(eng->code_pages));
+    memcpy(eng->slow_pages, eng->watch_pages, sizeof(eng->slow_pages));
+    eng->nblocks = 0;
+    eng->ninsts = 0;
+}
+
+void engine_restore (y86_engine_t *eng, byte_t *memory,
+        const byte_t *pristine)
+{
+    bool code = false;
+    for (int w = 0; w < PAGEWORDS; w++) {
+        uint64_t bits = eng->dirty_pages[w];
+        code |= (bits & eng->code_pages[w]) != 0;
+        while (bits != 0) {
+            address_t at = (address_t)(w * 64 + __builtin_ctzll(bits)) << PAGEBITS;
+            memcpy(&memory[at], &pristine[at], 1 << PAGEBITS);
+            bits &= bits - 1;
+        }
+        eng->dirty_pages[w] = 0;
+    }
+    if (code) {
+        engine_flush(eng);
+    }
+}
+
+void engine_set_edges (y86_engine_t *eng, uint8_t *edges)
+{
+    eng->edges = edges;
+    eng->prev_edge = 0;
+}
+
+/*
+ * Make room for one more block of up to MAXBLOCK instructions, growing the
+ * arrays or, once they are at their limits, flushing the cache.
+ */
+static bool reserve_block (y86_engine_t *eng)
+{
+    if (eng->nblocks == eng->maxblocks) {
+        if (eng->maxblocks == MEMSIZE) {
+            engine_flush(eng);
+        } else {
+            y86_block_t *blocks = realloc(eng->blocks,
+                    2 * eng->maxblocks * sizeof(y86_block_t));
+            if (blocks == NULL) {
+                return false;
+            }
+            eng->blocks = blocks;
+            eng->maxblocks *= 2;
+        }
+    }
+    while (eng->ninsts + MAXBLOCK > eng->maxinsts) {
+        if (eng->maxinsts == POOLSIZE) {
+            engine_flush(eng);
+            break;
+        }
+        y86_pinst_t *insts = realloc(eng->insts,
+                2 * eng->maxinsts * sizeof(y86_pinst_t));
+        if (insts == NULL) {
+            return false;
+        }
+        eng->insts = insts;
+        eng->maxinsts *= 2;
+    }
+    return true;
+}
+
+static void mark_code (y86_engine_t *eng, address_t start, address_t end)
+{
+    for (address_t page = start >> PAGEBITS; page <= (end - 1) >> PAGEBITS; page++) {
+        eng->code_pages[page / 64] |= 1ULL << (page % 64);
+        eng->slow_pages[page / 64] |= 1ULL << (page % 64);
+    }
+}
+
+static inline bool page_set (const uint64_t *pages, address_t addr)
+{
+    address_t page = addr >> PAGEBITS;
+    return (pages[page / 64] >> (page % 64)) & 1;
+}
+
+static inline bool is_break (y86_engine_t *eng, address_t addr)
+{
+    return (eng->breaks[addr / 64] >> (addr % 64)) & 1;
+}
+
+/* Opcode of a decoded instruction, seen through any breakpoint */
+static inline byte_t real_opcode (const y86_pinst_t *ip)
+{
+    return ip->opcode == BREAKPOINT ? ip->aux : ip->opcode;
+}
+
+/**********************************************************************
+ *                     BREAKPOINTS AND WATCHPOINTS
+ *********************************************************************/
+
+/* Patch every decoded copy of the instruction at addr */
+static void patch_break (y86_engine_t *eng, address_t addr, bool on)
+{
+    for (uint32_t b = 0; b < eng->nblocks; b++) {
+        y86_block_t *blk = &eng->blocks[b];
+        if (addr < blk->start || addr >= blk->start + blk->len) {
+            continue;
+        }
+        address_t pc = blk->start;
+        y86_pinst_t *ip = &eng->insts[blk->first];
+        for (int i = 0; i < blk->count && pc <= addr; i++, pc += ip->len, ip++) {
+            if (pc != addr) {
+                continue;
+            }
+            if (on && ip->opcode != BREAKPOINT) {
+                ip->aux = ip->opcode;
+                ip->opcode = BREAKPOINT;
+            } else if (!on && ip->opcode == BREAKPOINT) {
+                ip->opcode = ip->aux;
+            }
+        }
+    }
+}
+
+bool engine_set_break (y86_engine_t *eng, address_t addr, bool on)
+{
+    if (addr >= MEMSIZE) {
+        return false;
+    }
+    if (on) {
+        eng->breaks[addr / 64] |= 1ULL << (addr % 64);
+    } else {
+        eng->breaks[addr / 64] &= ~(1ULL << (addr % 64));
+    }
+    patch_break(eng, addr, on);
+    return true;
+}
+
+/* Recompute which pages make stores take the slow path */
+static void mark_watches (y86_engine_t *eng)
+{
+    memset(eng->watch_pages, 0, sizeof(eng->watch_pages));
+    for (int w = 0; w < eng->nwatches; w++) {
+        for (address_t page = eng->watches[w].lo >> PAGEBITS;
+                page <= (eng->watches[w].hi - 1) >> PAGEBITS; page++) {
+            eng->watch_pages[page / 64] |= 1ULL << (page % 64);
+        }
+    }
+    for (int i = 0; i < PAGEWORDS; i++) {
+        eng->slow_pages[i] = eng->code_pages[i] | eng->watch_pages[i];
+    }
+}
+
+bool engine_add_watch (y86_engine_t *eng, address_t addr, address_t len)
+{
+    if (len == 0 || addr >= MEMSIZE || len > MEMSIZE - addr ||
+            eng->nwatches == MAXWATCH) {
+        return false;
+    }
+    eng->watches[eng->nwatches].lo = addr;
+    eng->watches[eng->nwatches].hi = addr + len;
+    eng->nwatches++;
+    mark_watches(eng);
+    return true;
+}
+
+bool engine_remove_watch (y86_engine_t *eng, address_t addr, address_t len)
+{
+    for (int w = 0; w < eng->nwatches; w++) {
+        if (eng->watches[w].lo == addr && eng->watches[w].hi == addr + len) {
+            eng->watches[w] = eng->watches[--eng->nwatches];
+            mark_watches(eng);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * A store (or input trap) at pc wrote [addr, addr + len) on a slow page.
+ * Returns true if the run has to stop: decoded code was overwritten (and is
+ * flushed), or a watched range was written.
+ */
+static __attribute__((noinline)) bool slow_store (y86_engine_t *eng,
+        address_t addr, address_t len, address_t pc)
+{
+    bool stop = false;
+    if (page_set(eng->code_pages, addr) ||
+            page_set(eng->code_pages, addr + len - 1)) {
+        engine_flush(eng);
+        stop = true;
+    }
+    for (int w = 0; w < eng->nwatches; w++) {
+        if (addr < eng->watches[w].hi && addr + len > eng->watches[w].lo) {
+            eng->stopped = STOP_WATCH;
+            eng->stop_pc = pc;
+            eng->stop_addr = addr;
+            stop = true;
+            break;
+        }
+    }
+    return stop;
+}
+
+/* Quad-sized memory accesses; every access needs addr + 8 <= MEMSIZE */
+static inline bool mem_ok (y86_reg_t addr)
+{
+    return addr <= MEMSIZE - 8;
+}
+
+/**********************************************************************
+ *                        BOUNDS VERIFICATION
+ *********************************************************************/
+
+/* What is known about a register at some point in a block */
+typedef struct {
+    enum { VAL_UNKNOWN, VAL_CONST, VAL_ENTRY } kind;
+    uint8_t reg;                // VAL_ENTRY: register holding the base on entry
+    int64_t off;                // VAL_CONST: value; VAL_ENTRY: offset from base
+} absval_t;
+
+static const absval_t unknown = { VAL_UNKNOWN, 0, 0 };
+
+static inline bool same_value (absval_t a, absval_t b)
+{
+    return a.kind != VAL_UNKNOWN && a.kind == b.kind && a.off == b.off &&
+           (a.kind != VAL_ENTRY || a.reg == b.reg);
+}
+
+/* Offsets from entry values are kept small so they cannot overflow */
+static inline bool small (int64_t off)
+{
+    return off >= -MEMSIZE && off <= MEMSIZE;
+}
+
+static absval_t add_const (absval_t v, int64_t c)
+{
+    if (v.kind == VAL_CONST) {
+        v.off = (int64_t)((uint64_t)v.off + (uint64_t)c);
+    } else if (v.kind == VAL_ENTRY && small(c) && small(v.off + c)) {
+        v.off += c;
+    } else {
+        v = unknown;
+    }
+    return v;
+}
+
+/* Value of rB after OPq rA, rB */
+static absval_t op_value (int op, int ra, int rb, absval_t a, absval_t b)
+{
+    if (ra == rb && (op == SUB || op == XOR)) {
+        absval_t zero = { VAL_CONST, 0, 0 };
+        return zero;
+    }
+    if (op == ADD && a.kind == VAL_CONST) {
+        return add_const(b, a.off);
+    }
+    if (op == ADD && b.kind == VAL_CONST) {
+        return add_const(a, b.off);
+    }
+    if (op == SUB && a.kind == VAL_CONST) {
+        return add_const(b, (int64_t)(0 - (uint64_t)a.off));
+    }
+    if (a.kind == VAL_CONST && b.kind == VAL_CONST) {
+        absval_t v = { VAL_CONST, 0, op == AND ? a.off & b.off : a.off ^ b.off };
+        return v;
+    }
+    return unknown;
+}
+
+/*
+ * Prove that a quad access at base + d is in bounds: directly for a known
+ * constant, or by widening the entry check on the base register.
+ */
+static bool prove_access (y86_block_t *blk, absval_t base, int64_t d)
+{
+    if (base.kind == VAL_CONST) {
+        return mem_ok((y86_reg_t)base.off + (y86_reg_t)d);
+    }
+    if (base.kind != VAL_ENTRY || !small(d)) {
+        return false;
+    }
+
+    int64_t off = base.off + d;
+    y86_guard_t *g = blk->guards;
+    while (g < blk->guards + blk->nguards && g->reg != base.reg) {
+        g++;
+    }
+    if (g == blk->guards + blk->nguards) {
+        if (blk->nguards == MAXGUARDS) {
+            return false;
+        }
+        blk->nguards++;
+        g->reg = base.reg;
+        g->lo = off;
+        g->span = 0;
+    }
+
+    int64_t lo = off < g->lo ? off : g->lo;
+    int64_t hi = g->lo + (int64_t)g->span;
+    hi = off > hi ? off : hi;
+    if (hi - lo > MEMSIZE - 8) {
+        return false;
+    }
+    g->lo = lo;
+    g->span = hi - lo;
+    return true;
+}
+
+/*
+ * Track register values through a block and mark it verified if every
+ * memory access can be proven in bounds by at most MAXGUARDS entry checks.
+ * Instructions that fault for other reasons (e.g., rmmovq without a base
+ * register) stop the block before any later access, so they need no proof.
+ */
+static void verify_block (y86_block_t *blk, const y86_pinst_t *insts)
+{
+    absval_t regs[NOREG + 1];
+    for (int r = 0; r <= NOREG; r++) {
+        regs[r].kind = VAL_ENTRY;
+        regs[r].reg = r;
+        regs[r].off = 0;
+    }
+    blk->verified = false;
+    blk->nguards = 0;
+
+    for (const y86_pinst_t *ip = insts; ip < insts + blk->count; ip++) {
+        int ra = ip->regs >> 4;
+        int rb = ip->regs & 0x0F;
+
+        byte_t opcode = real_opcode(ip);
+        switch (opcode >> 4) {
+            case CMOV:
+                if ((opcode & 0x0F) == RRMOVQ) {
+                    regs[rb] = regs[ra];
+                } else if (!same_value(regs[ra], regs[rb])) {
+                    regs[rb] = unknown;
+                }
+                break;
+            case IRMOVQ:
+                regs[rb].kind = VAL_CONST;
+                regs[rb].off = ip->valC;
+                break;
+            case RMMOVQ:
+                if (rb != NOREG && !prove_access(blk, regs[rb], ip->valC)) {
+                    return;
+                }
+                break;
+            case MRMOVQ:
+                if (rb != NOREG && !prove_access(blk, regs[rb], ip->valC)) {
+                    return;
+                }
+                regs[ra] = unknown;
+                break;
+            case OPQ:
+                regs[rb] = op_value(opcode & 0x0F, ra, rb, regs[ra], regs[rb]);
+                break;
+            case CALL:
+            case PUSHQ:
+                if (!prove_access(blk, regs[RSP], -8)) {
+                    return;
+                }
+                regs[RSP] = add_const(regs[RSP], -8);
+                break;
+            case RET:
+            case POPQ:
+                if (!prove_access(blk, regs[RSP], 0)) {
+                    return;
+                }
+                regs[RSP] = add_const(regs[RSP], 8);
+                regs[ra] = unknown;
+                break;
+            default:
+                break;
+        }
+    }
+    blk->verified = true;
+}
+
+/*
+ * Predecode the block starting at pc. Returns NULL and sets *stat if the
+ * first instruction cannot be decoded (or the cache cannot grow); later bad
+ * instructions simply end the block, and fault once execution reaches them.
+ */
+static y86_block_t *build_block (y86_engine_t *eng, byte_t *memory,
+        address_t pc, y86_stat_t *stat)
+{
+    if (pc >= MEMSIZE) {
+        *stat = ADR;
+        return NULL;
+    }
+    if (!reserve_block(eng)) {
+        *stat = INS;
+        return NULL;
+    }
+
+    y86_block_t *blk = &eng->blocks[eng->nblocks];
+    blk->start = pc;
+    blk->first = eng->ninsts;
+    blk->count = 0;
+
+    address_t addr = pc;
+    while (blk->count < MAXBLOCK && addr < MEMSIZE) {
+        y86_stat_t s;
+        y86_inst_t inst = decode(memory, addr, &s);
+        if (s != AOK) {
+            if (blk->count == 0) {
+                *stat = s;
+                return NULL;
+            }
+            break;
+        }
+        y86_pinst_t *ip = &eng->insts[blk->first + blk->count++];
+        *ip = pack_inst(&inst, addr);
+        if (is_break(eng, addr)) {
+            ip->aux = ip->opcode;
+            ip->opcode = BREAKPOINT;
+        }
+        addr = inst.valP;
+
+        if (inst.icode == JUMP || inst.icode == CALL || inst.icode == RET ||
+                inst.icode == HALT) {
+            break;
+        }
+    }
+
+    blk->len = addr - pc;
+    verify_block(blk, &eng->insts[blk->first]);
+    mark_code(eng, pc, addr);
+    eng->ninsts += blk->count;
+    eng->block_at[pc] = ++eng->nblocks;
+    return blk;
+}
+
+/**********************************************************************
+ *                             EXECUTION
+ *********************************************************************/
+
+/* Condition codes for cmovXX and jXX, as in Cond() */
+static inline bool cond_holds (y86_t *cpu, int ifun)
+{
+    bool lt = cpu->sf != cpu->of;
+    switch (ifun) {
+        case JMP: return true;
+        case JLE: return lt || cpu->zf;
+        case JL:  return lt;
+        case JE:  return cpu->zf;
+        case JNE: return !cpu->zf;
+        case JGE: return !lt;
+        case JG:  return !lt && !cpu->zf;
+        default:  return false;
+    }
+}
+
+static inline y86_reg_t load_quad (byte_t *memory, y86_reg_t addr)
+{
+    y86_reg_t v;
+    memcpy(&v, &memory[addr], 8);
+    return v;
+}
+
+/* Note a store of len bytes (in bounds) at addr in dirty_pages */
+static inline void mark_dirty (y86_engine_t *eng, address_t addr,
+        address_t len)
+{
+    address_t first = addr >> PAGEBITS, last = (addr + len - 1) >> PAGEBITS;
+    eng->dirty_pages[first / 64] |= 1ULL << (first % 64);
+    eng->dirty_pages[last / 64] |= 1ULL << (last % 64);
+}
+
+/* Store a quad for the instruction at pc; returns true if the run has to
+   stop (see slow_store()) */
+static inline bool store_quad (y86_engine_t *eng, byte_t *memory,
+        y86_reg_t addr, y86_reg_t v, address_t pc)
+{
+    memcpy(&memory[addr], &v, 8);
+    mark_dirty(eng, addr, 8);
+    return (page_set(eng->slow_pages, addr) ||
+            page_set(eng->slow_pages, addr + 7)) &&
+           slow_store(eng, addr, 8, pc);
+}
+
+/*
+ * Hand an IOTRAP to the host handler, with the PC brought up to date for
+ * it. Returns false if the trap blocked.
+ */
+static inline bool call_trap (y86_engine_t *eng, y86_t *cpu, byte_t *memory,
+        address_t pc, int trap)
+{
+    cpu->pc = pc;
+    return eng->trap(eng->trap_ctx, cpu, memory, trap);
+}
+
+/* Did an input trap at pc just store to a slow page, and does the run have
+   to stop for it? */
+static inline bool input_store (y86_engine_t *eng, y86_t *cpu, int trap,
+        address_t pc)
+{
+    y86_reg_t dst = cpu->reg[RDI];
+    address_t len = (trap == CHARIN) ? 1 : 8;
+    if (trap != CHARIN && trap != DECIN) {
+        return false;
+    }
+    mark_dirty(eng, dst, len);
+    return (page_set(eng->slow_pages, dst) ||
+            page_set(eng->slow_pages, dst + len - 1)) &&
+           slow_store(eng, dst, len, pc);
+}
+
+/*
+ * Execute up to n instructions of a block starting at *pc. The checked
+ * variant tests every address; the unchecked one is only used for verified
+ * blocks whose entry checks hold. Returns the number of instructions run.
+ */
+static inline __attribute__((always_inline)) uint32_t run_block (
+        y86_engine_t *eng, y86_t *cpu, byte_t *memory,
+        const y86_pinst_t *ip, uint32_t n, address_t *pcp, bool checked)
+{
+    address_t pc = *pcp;
+    bool stop = false;
+    uint32_t i;
+    for (i = 0; i < n && !stop; i++, ip++) {
+        int ra = ip->regs >> 4;
+        int rb = ip->regs & 0x0F;
+        address_t valP = pc + ip->len;
+        y86_reg_t addr;
+
+        switch (ip->opcode >> 4) {
+            case HALT:
+                cpu->stat = HLT;
+                stop = true;
+                break;
+
+            case NOP:
+                break;
+
+            case IOTRAP:
+                if (eng->trap == NULL) {
+                    break;              // no host I/O: the trap does nothing
+                }
+                if (!call_trap(eng, cpu, memory, pc, ip->opcode & 0x0F)) {
+                    eng->blocked = true;    // not executed: stop in front
+                    valP = pc;
+                    stop = true;
+                    i--;
+                    break;
+                }
+                stop = cpu->stat != AOK ||
+                       input_store(eng, cpu, ip->opcode & 0x0F, pc);
+                break;
+
+            case CMOV:
+                if (cond_holds(cpu, ip->opcode & 0x0F)) {
+                    cpu->reg[rb] = cpu->reg[ra];
+                }
+                break;
+
+            case IRMOVQ:
+                cpu->reg[rb] = ip->valC;
+                break;
+
+            case RMMOVQ:
+                if (rb == NOREG) {
+                    cpu->stat = INS;    // no base register: PC stays put
+                    valP = pc;
+                    stop = true;
+                    break;
+                }
+                addr = cpu->reg[rb] + ip->valC;
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;    // the PC stays put as well
+                    valP = pc;
+                    stop = true;
+                    break;
+                }
+                stop = store_quad(eng, memory, addr, cpu->reg[ra], pc);
+                break;
+
+            case MRMOVQ:
+                if (rb == NOREG) {
+                    cpu->stat = INS;
+                    valP = pc;
+                    stop = true;
+                    break;
+                }
+                addr = cpu->reg[rb] + ip->valC;
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;
+                    stop = true;
+                    break;
+                }
+                cpu->reg[ra] = load_quad(memory, addr);
+                break;
+
+            case OPQ:
+                switch (ip->opcode & 0x0F) {
+                    case ADD: cpu->reg[rb] += cpu->reg[ra]; break;
+                    case SUB: cpu->reg[rb] -= cpu->reg[ra]; break;
+                    case AND: cpu->reg[rb] &= cpu->reg[ra]; break;
+                    case XOR: cpu->reg[rb] ^= cpu->reg[ra]; break;
+                }
+                break;
+
+            case JUMP:
+                if (cond_holds(cpu, ip->opcode & 0x0F)) {
+                    valP = ip->valC;
+                }
+                break;
+
+            case CALL:
+                addr = cpu->reg[RSP] - 8;
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;
+                    stop = true;
+                    break;
+                }
+                cpu->reg[RSP] = addr;
+                stop = store_quad(eng, memory, addr, valP, pc);
+                valP = ip->valC;
+                break;
+
+            case RET:
+                addr = cpu->reg[RSP];
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;
+                    stop = true;
+                    break;
+                }
+                cpu->reg[RSP] = addr + 8;
+                valP = load_quad(memory, addr);
+                break;
+
+            case PUSHQ:
+                addr = cpu->reg[RSP] - 8;
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;
+                    stop = true;
+                    break;
+                }
+                stop = store_quad(eng, memory, addr, cpu->reg[ra], pc);
+                cpu->reg[RSP] = addr;
+                break;
+
+            case POPQ:
+                addr = cpu->reg[RSP];
+                if (checked && !mem_ok(addr)) {
+                    cpu->stat = ADR;
+                    stop = true;
+                    break;
+                }
+                cpu->reg[RSP] = addr + 8;
+                cpu->reg[ra] = load_quad(memory, addr);
+                break;
+
+            case BREAKPOINT >> 4:
+                eng->stopped = STOP_BREAK;  // not executed: stop in front
+                eng->stop_pc = pc;
+                eng->skip_break = true;
+                valP = pc;
+                stop = true;
+                i--;
+                break;
+
+            default:
+                cpu->stat = INS;
+                valP = pc;
+                stop = true;
+                break;
+        }
+        pc = valP;
+    }
+    *pcp = pc;
+    return i;
+}
+
+static inline bool guards_hold (const y86_block_t *blk, const y86_t *cpu)
+{
+    for (int g = 0; g < blk->nguards; g++) {
+        const y86_guard_t *guard = &blk->guards[g];
+        y86_reg_t lo = cpu->reg[guard->reg] + (y86_reg_t)(int64_t)guard->lo;
+        if (lo > MEMSIZE - 8 - guard->span) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t engine_run (y86_engine_t *eng, y86_t *cpu, byte_t *memory,
+        uint64_t limit)
+{
+    uint64_t count = 0;
+
+    uint64_t deadline = eng->deadline;
+    uint32_t ticks = 1;         // read the clock on entry too, for short runs
+
+    eng->blocked = false;
+    eng->stopped = STOP_NONE;
+
+    // resuming from a breakpoint: run its instruction once, undecoded
+    if (eng->skip_break && cpu->pc == eng->stop_pc && cpu->stat == AOK &&
+            limit > 0) {
+        address_t pc = cpu->pc;
+        y86_stat_t stat = AOK;
+        y86_inst_t inst = decode(memory, pc, &stat);
+        if (stat != AOK) {
+            cpu->stat = stat;
+        } else {
+            y86_pinst_t one = pack_inst(&inst, pc);
+            count += run_block(eng, cpu, memory, &one, 1, &pc, true);
+            cpu->pc = pc;
+        }
+    }
+    eng->skip_break = eng->blocked;     // a blocked trap is retried first
+
+    while (cpu->stat == AOK && count < limit && !eng->blocked &&
+            eng->stopped == STOP_NONE) {
+
+        if (deadline != 0 && --ticks == 0) {
+            ticks = TIME_CHECK;
+            if (y86_clock_ns() >= deadline) {
+                cpu->stat = TMO;
+                break;
+            }
+        }
+
+        // find (or predecode) the block at the PC
+        address_t pc = cpu->pc;
+        y86_block_t *blk = NULL;
+        if (pc < MEMSIZE && eng->block_at[pc]) {
+            blk = &eng->blocks[eng->block_at[pc] - 1];
+        } else {
+            y86_stat_t stat = AOK;
+            blk = build_block(eng, memory, pc, &stat);
+            if (blk == NULL && pc < MEMSIZE && is_break(eng, pc)) {
+                eng->stopped = STOP_BREAK;  // stop before the fault, too
+                eng->stop_pc = pc;
+                eng->skip_break = true;
+                break;
+            }
+            if (blk == NULL) {
+                cpu->stat = stat;
+                break;
+            }
+        }
+
+        if (eng->edges != NULL) {
+            uint32_t id = (uint32_t)(pc * 0x9E3779B1u) >> (32 - EDGE_BITS);
+            eng->edges[id ^ eng->prev_edge]++;
+            eng->prev_edge = id >> 1;
+        }
+
+        const y86_pinst_t *ip = &eng->insts[blk->first];
+        uint32_t n = blk->count;
+        if (n > limit - count) {
+            n = limit - count;
+        }
+
+        if (blk->verified && guards_hold(blk, cpu)) {
+            count += run_block(eng, cpu, memory, ip, n, &pc, false);
+        } else {
+            count += run_block(eng, cpu, memory, ip, n, &pc, true);
+        }
+        cpu->pc = pc;
+    }
+    return count;
+}
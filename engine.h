@@ -0,0 +1,227 @@
+#ifndef __CS261_ENGINE__
+#define __CS261_ENGINE__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "y86.h"
+
+/* Most instructions predecoded into one block */
+#define MAXBLOCK 64
+
+/* Largest predecoded instruction pool; the cache is flushed when it fills
+   up. The block and instruction arrays start small and grow on demand. */
+#define POOLSIZE (4 * MEMSIZE)
+
+/* Blocks run between reads of the clock when a deadline is set */
+#define TIME_CHECK 1024
+
+/* Most watched memory ranges */
+#define MAXWATCH 16
+
+/* Edge coverage map: (1 << EDGE_BITS) one-byte hit counters */
+#define EDGE_BITS 14
+#define EDGE_MAP (1 << EDGE_BITS)
+
+/* Predecoded opcode that replaces an instruction with a breakpoint; the
+   original opcode is kept in the instruction's aux field */
+#define BREAKPOINT 0xF0
+
+/* Most base registers a verified block may check on entry */
+#define MAXGUARDS 3
+
+/*
+ * Entry check for a verified block: every access based on reg's value at
+ * block entry lies at an offset in [lo, lo + span], so one comparison on
+ * entry proves all of them in bounds.
+ */
+typedef struct y86_guard {
+    uint8_t reg;                // base register
+    int32_t lo;                 // lowest offset from its entry value
+    uint32_t span;              // highest offset - lowest offset
+} y86_guard_t;
+
+/* Straight-line run of predecoded instructions, ending at the first control
+   transfer (jXX, call, ret or halt) or at MAXBLOCK instructions */
+typedef struct y86_block {
+    address_t start;            // address of the first instruction
+    uint32_t first;             // index of the first instruction in the pool
+    uint16_t count;             // number of instructions
+    uint16_t len;               // number of bytes
+    bool verified;              // accesses proven in bounds once guards hold
+    uint8_t nguards;            // number of entry checks
+    y86_guard_t guards[MAXGUARDS];
+} y86_block_t;
+
+/* Why the last run stopped at a breakpoint or watchpoint */
+typedef enum {
+    STOP_NONE,
+    STOP_BREAK,                 // in front of the instruction at stop_pc
+    STOP_WATCH                  // after stop_pc stored to stop_addr
+} y86_stop_t;
+
+/* Watched memory range [lo, hi) */
+typedef struct y86_watch {
+    address_t lo, hi;
+} y86_watch_t;
+
+/* Host handler for IOTRAP. Returns false if the trap has to wait (e.g., for
+   input); it is then not executed and the run stops in front of it. */
+typedef bool (*y86_trap_fn_t) (void *ctx, y86_t *cpu, byte_t *memory,
+        int trap);
+
+/*
+ * Predecoded execution engine. Instructions are decoded once into compact
+ * y86_pinst_t blocks and executed from there; stores into memory that holds
+ * decoded instructions flush the cache, so self-modifying code still sees
+ * the bytes it wrote.
+ *
+ * Blocks whose memory addresses are all constant or a small offset from a
+ * register's value on entry (e.g., %rsp-relative pushes, pops and calls)
+ * are verified when they are built. If the entry checks pass, such a block
+ * runs without per-access bounds checks; otherwise it runs the checked
+ * code, which raises ADR exactly as the stages do.
+ *
+ * Breakpoints are decoded as a BREAKPOINT instruction in place of the one at
+ * their address, and only pages holding decoded code or watched ranges make
+ * stores take the slow path, so neither costs anything when none is set.
+ */
+typedef struct y86_engine {
+    uint32_t block_at[MEMSIZE];         // block index + 1 for each address
+    y86_block_t *blocks;
+    uint32_t nblocks, maxblocks;
+    y86_pinst_t *insts;
+    uint32_t ninsts, maxinsts;
+    uint64_t code_pages[PAGEWORDS];     // pages holding decoded instructions
+    uint64_t watch_pages[PAGEWORDS];    // pages holding watched bytes
+    uint64_t slow_pages[PAGEWORDS];     // union of the two above
+    uint64_t breaks[MEMSIZE / 64];      // breakpoint addresses
+    y86_watch_t watches[MAXWATCH];
+    int nwatches;
+    y86_trap_fn_t trap;                 // IOTRAP handler (NULL: no-op)
+    void *trap_ctx;
+    bool blocked;                       // last run stopped at a waiting trap
+    uint64_t deadline;                  // y86_clock_ns() time to stop with
+                                        // TMO (0: none)
+    y86_stop_t stopped;                 // last run hit a break/watchpoint
+    address_t stop_pc;                  // instruction that hit it
+    address_t stop_addr;                // STOP_WATCH: address stored to
+    bool skip_break;                    // next run first executes the
+                                        // instruction at stop_pc
+    uint64_t dirty_pages[PAGEWORDS];    // pages stored to since the last
+                                        // engine_restore()
+    uint8_t *edges;                     // edge hit counters (EDGE_MAP
+                                        // bytes), or NULL for none
+    uint32_t prev_edge;                 // hashed id of the last block, >> 1
+} y86_engine_t;
+
+/**
+ * @brief Allocate an engine with an empty instruction cache
+ *
+ * @returns Pointer to the new engine, or NULL if it could not be allocated
+ */
+y86_engine_t *engine_new (void);
+
+/**
+ * @brief Release an engine
+ *
+ * @param eng Engine to free (may be NULL)
+ */
+void engine_free (y86_engine_t *eng);
+
+/**
+ * @brief Attach a host handler for IOTRAP. Without one, IOTRAP does nothing,
+ * as in memory_wb_pc().
+ *
+ * @param eng Engine
+ * @param trap Handler, or NULL to detach it
+ * @param ctx Argument passed to the handler
+ */
+void engine_set_trap (y86_engine_t *eng, y86_trap_fn_t trap, void *ctx);
+
+/**
+ * @brief Drop every predecoded instruction; must be called whenever memory
+ * is changed other than by the engine itself (e.g., reloading an image)
+ *
+ * @param eng Engine to flush
+ */
+void engine_flush (y86_engine_t *eng);
+
+/**
+ * @brief Copy the pages stored to since the last call back from the image
+ * the run started from, so that memory matches it again; decoded code is
+ * flushed only if one of those pages holds some
+ *
+ * @param eng Engine
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param pristine Copy of the address space to return to
+ */
+void engine_restore (y86_engine_t *eng, byte_t *memory,
+        const byte_t *pristine);
+
+/**
+ * @brief Count control transfers between blocks into an AFL-style map:
+ * each block entry adds one to the counter for (id(from) >> 1) ^ id(to),
+ * where id() hashes the block's address. With no map, this costs a test
+ * per block.
+ *
+ * @param eng Engine
+ * @param edges EDGE_MAP counters to add to, or NULL to stop counting
+ */
+void engine_set_edges (y86_engine_t *eng, uint8_t *edges);
+
+/**
+ * @brief Set or clear a breakpoint. Instructions already decoded at the
+ * address are patched in place.
+ *
+ * @param eng Engine
+ * @param addr Address of the instruction
+ * @param on True to set the breakpoint, false to clear it
+ * @returns False if the address is outside memory
+ */
+bool engine_set_break (y86_engine_t *eng, address_t addr, bool on);
+
+/**
+ * @brief Watch stores to a memory range
+ *
+ * @param eng Engine
+ * @param addr First byte of the range
+ * @param len Number of bytes
+ * @returns False if the range is empty or outside memory, or MAXWATCH
+ * ranges are watched already
+ */
+bool engine_add_watch (y86_engine_t *eng, address_t addr, address_t len);
+
+/**
+ * @brief Stop watching a range added with engine_add_watch()
+ *
+ * @param eng Engine
+ * @param addr First byte of the range
+ * @param len Number of bytes
+ * @returns False if the range was not watched
+ */
+bool engine_remove_watch (y86_engine_t *eng, address_t addr, address_t len);
+
+/**
+ * @brief Run the CPU until it stops, limit instructions have executed or
+ * an IOTRAP blocks (eng->blocked is then set). The resulting state and
+ * instruction count are identical to stepping the
+ * fetch/decode_execute/memory_wb_pc stages. The limit is checked once per
+ * block and leaves the CPU runnable; passing eng->deadline (checked every
+ * TIME_CHECK blocks) stops it with TMO.
+ *
+ * A breakpoint stops the run in front of its instruction, and a store to a
+ * watched range right after the storing instruction; eng->stopped says
+ * which, and the CPU stays runnable. Running again from a breakpoint
+ * executes its instruction first.
+ *
+ * @param eng Engine holding the instruction cache for memory
+ * @param cpu Y86 CPU structure (runs only if its status is AOK)
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param limit Maximum number of instructions to execute
+ * @returns Number of instructions executed
+ */
+uint64_t engine_run (y86_engine_t *eng, y86_t *cpu, byte_t *memory,
+        uint64_t limit);
+
+#endif
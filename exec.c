@@ -0,0 +1,727 @@
+/*
+ * CS 261: Specialized run loops
+ *
+ * Name: Aiden Smith
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exec.h"
+#include "p3-disas.h"
+#include "p4-interp.h"
+
+/**********************************************************************
+ *                             RUN LOOP
+ *********************************************************************/
+
+/* Does the instruction store a quad at valE? */
+static inline bool is_store (y86_icode_t icode)
+{
+    return icode == RMMOVQ || icode == CALL || icode == PUSHQ;
+}
+
+static inline uint64_t read_quad (const byte_t *memory, address_t addr)
+{
+    uint64_t v;
+    memcpy(&v, &memory[addr], 8);
+    return v;
+}
+
+/*
+ * EXEC_SAMPLE: control went from an instruction ending at fallthrough to
+ * target. Samples are taken as control leaves a block; calls and returns
+ * keep the shadow stack that the sample records.
+ */
+static inline void sample_leave (y86_sampler_t *smp, address_t *block,
+        y86_icode_t icode, address_t fallthrough, address_t target)
+{
+    if (target == fallthrough) {
+        return;
+    }
+    if (sample_due) {
+        sample_record(smp, *block);
+    }
+    if (icode == CALL) {
+        smp->calls[smp->depth++ % SAMPLE_DEPTH] = target;
+    } else if (icode == RET && smp->depth > 0) {
+        smp->depth--;
+    }
+    *block = target;
+}
+
+/*
+ * The stage loop, with every feature test on a constant. Each instantiation
+ * below passes a literal feature set, so the compiler drops the code for the
+ * features that are off along with the tests themselves.
+ */
+static inline __attribute__((always_inline)) void run_loop (y86_exec_t *ex,
+        unsigned features)
+{
+    y86_t *cpu = &ex->cpu;
+    byte_t *memory = ex->memory;
+    uint64_t limit = ex->limit ? ex->limit : UINT64_MAX;
+    uint64_t deadline = ex->deadline;
+    uint32_t ticks = EXEC_TIME_CHECK;
+
+    // the next snapshot shares the budget test: the loop stops at whichever
+    // count comes first and sorts out which it was
+    uint64_t next = limit;
+    if (ex->snap != NULL && ex->snap_every < limit) {
+        next = ex->snap_every;
+    }
+
+    address_t block = cpu->pc;          // EXEC_SAMPLE: current block
+
+    // EXEC_COVER: end of the current block, where falling through enters
+    // the next one
+    address_t block_end = 0;
+    if (features & EXEC_COVER) {
+        block_end = cover_enter(ex->cover, cpu->pc);
+    }
+
+    while (cpu->stat == AOK || cpu->stat == HLT) {
+        address_t pc = cpu->pc;
+
+        /* Fetch instruction */
+        y86_inst_t inst = fetch(cpu, memory);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            break;
+        }
+        ex->count++;
+
+        if (features & EXEC_PROFILE) {
+            ex->profile[pc]++;
+        }
+        if (features & EXEC_STATS) {
+            ex->stats.icodes[inst.icode]++;
+        }
+
+        /* Decode and execute */
+        bool cnd = false;
+        y86_reg_t valA = 0;
+        y86_reg_t valE = decode_execute(cpu, &inst, &cnd, &valA);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            break;
+        }
+
+        // remember the watched quad a store is about to overwrite
+        bool watched = false;
+        uint64_t before = 0;
+        if (features & EXEC_WATCH) {
+            watched = is_store(inst.icode) && valE <= MEMSIZE - 8 &&
+                      valE < ex->watch_hi && valE + 8 > ex->watch_lo;
+            if (watched) {
+                before = read_quad(memory, valE);
+            }
+        }
+
+        /* Memory access, write-back, and PC update */
+        memory_wb_pc_dirty(cpu, &inst, memory, cnd, valA, valE, ex->dirty);
+
+        if (features & EXEC_STATS) {
+            if (inst.icode == JUMP && inst.ifun.jump != JMP) {
+                if (cnd) {
+                    ex->stats.taken++;
+                } else {
+                    ex->stats.not_taken++;
+                }
+            } else if (inst.icode == CMOV && inst.ifun.cmov != RRMOVQ && cnd) {
+                ex->stats.cmovs++;
+            }
+        }
+
+        if ((features & EXEC_WATCH) && watched &&
+                read_quad(memory, valE) != before) {
+            if (features & EXEC_TRACE) {
+                trace_watch(ex->tracer, pc, valE, before,
+                            read_quad(memory, valE), cpu);
+            } else {
+                printf("Watch: 0x%04" PRIx64 ": %016" PRIx64 " -> %016" PRIx64
+                       " (pc 0x%04" PRIx64 ")\n", valE, before,
+                       read_quad(memory, valE), pc);
+            }
+        }
+
+        // the writer thread formats the trace; filtered-out instructions
+        // only bump a counter
+        bool skipped = false;
+        if (features & EXEC_TRACE) {
+            if (ex->filter == NULL ||
+                    trace_wanted(ex->filter, pc, ex->count - 1, cpu, memory)) {
+                trace_step(ex->tracer, pc, &inst, cpu);
+            } else {
+                trace_skip(ex->tracer);
+                skipped = true;
+            }
+        }
+
+        if (cpu->stat == HLT || cpu->stat != AOK) {
+            break; // Exit loop when halt is encountered
+        }
+
+        if (features & EXEC_SAMPLE) {
+            sample_leave(ex->sampler, &block, inst.icode, inst.valP, cpu->pc);
+        }
+
+        // coverage is only recorded as control enters a block
+        if ((features & EXEC_COVER) &&
+                (cpu->pc != inst.valP || inst.valP == block_end)) {
+            if (inst.icode == JUMP && inst.ifun.jump != JMP) {
+                cover_branch(ex->cover, pc, cnd);
+            }
+            block_end = cover_enter(ex->cover, cpu->pc);
+        }
+
+        // a program can only run forever by jumping back, so the budget
+        // and the clock are checked there rather than every instruction
+        if (cpu->pc <= pc) {
+            if (ex->count >= next) {
+                if (ex->count >= limit) {
+                    cpu->stat = TMO;
+                    break;
+                }
+                snap_publish(ex->snap, cpu, ex->count,
+                             (features & EXEC_PROFILE) ? ex->profile : NULL);
+                next = limit - ex->count > ex->snap_every ?
+                       ex->count + ex->snap_every : limit;
+            }
+            if (deadline != 0 && --ticks == 0) {
+                ticks = EXEC_TIME_CHECK;
+                if (y86_clock_ns() >= deadline) {
+                    cpu->stat = TMO;
+                    break;
+                }
+            }
+        }
+
+        // run_trace() runs what a filter leaves out on run_local()
+        if (features == EXEC_TRACE && skipped) {
+            break;
+        }
+    }
+
+    if (ex->snap != NULL) {
+        snap_publish(ex->snap, cpu, ex->count,
+                     (features & EXEC_PROFILE) ? ex->profile : NULL);
+    }
+}
+
+/*
+ * The plain loop (no features, only EXEC_SAMPLE and EXEC_COVER, or the
+ * instructions a trace filter leaves out) keeps the guest state in
+ * locals: the PC, the
+ * instruction count, and one local per register, read and written through a
+ * switch on the register number so that none of them has to live in memory.
+ * Every instruction but halt runs inline. For halt, faults and out-of-range
+ * accesses it writes the locals back and steps through the stage functions,
+ * so the result is the same as run_loop() with the same features.
+ */
+#define FOR_REGS(X) X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) \
+                    X(8) X(9) X(10) X(11) X(12) X(13) X(14)
+
+#define DECL_REG(k)     y86_reg_t r##k = cpu->reg[k];
+#define LOAD_REG(k)     r##k = cpu->reg[k];
+#define SAVE_REG(k)     cpu->reg[k] = r##k;
+#define GET_CASE(k)     case k: v_ = r##k; break;
+#define SET_CASE(k)     case k: r##k = s_; break;
+
+#define REG(n) ({ \
+        y86_reg_t v_ = 0; \
+        switch (n) { FOR_REGS(GET_CASE) default: break; } \
+        v_; })
+#define SET_REG(n, v) do { \
+        y86_reg_t s_ = (v); \
+        switch (n) { FOR_REGS(SET_CASE) default: break; } \
+    } while (0)
+
+/* Conditions that hold for the flags, one bit per cmovXX/jXX ifun */
+static unsigned cond_mask (const y86_t *cpu)
+{
+    bool lt = cpu->sf != cpu->of;
+    return 1u << JMP | (lt || cpu->zf) << JLE | lt << JL | cpu->zf << JE |
+           !cpu->zf << JNE | !lt << JGE | (!lt && !cpu->zf) << JG;
+}
+
+/* Note a quad store at addr in the dirty-page bitmap */
+static inline void note_store (uint64_t *dirty, address_t addr)
+{
+    address_t first = addr >> PAGEBITS, last = (addr + 7) >> PAGEBITS;
+    dirty[first / 64] |= 1ULL << (first % 64);
+    dirty[last / 64] |= 1ULL << (last % 64);
+}
+
+/*
+ * EXEC_TRACE: what could make the filter want an instruction that run_local()
+ * runs. Everything else it runs is left out without asking.
+ */
+typedef struct skip {
+    uint64_t from;          // window start, once the trigger has fired
+    address_t pc_stop;      // first traced address from the block on
+    uint8_t reg;            // register the trigger watches (NOREG: none)
+    address_t lo, hi;       // quad the trigger watches (empty: none)
+    uint64_t counted;       // instructions accounted to the tracer
+} skip_t;
+
+static inline address_t next_traced (const trace_filter_t *f, address_t pc)
+{
+    if (!f->ranges) {
+        return 0;
+    }
+    return pc < MEMSIZE ? f->next_pc[pc] : MEMSIZE;
+}
+
+/* Set up the tests for the instructions from count on, starting at pc */
+static void skip_arm (skip_t *s, const trace_filter_t *f, uint64_t count,
+        address_t pc)
+{
+    s->from = UINT64_MAX;
+    s->pc_stop = next_traced(f, pc);
+    s->reg = NOREG;
+    s->lo = s->hi = 0;
+    if (count >= f->to) {
+        return;                 // nothing left to trace
+    }
+    if (f->fired) {
+        s->from = f->from;
+    } else if (f->trigger == TRIGGER_REG) {
+        s->reg = f->reg;
+    } else {
+        s->lo = f->addr;
+        s->hi = f->addr + 8;
+    }
+}
+
+/*
+ * Ask the filter about the instruction at pc, the count'th one run (the
+ * state after it is in ex->cpu). If it is wanted, trace it after the ones
+ * left out before it; otherwise set the tests up again.
+ */
+static bool skip_check (y86_exec_t *ex, skip_t *s, address_t pc,
+        const y86_inst_t *inst, uint64_t count)
+{
+    if (trace_wanted(ex->filter, pc, count - 1, &ex->cpu, ex->memory)) {
+        trace_skip_n(ex->tracer, count - 1 - s->counted);
+        trace_step(ex->tracer, pc, inst, &ex->cpu);
+        s->counted = count;
+        return true;
+    }
+    skip_arm(s, ex->filter, count, ex->cpu.pc);
+    return false;
+}
+
+/*
+ * Returns true if it stopped (still AOK) after tracing an instruction the
+ * filter wanted, which only happens with EXEC_TRACE.
+ */
+static inline __attribute__((always_inline)) bool run_local (
+        y86_exec_t *ex, unsigned features)
+{
+    y86_t *cpu = &ex->cpu;
+    byte_t *memory = ex->memory;
+    uint64_t limit = ex->limit ? ex->limit : UINT64_MAX;
+    uint64_t deadline = ex->deadline;
+    uint32_t ticks = EXEC_TIME_CHECK;
+    uint64_t next = limit;
+    if (ex->snap != NULL && ex->snap_every < limit) {
+        next = ex->snap_every;
+    }
+
+    // every fetch sets the status, so starting from AOK changes nothing
+    cpu->stat = AOK;
+
+    // only the stages could change the flags, and they never do
+    unsigned taken = cond_mask(cpu);
+    address_t pc = cpu->pc;
+    uint64_t count = ex->count;
+    FOR_REGS(DECL_REG)                  // r4 is %rsp
+    address_t block = pc;               // EXEC_SAMPLE: current block
+    address_t block_end = 0;            // EXEC_COVER: as in run_loop()
+    if (features & EXEC_COVER) {
+        block_end = cover_enter(ex->cover, pc);
+    }
+
+    // EXEC_TRACE: instructions the filter might want; the tests below only
+    // flag writes and stores to what the trigger watches
+    skip_t skip = { .counted = count };
+    bool traced = false;
+    if (features & EXEC_TRACE) {
+        skip_arm(&skip, ex->filter, count, pc);
+    }
+#define WROTE(n)    (event |= (features & EXEC_TRACE) && (n) == skip.reg)
+#define STORED(a)   (event |= (features & EXEC_TRACE) && \
+                     (a) < skip.hi && (a) + 8 > skip.lo)
+
+    while (true) {
+        address_t at = pc;
+        y86_stat_t stat = ADR;
+        y86_inst_t inst;
+        y86_reg_t addr, val;
+        bool event = false;
+
+        if (pc <= MEMSIZE - Y86_MAXLEN) {
+            inst = decode(memory, pc, &stat);
+        }
+        if (stat != AOK) {
+            goto stages;
+        }
+        address_t target = inst.valP;
+
+        switch (inst.icode) {
+            case NOP:
+            case IOTRAP:
+                // the stages do no I/O, so a trap only moves on
+                break;
+            case CMOV:
+                if ((taken >> inst.ifun.b) & 1) {
+                    SET_REG(inst.rb, REG(inst.ra));
+                    WROTE(inst.rb);
+                }
+                break;
+            case IRMOVQ:
+                SET_REG(inst.rb, inst.valC.v);
+                WROTE(inst.rb);
+                break;
+            case RMMOVQ:
+                if (inst.rb == NOREG) {
+                    goto stages;
+                }
+                addr = REG(inst.rb) + inst.valC.d;
+                if (addr > MEMSIZE - 8) {
+                    goto stages;
+                }
+                val = REG(inst.ra);
+                memcpy(&memory[addr], &val, 8);
+                note_store(ex->dirty, addr);
+                STORED(addr);
+                break;
+            case MRMOVQ:
+                if (inst.rb == NOREG) {
+                    goto stages;
+                }
+                addr = REG(inst.rb) + inst.valC.d;
+                if (addr > MEMSIZE - 8) {
+                    goto stages;
+                }
+                SET_REG(inst.ra, read_quad(memory, addr));
+                WROTE(inst.ra);
+                break;
+            case OPQ:
+                val = REG(inst.rb);
+                switch (inst.ifun.op) {
+                    case ADD: val += REG(inst.ra); break;
+                    case SUB: val -= REG(inst.ra); break;
+                    case AND: val &= REG(inst.ra); break;
+                    case XOR: val ^= REG(inst.ra); break;
+                    default:  break;
+                }
+                SET_REG(inst.rb, val);
+                WROTE(inst.rb);
+                break;
+            case JUMP:
+                if ((taken >> inst.ifun.b) & 1) {
+                    if (features & EXEC_SAMPLE) {
+                        sample_leave(ex->sampler, &block, JUMP, inst.valP,
+                                     inst.valC.dest);
+                    }
+                    target = inst.valC.dest;
+                }
+                break;
+            case CALL:
+                addr = r4 - 8;
+                if (addr > MEMSIZE - 8) {
+                    goto stages;
+                }
+                memcpy(&memory[addr], &inst.valP, 8);
+                note_store(ex->dirty, addr);
+                r4 = addr;
+                STORED(addr);
+                WROTE(RSP);
+                if (features & EXEC_SAMPLE) {
+                    sample_leave(ex->sampler, &block, CALL, inst.valP,
+                                 inst.valC.dest);
+                }
+                target = inst.valC.dest;
+                break;
+            case RET:
+                if (r4 > MEMSIZE - 8) {
+                    goto stages;
+                }
+                val = read_quad(memory, r4);
+                r4 += 8;
+                WROTE(RSP);
+                if (features & EXEC_SAMPLE) {
+                    sample_leave(ex->sampler, &block, RET, inst.valP, val);
+                }
+                target = val;
+                break;
+            case PUSHQ:
+                addr = r4 - 8;
+                if (addr > MEMSIZE - 8) {
+                    goto stages;
+                }
+                val = REG(inst.ra);
+                memcpy(&memory[addr], &val, 8);
+                note_store(ex->dirty, addr);
+                r4 = addr;
+                STORED(addr);
+                WROTE(RSP);
+                break;
+            case POPQ:
+                if (r4 > MEMSIZE - 8) {
+                    goto stages;
+                }
+                val = read_quad(memory, r4);
+                r4 += 8;
+                SET_REG(inst.ra, val);
+                WROTE(RSP);
+                WROTE(inst.ra);
+                break;
+            default:
+                goto stages;
+        }
+        pc = target;
+        count++;
+
+        if ((features & EXEC_COVER) &&
+                (target != inst.valP || inst.valP == block_end)) {
+            if (inst.icode == JUMP && inst.ifun.jump != JMP) {
+                cover_branch(ex->cover, at, (taken >> inst.ifun.b) & 1);
+            }
+            block_end = cover_enter(ex->cover, pc);
+        }
+
+        // the instruction is tested against the block it was in, before
+        // a transfer moves the tests on to the next one
+        if (features & EXEC_TRACE) {
+            if (event || (count > skip.from && at >= skip.pc_stop)) {
+                cpu->pc = pc;
+                FOR_REGS(SAVE_REG)
+                if (skip_check(ex, &skip, at, &inst, count)) {
+                    traced = true;
+                    break;
+                }
+            } else if (target != inst.valP) {
+                skip.pc_stop = next_traced(ex->filter, pc);
+            }
+        }
+        goto check;
+
+    stages:
+        // write the state back and run one instruction as run_loop does
+        cpu->pc = pc;
+        FOR_REGS(SAVE_REG)
+        inst = fetch(cpu, memory);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            break;
+        }
+        count++;
+        bool cnd = false;
+        y86_reg_t valA = 0;
+        y86_reg_t valE = decode_execute(cpu, &inst, &cnd, &valA);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            skip.counted++;     // counted, but not run: run_loop() leaves it
+            break;              // out of the trace without a note
+        }
+        memory_wb_pc_dirty(cpu, &inst, memory, cnd, valA, valE, ex->dirty);
+        if (features & EXEC_TRACE) {
+            traced = skip_check(ex, &skip, at, &inst, count);
+        }
+        if (cpu->stat != AOK || traced) {
+            break;
+        }
+        if (features & EXEC_SAMPLE) {
+            sample_leave(ex->sampler, &block, inst.icode, inst.valP, cpu->pc);
+        }
+        if ((features & EXEC_COVER) &&
+                (cpu->pc != inst.valP || inst.valP == block_end)) {
+            if (inst.icode == JUMP && inst.ifun.jump != JMP) {
+                cover_branch(ex->cover, at, cnd);
+            }
+            block_end = cover_enter(ex->cover, cpu->pc);
+        }
+        pc = cpu->pc;
+        FOR_REGS(LOAD_REG)
+
+    check:
+        if (pc <= at) {
+            if (count >= next) {
+                cpu->pc = pc;
+                FOR_REGS(SAVE_REG)
+                if (count >= limit) {
+                    cpu->stat = TMO;
+                    break;
+                }
+                snap_publish(ex->snap, cpu, count, NULL);
+                next = limit - count > ex->snap_every ?
+                       count + ex->snap_every : limit;
+            }
+            if (deadline != 0 && --ticks == 0) {
+                ticks = EXEC_TIME_CHECK;
+                if (y86_clock_ns() >= deadline) {
+                    cpu->pc = pc;
+                    FOR_REGS(SAVE_REG)
+                    cpu->stat = TMO;
+                    break;
+                }
+            }
+        }
+    }
+#undef WROTE
+#undef STORED
+    ex->count = count;
+    if (features & EXEC_TRACE) {
+        trace_skip_n(ex->tracer, count - skip.counted);
+    }
+    return traced && cpu->stat == AOK;
+}
+
+#define RUN_LOCAL(name, f) \
+    static void name (y86_exec_t *ex) \
+    { \
+        if (ex->cpu.stat == AOK || ex->cpu.stat == HLT) { \
+            run_local(ex, f); \
+        } \
+        if (ex->snap != NULL) { \
+            snap_publish(ex->snap, &ex->cpu, ex->count, NULL); \
+        } \
+    }
+
+RUN_LOCAL(run_plain, 0)
+RUN_LOCAL(run_sample, EXEC_SAMPLE)
+RUN_LOCAL(run_cover, EXEC_COVER)
+RUN_LOCAL(run_cover_sample, EXEC_COVER | EXEC_SAMPLE)
+
+/*
+ * Trace mode. With a filter, run_local() runs what the filter leaves out and
+ * stops once it has traced an instruction; run_loop() goes on tracing until
+ * the filter leaves one out again.
+ */
+static void run_trace (y86_exec_t *ex)
+{
+    if (ex->filter == NULL) {
+        run_loop(ex, EXEC_TRACE);
+        return;
+    }
+    bool more = ex->cpu.stat == AOK || ex->cpu.stat == HLT;
+    while (more && run_local(ex, EXEC_TRACE)) {
+        run_loop(ex, EXEC_TRACE);
+        more = ex->cpu.stat == AOK;
+    }
+    if (ex->snap != NULL) {
+        snap_publish(ex->snap, &ex->cpu, ex->count, NULL);
+    }
+}
+
+#define RUN_LOOP(f) \
+    static void run_##f (y86_exec_t *ex) { run_loop(ex, f); }
+
+                          RUN_LOOP(2)  RUN_LOOP(3)
+RUN_LOOP(4)  RUN_LOOP(5)  RUN_LOOP(6)  RUN_LOOP(7)
+RUN_LOOP(8)  RUN_LOOP(9)  RUN_LOOP(10) RUN_LOOP(11)
+RUN_LOOP(12) RUN_LOOP(13) RUN_LOOP(14) RUN_LOOP(15)
+             RUN_LOOP(17) RUN_LOOP(18) RUN_LOOP(19)
+RUN_LOOP(20) RUN_LOOP(21) RUN_LOOP(22) RUN_LOOP(23)
+RUN_LOOP(24) RUN_LOOP(25) RUN_LOOP(26) RUN_LOOP(27)
+RUN_LOOP(28) RUN_LOOP(29) RUN_LOOP(30) RUN_LOOP(31)
+             RUN_LOOP(33) RUN_LOOP(34) RUN_LOOP(35)
+RUN_LOOP(36) RUN_LOOP(37) RUN_LOOP(38) RUN_LOOP(39)
+RUN_LOOP(40) RUN_LOOP(41) RUN_LOOP(42) RUN_LOOP(43)
+RUN_LOOP(44) RUN_LOOP(45) RUN_LOOP(46) RUN_LOOP(47)
+             RUN_LOOP(49) RUN_LOOP(50) RUN_LOOP(51)
+RUN_LOOP(52) RUN_LOOP(53) RUN_LOOP(54) RUN_LOOP(55)
+RUN_LOOP(56) RUN_LOOP(57) RUN_LOOP(58) RUN_LOOP(59)
+RUN_LOOP(60) RUN_LOOP(61) RUN_LOOP(62) RUN_LOOP(63)
+
+// no features, or only sampling and coverage: the loop with the state in
+// locals; a filtered trace also runs what it leaves out there
+static const exec_fn_t run_loops[EXEC_VARIANTS] = {
+    run_plain, run_trace,  run_2,  run_3,  run_4,  run_5,  run_6,  run_7,
+    run_8,  run_9,  run_10, run_11, run_12, run_13, run_14, run_15,
+    run_sample, run_17, run_18, run_19, run_20, run_21, run_22, run_23,
+    run_24, run_25, run_26, run_27, run_28, run_29, run_30, run_31,
+    run_cover, run_33, run_34, run_35, run_36, run_37, run_38, run_39,
+    run_40, run_41, run_42, run_43, run_44, run_45, run_46, run_47,
+    run_cover_sample, run_49, run_50, run_51, run_52, run_53, run_54, run_55,
+    run_56, run_57, run_58, run_59, run_60, run_61, run_62, run_63
+};
+
+exec_fn_t exec_select (unsigned features)
+{
+    return run_loops[features % EXEC_VARIANTS];
+}
+
+/**********************************************************************
+ *                              REPORTS
+ *********************************************************************/
+
+static const char *const icode_names[] = {
+    "halt", "nop", "cmovXX", "irmovq", "rmmovq", "mrmovq", "OPq", "jXX",
+    "call", "ret", "pushq", "popq", "iotrap"
+};
+
+void exec_print_stats (y86_exec_t *ex)
+{
+    printf("Instruction mix:\n");
+    for (int i = 0; i < (int)(sizeof(icode_names) / sizeof(icode_names[0])); i++) {
+        if (ex->stats.icodes[i] == 0) {
+            continue;
+        }
+        printf("  %-8s %12" PRIu64 "  %5.1f%%\n", icode_names[i],
+               ex->stats.icodes[i], 100.0 * ex->stats.icodes[i] / ex->count);
+    }
+    printf("Conditional jumps: %" PRIu64 " taken, %" PRIu64 " not taken\n",
+           ex->stats.taken, ex->stats.not_taken);
+    printf("Conditional moves: %" PRIu64 " moved\n", ex->stats.cmovs);
+}
+
+void exec_print_hot (const uint64_t *counts, uint64_t total, int top,
+        const char *title, const byte_t *memory)
+{
+    static address_t order[MEMSIZE];
+    int n = 0;
+
+    for (address_t addr = 0; addr < MEMSIZE; addr++) {
+        if (counts[addr] != 0) {
+            order[n++] = addr;
+        }
+    }
+
+    // partial selection sort: only the first top entries are needed
+    if (top > n) {
+        top = n;
+    }
+    for (int i = 0; i < top; i++) {
+        int best = i;
+        for (int j = i + 1; j < n; j++) {
+            if (counts[order[j]] > counts[order[best]]) {
+                best = j;
+            }
+        }
+        address_t tmp = order[i];
+        order[i] = order[best];
+        order[best] = tmp;
+    }
+
+    printf("%s\n", title);
+    for (int i = 0; i < top; i++) {
+        printf("  0x%03" PRIx64 ": %12" PRIu64 "  %5.1f%%", order[i],
+               counts[order[i]], 100.0 * counts[order[i]] / total);
+        if (memory != NULL) {
+            y86_stat_t stat;
+            y86_inst_t inst = decode(memory, order[i], &stat);
+            char text[Y86_TEXTLEN];
+            format_inst(text, &inst);
+            printf("  %s", text);
+        }
+        printf("\n");
+    }
+}
+
+void exec_print_profile (y86_exec_t *ex, int top)
+{
+    exec_print_hot(ex->profile, ex->count, top, "Hottest addresses:",
+                   ex->memory);
+}
@@ -0,0 +1,99 @@
+#ifndef __CS261_EXEC__
+#define __CS261_EXEC__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cover.h"
+#include "sample.h"
+#include "snap.h"
+#include "trace.h"
+#include "y86.h"
+
+/* Optional features of the run loop; each combination is compiled into its
+   own copy of the loop, so features that are off cost nothing */
+#define EXEC_TRACE      0x1     // trace each instruction and the CPU state
+#define EXEC_PROFILE    0x2     // count executions of each address
+#define EXEC_STATS      0x4     // count instructions by kind and branches
+#define EXEC_WATCH      0x8     // report stores that change a memory range
+#define EXEC_SAMPLE     0x10    // take timer samples at block ends
+#define EXEC_COVER      0x20    // record blocks entered and branch directions
+#define EXEC_VARIANTS   64      // number of feature combinations
+
+/* Backward jumps taken between reads of the clock when a deadline is set */
+#define EXEC_TIME_CHECK 4096
+
+/* Instruction mix collected with EXEC_STATS */
+typedef struct y86_exec_stats {
+    uint64_t icodes[16];        // instructions executed, by icode
+    uint64_t taken;             // conditional jumps taken
+    uint64_t not_taken;         // conditional jumps not taken
+    uint64_t cmovs;             // conditional moves that moved
+} y86_exec_stats_t;
+
+/*
+ * One run of a loaded program through the fetch, decode_execute and
+ * memory_wb_pc stages.
+ */
+typedef struct y86_exec {
+    y86_t cpu;
+    byte_t *memory;
+    uint64_t dirty[PAGEWORDS];          // pages of memory stored to
+    uint64_t count;                     // instructions executed
+    uint64_t profile[MEMSIZE];          // EXEC_PROFILE: executions per address
+    y86_exec_stats_t stats;             // EXEC_STATS
+    address_t watch_lo, watch_hi;       // EXEC_WATCH: range [lo, hi)
+    uint64_t limit;                     // instruction budget (0: none)
+    uint64_t deadline;                  // y86_clock_ns() time (0: none)
+    y86_snap_t *snap;                   // live snapshots (NULL: none)
+    uint64_t snap_every;                // instructions between snapshots
+    y86_sampler_t *sampler;             // EXEC_SAMPLE
+    y86_tracer_t *tracer;               // EXEC_TRACE
+    trace_filter_t *filter;             // EXEC_TRACE: what to trace (NULL: all)
+    y86_cover_t *cover;                 // EXEC_COVER
+} y86_exec_t;
+
+/* Run loop specialized for one set of features */
+typedef void (*exec_fn_t) (y86_exec_t *ex);
+
+/**
+ * @brief Select the run loop compiled for a set of features; done once,
+ * before the run, so the loop itself never tests which features are on
+ *
+ * @param features Bitwise OR of EXEC_* flags
+ * @returns Run loop that executes until the CPU halts or faults, or stops
+ * it with TMO once it has used up ex->limit or passed ex->deadline; with
+ * ex->snap set it publishes the state about every ex->snap_every
+ * instructions and once more at the end
+ */
+exec_fn_t exec_select (unsigned features);
+
+/**
+ * @brief Print the instruction mix collected with EXEC_STATS
+ *
+ * @param ex Finished run
+ */
+void exec_print_stats (y86_exec_t *ex);
+
+/**
+ * @brief Print the addresses with the highest counts, most first
+ *
+ * @param counts Count for each address (MEMSIZE entries)
+ * @param total Count the percentages are of
+ * @param top Number of addresses to show
+ * @param title Heading line
+ * @param memory Address space to disassemble each address from, or NULL to
+ * show just the counts
+ */
+void exec_print_hot (const uint64_t *counts, uint64_t total, int top,
+        const char *title, const byte_t *memory);
+
+/**
+ * @brief Print the most executed addresses collected with EXEC_PROFILE
+ *
+ * @param ex Finished run
+ * @param top Number of addresses to show
+ */
+void exec_print_profile (y86_exec_t *ex, int top);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * CS 261: Guest I/O traps
+ *
+ * Name: Aiden Smith
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+
+void io_init (y86_io_t *io, void (*flush) (void *, const char *, size_t),
+        void *ctx)
+{
+    memset(io, 0, sizeof(*io));
+    io->flush = flush;
+    io->ctx = ctx;
+}
+
+void io_free (y86_io_t *io)
+{
+    free(io->in);
+    free(io->out);
+    io->in = NULL;
+    io->out = NULL;
+}
+
+void io_reset (y86_io_t *io)
+{
+    io->in_pos = 0;
+    io->in_len = 0;
+    io->in_eof = false;
+    io->out_len = 0;
+}
+
+/* Make room for n more bytes in a growing buffer */
+static bool grow (void **buf, size_t *cap, size_t len, size_t n)
+{
+    if (len + n <= *cap) {
+        return true;
+    }
+    size_t size = *cap ? *cap : 256;
+    while (size < len + n) {
+        size *= 2;
+    }
+    void *p = realloc(*buf, size);
+    if (p == NULL) {
+        return false;
+    }
+    *buf = p;
+    *cap = size;
+    return true;
+}
+
+bool io_input (y86_io_t *io, const void *data, size_t len, bool eof)
+{
+    // drop what has been consumed before growing
+    if (io->in_pos > 0) {
+        memmove(io->in, io->in + io->in_pos, io->in_len - io->in_pos);
+        io->in_len -= io->in_pos;
+        io->in_pos = 0;
+    }
+    if (!grow((void **)&io->in, &io->in_cap, io->in_len, len)) {
+        return false;
+    }
+    if (len > 0) {
+        memcpy(io->in + io->in_len, data, len);
+    }
+    io->in_len += len;
+    io->in_eof = io->in_eof || eof;
+    return true;
+}
+
+void io_flush (y86_io_t *io)
+{
+    if (io->flush != NULL && io->out_len > 0) {
+        io->flush(io->ctx, io->out, io->out_len);
+        io->out_len = 0;
+    }
+}
+
+static void put (y86_io_t *io, const char *data, size_t len)
+{
+    if (grow((void **)&io->out, &io->out_cap, io->out_len, len)) {
+        memcpy(io->out + io->out_len, data, len);
+        io->out_len += len;
+    }
+}
+
+/*
+ * Parse a decimal number at the start of the unread input. Returns 1 if one
+ * was read, 0 if the input cannot give one, or -1 if it may still (the
+ * input so far is all white space, sign and digits, and more may come).
+ */
+static int read_decimal (y86_io_t *io, int64_t *value)
+{
+    size_t i = io->in_pos;
+    while (i < io->in_len && strchr(" \t\r\n\v\f", io->in[i]) != NULL) {
+        i++;
+    }
+    bool neg = false;
+    if (i < io->in_len && (io->in[i] == '-' || io->in[i] == '+')) {
+        neg = io->in[i] == '-';
+        i++;
+    }
+    size_t digits = i;
+    uint64_t v = 0;
+    while (i < io->in_len && io->in[i] >= '0' && io->in[i] <= '9') {
+        v = v * 10 + (io->in[i] - '0');
+        i++;
+    }
+
+    if (i == io->in_len && !io->in_eof) {
+        return -1;
+    }
+    if (i == digits) {
+        return 0;
+    }
+    io->in_pos = i;
+    *value = (int64_t)(neg ? 0 - v : v);
+    return 1;
+}
+
+y86_io_status_t io_trap (y86_io_t *io, y86_t *cpu, byte_t *memory, int trap)
+{
+    y86_reg_t src = cpu->reg[RSI];
+    y86_reg_t dst = cpu->reg[RDI];
+    char text[24];
+    int64_t value;
+
+    switch (trap) {
+        case CHAROUT:
+            if (src >= MEMSIZE) {
+                cpu->stat = ADR;
+                break;
+            }
+            put(io, (const char *)&memory[src], 1);
+            break;
+
+        case CHARIN:
+            if (dst >= MEMSIZE) {
+                cpu->stat = ADR;
+                break;
+            }
+            if (io->in_pos == io->in_len) {
+                if (!io->in_eof) {
+                    return IO_BLOCKED;
+                }
+                cpu->stat = HLT;
+                break;
+            }
+            memory[dst] = io->in[io->in_pos++];
+            break;
+
+        case DECOUT:
+            if (src > MEMSIZE - 8) {
+                cpu->stat = ADR;
+                break;
+            }
+            memcpy(&value, &memory[src], 8);
+            put(io, text, snprintf(text, sizeof(text), "%" PRId64, value));
+            break;
+
+        case DECIN:
+            if (dst > MEMSIZE - 8) {
+                cpu->stat = ADR;
+                break;
+            }
+            switch (read_decimal(io, &value)) {
+                case -1:
+                    return IO_BLOCKED;
+                case 0:
+                    cpu->stat = HLT;
+                    break;
+                default:
+                    memcpy(&memory[dst], &value, 8);
+                    break;
+            }
+            break;
+
+        case STROUT:
+            if (src >= MEMSIZE) {
+                cpu->stat = ADR;
+                break;
+            }
+            put(io, (const char *)&memory[src], strnlen((const char *)&memory[src],
+                    MEMSIZE - src));
+            break;
+
+        case FLUSH:
+            io_flush(io);
+            break;
+
+        default:
+            cpu->stat = INS;
+            break;
+    }
+    return IO_DONE;
+}
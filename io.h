@@ -0,0 +1,98 @@
+#ifndef __CS261_IO__
+#define __CS261_IO__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "y86.h"
+
+/*
+ * Guest I/O through IOTRAP, on memory buffers:
+ *
+ *   CHAROUT  write the byte at M[%rsi]
+ *   CHARIN   read one byte into M[%rdi]
+ *   DECOUT   write the quad at M[%rsi] in decimal
+ *   DECIN    read a decimal number (after any white space) into M[%rdi]
+ *   STROUT   write the NUL-terminated string at M[%rsi]
+ *   FLUSH    hand the buffered output to the output callback
+ *
+ * An address outside memory gives ADR. An input trap that cannot read a
+ * value because the input has ended (or, for DECIN, does not continue with
+ * a number) halts the guest with HLT. When more input may still arrive,
+ * the trap blocks instead: it is not executed, and the guest can be
+ * resumed once io_input() has added the missing bytes.
+ */
+typedef struct y86_io {
+    byte_t *in;                 // input not consumed yet starts at in_pos
+    size_t in_pos, in_len, in_cap;
+    bool in_eof;                // no more input will be added
+    char *out;                  // output not flushed yet
+    size_t out_len, out_cap;
+
+    /* Called on FLUSH (and by io_flush()) with the buffered output; NULL
+       keeps everything in out */
+    void (*flush) (void *ctx, const char *data, size_t len);
+    void *ctx;
+} y86_io_t;
+
+/* Outcome of an I/O trap */
+typedef enum {
+    IO_DONE,                    // executed (cpu->stat tells if it faulted)
+    IO_BLOCKED                  // needs input that has not arrived yet
+} y86_io_status_t;
+
+/**
+ * @brief Initialize empty I/O buffers
+ *
+ * @param io Buffers to initialize
+ * @param flush Output callback (may be NULL)
+ * @param ctx Argument for the callback
+ */
+void io_init (y86_io_t *io, void (*flush) (void *, const char *, size_t),
+        void *ctx);
+
+/**
+ * @brief Release the buffers
+ *
+ * @param io Buffers to free
+ */
+void io_free (y86_io_t *io);
+
+/**
+ * @brief Discard all input and output, keeping the buffers for reuse
+ *
+ * @param io Buffers to reset
+ */
+void io_reset (y86_io_t *io);
+
+/**
+ * @brief Append guest input
+ *
+ * @param io Buffers
+ * @param data Bytes to append
+ * @param len Number of bytes
+ * @param eof True if this is the end of the input
+ * @returns False if the buffer could not grow
+ */
+bool io_input (y86_io_t *io, const void *data, size_t len, bool eof);
+
+/**
+ * @brief Hand any buffered output to the callback
+ *
+ * @param io Buffers
+ */
+void io_flush (y86_io_t *io);
+
+/**
+ * @brief Execute an I/O trap
+ *
+ * @param io Buffers
+ * @param cpu Y86 CPU structure (registers; stat is set on a fault)
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param trap Trap number (the instruction's ifun)
+ * @returns IO_DONE, or IO_BLOCKED if the trap must be retried later
+ */
+y86_io_status_t io_trap (y86_io_t *io, y86_t *cpu, byte_t *memory, int trap);
+
+#endif
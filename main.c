@@ -15,13 +15,55 @@
 #include "p2-load.h"
 #include "p3-disas.h"
 #include "p4-interp.h"
+#include "cfg.h"
+#include "batch.h"
+#include "exec.h"
+#include "report.h"
+
+/* Most symbols used as control-flow roots */
+#define MAXSYMS 1024
+
+/* Addresses listed by -P */
+#define PROFILE_TOP 10
+
+/* What to show for each input file */
+typedef struct options {
+    int show_header;
+    int show_phdrs;
+    int disas_code;
+    int disas_data;
+    int show_mem;
+    int exec_mode;  // 0: no execution, 1: execute, 2: trace mode
+    int full_mem;
+    int cfg_mode;   // 0: none, 1: listing, 2: DOT
+    unsigned features;              // EXEC_* run loop features
+    address_t watch_lo, watch_hi;   // -W range
+    uint64_t limit;                 // -l instruction budget (0: none)
+    double timeout;                 // -t seconds per run (0: none)
+    report_fmt_t report;            // -o result format
+    bool digest;                    // -x final memory digest in results
+    y86_snap_t *snap;               // -v live snapshots
+    uint64_t snap_every;            // -v instructions between snapshots
+    bool sample_hot;                // -p print sampled blocks
+    const char *folded;             // -F folded stacks file
+    trace_policy_t trace_policy;    // -b when the trace writer falls behind
+    bool filtered;                  // -R, -I or -T given
+    trace_filter_t filter;          // -I window and -T trigger
+    const char *ranges[TRACE_MAXRANGES];    // -R ranges and symbols
+    int nranges;
+    bool dirty_dump;                // -u trace dump shows written pages only
+    const char *coverage;           // -C lcov tracefile to merge into
+} options_t;
+
+/* Writer for structured results (-o) */
+static outbuf_t results;
 
 /*
  * helper function for printing help text
  */
 void usage (char **argv)
 {
-    printf("Usage: %s <option(s)> mini-elf-file\n", argv[0]);
+    printf("Usage: %s <option(s)> mini-elf-file(s)\n", argv[0]);
     printf(" Options are:\n");
     printf("  -h      Display usage\n");
     printf("  -H      Show the Mini-ELF header\n");
@@ -32,106 +74,170 @@ void usage (char **argv)
     printf("  -M      Show the memory contents (full)\n");
     printf("  -d      Disassemble code contents\n");
     printf("  -D      Disassemble data contents\n");
+    printf("  -c      Disassemble code by following control flow\n");
+    printf("  -g      Print the control-flow graph (Graphviz DOT)\n");
     printf("  -e      Execute program\n");
     printf("  -E      Execute program (trace mode)\n");
+    printf("  -b pol  Trace writer behind: block (default) or drop records\n");
+    printf("  -R a:b  Trace only addresses [a, b) or a symbol (repeatable)\n");
+    printf("  -I a:b  Trace only instructions a (from 0) up to b\n");
+    printf("  -T t    Trace from when %%reg or addr changes (or equals =v)\n");
+    printf("  -u      Trace mode: dump only the memory pages written\n");
+    printf("  -C file Merge block and branch coverage into an lcov file\n");
+    printf("  -P      Profile execution (hottest addresses)\n");
+    printf("  -p      Sample execution with a timer (hottest blocks)\n");
+    printf("  -F file Append sampled call stacks to file (folded format)\n");
+    printf("  -S      Show execution statistics (instruction mix)\n");
+    printf("  -W a[:n] Report stores that change n bytes at a (default 8)\n");
+    printf("  -l insts Stop with TMO after about this many instructions\n");
+    printf("  -t secs Stop with TMO after this much time\n");
+    printf("  -j jobs Worker processes for multiple files (default: one per CPU)\n");
+    printf("  -o fmt  Print run results as json (JSON Lines) or csv\n");
+    printf("  -x      Add a digest of the final memory to -o results\n");
+    printf("  -v name[:n] Publish the state for y86-top every n instructions"
+           " (default %d)\n", SNAP_INTERVAL);
 }
 
-int main (int argc, char **argv)
+/*
+ * Report a file that failed to load: as text, or as an ERR result with -o.
+ */
+static int load_failed (const options_t *opts, const char *filename,
+        bool say)
 {
-    int opt;
-    int show_header = 0;
-    int show_phdrs = 0;
-    int disas_code = 0;
-    int disas_data = 0;
-    int show_mem = 0;
-    int exec_mode = 0; // 0: no execution, 1: execute, 2: trace mode
-    int full_mem = 0;
+    if (opts->report != REPORT_TEXT) {
+        run_report_t rep = { .file = filename, .has_digest = opts->digest };
+        report_write(&results, opts->report, &rep);
+        ob_flush(&results);
+    } else if (say) {
+        printf("Failed to read file\n");
+    }
+    return EXIT_FAILURE;
+}
 
-    /* Parse command-line arguments */
-    while ((opt = getopt(argc, argv, "hHsmdDMafeE")) != -1) {
-        switch (opt) {
-            case 'h':
-                usage(argv);
-                return EXIT_SUCCESS;
-            case 'H':
-                show_header = 1;
-                break;
-            case 's':
-                show_phdrs = 1;
-                break;
-            case 'd':
-                disas_code = 1;
-                break;
-            case 'D':
-                disas_data = 1;
-                break;
-            case 'm':
-                show_mem = 1;
-                break;
-            case 'M':
-                show_mem = 1;
-                full_mem = 1;
-                break;
-            case 'a':
-                show_header = 1;
-                show_phdrs = 1;
-                show_mem = 1;
-                disas_code = 1;
-                disas_data = 1;
-                break;
-            case 'f':
-                show_header = 1;
-                show_phdrs = 1;
-                show_mem = 1;
-                full_mem = 1;
-                disas_code = 1;
-                disas_data = 1;
-                break;
-            case 'e':
-                if (exec_mode == 2) {
-                    usage(argv);
-                    return EXIT_FAILURE;
-                }
-                exec_mode = 1;
-                break;
-            case 'E':
-                if (exec_mode == 1) {
-                    usage(argv);
-                    return EXIT_FAILURE;
-                }
-                exec_mode = 2;
+/*
+ * Stop sampling a run and append its folded stacks to the -F file, with
+ * calls named after the program's symbols.
+ */
+static void sample_end (const options_t *opts, const char *filename,
+        FILE *file, elf_hdr_t *hdr, y86_sampler_t *sampler)
+{
+    static elf_sym_t syms[MAXSYMS];
+    static char names[MAXSYMS][32];
+    static const char *by_addr[MEMSIZE];
+
+    sample_stop();
+    sample_flush(sampler);
+    if (opts->folded == NULL) {
+        return;
+    }
+
+    memset(by_addr, 0, sizeof(by_addr));
+    int nsyms = read_symbols(file, hdr, syms, MAXSYMS);
+    for (int i = 0; i < nsyms; i++) {
+        if (syms[i].st_value < MEMSIZE &&
+                read_symbol_name(file, hdr, &syms[i], names[i], 32)) {
+            by_addr[syms[i].st_value] = names[i];
+        }
+    }
+
+    // unbuffered, so that each whole-line chunk from the output buffer is
+    // one append and parallel workers never split each other's lines
+    FILE *out = fopen(opts->folded, "a");
+    if (out == NULL) {
+        perror(opts->folded);
+        return;
+    }
+    setvbuf(out, NULL, _IONBF, 0);
+    static outbuf_t ob;
+    ob_init(&ob, out);
+    sample_write_folded(sampler, &ob, filename, by_addr);
+    ob_flush(&ob);
+    fclose(out);
+}
+
+/*
+ * Collect the entry point and the symbols that name code, where control
+ * flow recovery starts. Returns the number of roots.
+ */
+static int find_roots (FILE *file, elf_hdr_t *hdr, elf_phdr_t *phdrs,
+        address_t *roots)
+{
+    static elf_sym_t syms[MAXSYMS];
+    int nroots = 0;
+
+    roots[nroots++] = hdr->e_entry;
+    int nsyms = read_symbols(file, hdr, syms, MAXSYMS);
+    for (int i = 0; i < nsyms; i++) {
+        // only symbols that name code are roots
+        for (int j = 0; j < hdr->e_num_phdr; j++) {
+            elf_phdr_t *phdr = &phdrs[j];
+            if (phdr->p_type == CODE && syms[i].st_value >= phdr->p_vaddr &&
+                    syms[i].st_value < phdr->p_vaddr + phdr->p_size) {
+                roots[nroots++] = syms[i].st_value;
                 break;
-            case '?':
-                usage(argv);
-                return EXIT_FAILURE;
-            default:
-                usage(argv);
-                return EXIT_FAILURE;
+            }
         }
     }
+    return nroots;
+}
 
-    if (optind >= argc) {
-        usage(argv);
-        return EXIT_FAILURE;
+/*
+ * Merge a run's coverage into the -C tracefile and print the totals.
+ */
+static void cover_end (const options_t *opts, const char *filename,
+        FILE *file, elf_hdr_t *hdr, y86_cover_t *cover)
+{
+    if (!cover_merge(cover, opts->coverage, filename, file, hdr)) {
+        perror(opts->coverage);
     }
+    if (opts->report == REPORT_TEXT) {
+        cover_print(cover);
+    }
+}
+
+/*
+ * Run a loaded program and write its structured result (-o).
+ */
+static void report_run (const options_t *opts, const char *filename,
+        y86_exec_t *ex)
+{
+    run_report_t rep = { .file = filename, .loaded = true,
+                         .has_digest = opts->digest };
+
+    uint64_t start = y86_clock_ns();
+    exec_select(opts->features)(ex);
+    rep.wall_ns = y86_clock_ns() - start;
+
+    rep.cpu = ex->cpu;
+    rep.count = ex->count;
+    if (opts->digest) {
+        rep.digest = report_digest(ex->memory);
+    }
+    report_write(&results, opts->report, &rep);
+    ob_flush(&results);
+}
+
+/*
+ * Load one Mini-ELF file and show, disassemble or run it as requested.
+ */
+static int run_file (const char *filename, const void *arg)
+{
+    const options_t *opts = arg;
 
     /* Open the file */
-    const char *filename = argv[optind];
     FILE *file = fopen(filename, "rb");
     if (!file) {
-        printf("Failed to read file\n");
-        return EXIT_FAILURE;
+        return load_failed(opts, filename, true);
     }
 
     elf_hdr_t hdr;
     if (!read_header(file, &hdr)) {
-        printf("Failed to read file\n");
         fclose(file);
-        return EXIT_FAILURE;
+        return load_failed(opts, filename, true);
     }
 
     /* Show the header */
-    if (show_header) {
+    if (opts->show_header) {
         dump_header(&hdr);
     }
 
@@ -146,15 +252,14 @@ int main (int argc, char **argv)
     for (int i = 0; i < hdr.e_num_phdr; i++) {
         uint16_t offset = hdr.e_phdr_start + i * sizeof(elf_phdr_t);
         if (!read_phdr(file, offset, &phdrs[i])) {
-            printf("Failed to read file\n"); // Bad header
             free(phdrs);
             fclose(file);
-            return EXIT_FAILURE;
+            return load_failed(opts, filename, true); // Bad header
         }
     }
 
     /* Show program headers */
-    if (show_phdrs) {
+    if (opts->show_phdrs) {
         dump_phdrs(hdr.e_num_phdr, phdrs);
     }
 
@@ -166,15 +271,15 @@ int main (int argc, char **argv)
         if (!load_segment(file, memory, &phdrs[i])) {
             free(phdrs);
             fclose(file);
-            return EXIT_FAILURE;
+            return load_failed(opts, filename, false);
         }
     }
 
     /* Display memory contents */
-    if (show_mem && exec_mode != 2) { // Do not dump memory here if in trace mode
+    if (opts->show_mem && opts->exec_mode != 2) { // Do not dump memory here if in trace mode
         uint16_t start = 0;
         uint16_t end = MEMSIZE - 1;
-        if (!full_mem) {
+        if (!opts->full_mem) {
             // Find the range of used memory
             start = MEMSIZE - 1;
             end = 0;
@@ -191,7 +296,7 @@ int main (int argc, char **argv)
     }
 
     /* Disassemble code segments */
-    if (disas_code) {
+    if (opts->disas_code) {
         int print_flag = 0;
         for (int i = 0; i < hdr.e_num_phdr; i++) {
             elf_phdr_t *phdr = &phdrs[i];
@@ -207,7 +312,7 @@ int main (int argc, char **argv)
     }
 
     /* Disassemble data segments */
-    if (disas_data) {
+    if (opts->disas_data) {
         int print_flag = 0;
         for (int i = 0; i < hdr.e_num_phdr; i++) {
             elf_phdr_t *phdr = &phdrs[i];
@@ -227,78 +332,148 @@ int main (int argc, char **argv)
         }
     }
 
+    /* Recursive-descent disassembly from the entry point and symbols */
+    if (opts->cfg_mode) {
+        static address_t roots[MAXSYMS + 1];
+        static y86_cfg_t cfg;
+        int nroots = find_roots(file, &hdr, phdrs, roots);
+
+        cfg_build(&cfg, memory, roots, nroots);
+        if (opts->cfg_mode == 1) {
+            cfg_print(&cfg, memory, &hdr);
+            printf("\n");
+        } else {
+            cfg_print_dot(&cfg, memory, &hdr);
+        }
+    }
 
     // p4444
     bool first = true;
-    if (exec_mode > 0) {
+    if (opts->exec_mode > 0) {
         /* Initialize CPU */
-        y86_t cpu = {0};
-        cpu.pc = hdr.e_entry;
-        cpu.stat = AOK;
+        static y86_exec_t ex;
+        memset(&ex, 0, sizeof(ex));
+        ex.memory = memory;
+        ex.cpu.pc = hdr.e_entry;
+        ex.cpu.stat = AOK;
+        ex.watch_lo = opts->watch_lo;
+        ex.watch_hi = opts->watch_hi;
+        ex.limit = opts->limit;
+        if (opts->timeout > 0) {
+            ex.deadline = y86_clock_ns() + (uint64_t)(opts->timeout * 1e9);
+        }
+        if (opts->snap != NULL) {
+            ex.snap = opts->snap;
+            ex.snap_every = opts->snap_every;
+            snap_begin(opts->snap, filename, &ex.cpu);
+        }
+        static y86_sampler_t sampler;
+        if (opts->features & EXEC_SAMPLE) {
+            sample_init(&sampler, hdr.e_entry);
+            ex.sampler = &sampler;
+            sample_start(SAMPLE_HZ);
+        }
+        static y86_cover_t cover;
+        if (opts->features & EXEC_COVER) {
+            static address_t roots[MAXSYMS + 1];
+            cover_init(&cover, memory, roots,
+                       find_roots(file, &hdr, phdrs, roots));
+            ex.cover = &cover;
+        }
+        if (opts->report != REPORT_TEXT) {
+            // structured results replace all of the text output below
+            report_run(opts, filename, &ex);
+            if (opts->features & EXEC_SAMPLE) {
+                sample_end(opts, filename, file, &hdr, &sampler);
+            }
+            if (opts->features & EXEC_COVER) {
+                cover_end(opts, filename, file, &hdr, &cover);
+            }
+            free(phdrs);
+            fclose(file);
+            return EXIT_SUCCESS;
+        }
         if (first) {
             printf("Beginning execution at 0x%04x\n", hdr.e_entry);
 
-            if (exec_mode == 2) {
+            if (opts->exec_mode == 2) {
                 printf("Y86 CPU state:\n");
-                dump_cpu_state(&cpu);
+                dump_cpu_state(&ex.cpu);
                 first = false;
             }
         }
-        int instruction_count = 0;
-
-        while (cpu.stat == AOK || cpu.stat == HLT) {
-            /* Fetch instruction */
-            y86_inst_t inst = fetch(&cpu, memory);
 
-            if (cpu.stat == ADR || cpu.stat == INS) {
-                break;
-            }
-
-            instruction_count++;
-
-            /* Decode and execute */
-            bool cnd = false;
-            y86_reg_t valA = 0;
-            y86_reg_t valE = decode_execute(&cpu, &inst, &cnd, &valA);
-
-            if (cpu.stat == ADR || cpu.stat == INS) {
-                break;
-            }
-
-            if (first == false) {
-                printf("\n");
-            }
-            /* Memory access, write-back, and PC update */
-            memory_wb_pc(&cpu, &inst, memory, cnd, valA, valE);
-
-            if (exec_mode == 2) {
-                printf("Executing: ");
-                disassemble(&inst);
-                printf("\n");
-                printf("Y86 CPU state:\n");
-                dump_cpu_state(&cpu);                
+        unsigned features = opts->features;
+        if (opts->exec_mode == 2) {
+            features |= EXEC_TRACE;
+            if (opts->filtered) {
+                static trace_filter_t filter;
+                filter = opts->filter;
+                for (int i = 0; i < opts->nranges; i++) {
+                    if (!trace_add_range(&filter, opts->ranges[i], file,
+                                         &hdr)) {
+                        printf("Unknown trace range %s\n", opts->ranges[i]);
+                        free(phdrs);
+                        fclose(file);
+                        return EXIT_FAILURE;
+                    }
+                }
+                trace_filter_start(&filter, &ex.cpu, memory);
+                ex.filter = &filter;
             }
-
-            if (cpu.stat == HLT || cpu.stat != AOK) {
-                break; // Exit loop when halt is encountered
+            fflush(stdout);     // the writer thread continues the output
+            ex.tracer = trace_start(stdout, &ex.cpu, opts->trace_policy);
+            if (ex.tracer == NULL) {
+                printf("Failed to start the trace writer\n");
+                free(phdrs);
+                fclose(file);
+                return EXIT_FAILURE;
             }
         }
+        exec_select(features)(&ex);
+        if (ex.tracer != NULL) {
+            trace_finish(ex.tracer, &ex.cpu);
+        }
+        if (opts->features & EXEC_SAMPLE) {
+            sample_end(opts, filename, file, &hdr, &sampler);
+        }
 
-        if (exec_mode != 2) {
+        if (opts->exec_mode != 2) {
             /* Print final CPU state */
             printf("Y86 CPU state:\n");
-            dump_cpu_state(&cpu);
+            dump_cpu_state(&ex.cpu);
         }
 
-        printf("Total execution count: %d\n", instruction_count);
+        printf("Total execution count: %" PRIu64 "\n", ex.count);
 
         if (first == false) {
                 printf("\n");
         }
 
-        if (exec_mode == 2) {
+        if (opts->exec_mode == 2) {
             /* Trace mode: dump memory contents */
-            dump_memory(memory, 0, MEMSIZE);
+            if (opts->dirty_dump) {
+                dump_dirty_memory(memory, ex.dirty);
+            } else {
+                dump_memory(memory, 0, MEMSIZE);
+            }
+        }
+
+        if (opts->features & EXEC_STATS) {
+            exec_print_stats(&ex);
+        }
+        if (opts->features & EXEC_PROFILE) {
+            exec_print_profile(&ex, PROFILE_TOP);
+        }
+        if (opts->sample_hot) {
+            char title[64];
+            snprintf(title, sizeof(title), "Sampled blocks (%" PRIu64
+                     " samples):", sampler.total);
+            exec_print_hot(sampler.blocks, sampler.total, PROFILE_TOP, title,
+                           NULL);
+        }
+        if (opts->features & EXEC_COVER) {
+            cover_end(opts, filename, file, &hdr, &cover);
         }
     }
 
@@ -306,4 +481,243 @@ int main (int argc, char **argv)
     free(phdrs);
     fclose(file);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    options_t options = {0};
+    trace_filter_init(&options.filter);
+    int jobs = 0;
+    const char *snap_name = NULL;
+
+    /* Parse command-line arguments */
+    while ((opt = getopt(argc, argv, "hHsmdDcgMafeEuC:b:R:I:T:PpSF:W:j:l:t:o:xv:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'H':
+                options.show_header = 1;
+                break;
+            case 's':
+                options.show_phdrs = 1;
+                break;
+            case 'd':
+                options.disas_code = 1;
+                break;
+            case 'D':
+                options.disas_data = 1;
+                break;
+            case 'c':
+                options.cfg_mode = 1;
+                break;
+            case 'g':
+                options.cfg_mode = 2;
+                break;
+            case 'm':
+                options.show_mem = 1;
+                break;
+            case 'M':
+                options.show_mem = 1;
+                options.full_mem = 1;
+                break;
+            case 'a':
+                options.show_header = 1;
+                options.show_phdrs = 1;
+                options.show_mem = 1;
+                options.disas_code = 1;
+                options.disas_data = 1;
+                break;
+            case 'f':
+                options.show_header = 1;
+                options.show_phdrs = 1;
+                options.show_mem = 1;
+                options.full_mem = 1;
+                options.disas_code = 1;
+                options.disas_data = 1;
+                break;
+            case 'e':
+                if (options.exec_mode == 2) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.exec_mode = 1;
+                break;
+            case 'E':
+                if (options.exec_mode == 1) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.exec_mode = 2;
+                break;
+            case 'o':
+                if (!report_parse(optarg, &options.report)) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'x':
+                options.digest = true;
+                break;
+            case 'v': {
+                char *colon = strchr(optarg, ':');
+                options.snap_every = SNAP_INTERVAL;
+                if (colon != NULL) {
+                    *colon = '\0';
+                    options.snap_every = strtoull(colon + 1, NULL, 0);
+                }
+                if (options.snap_every == 0) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                snap_name = optarg;
+                break;
+            }
+            case 'P':
+                options.features |= EXEC_PROFILE;
+                break;
+            case 'R':
+                if (options.nranges == TRACE_MAXRANGES) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.ranges[options.nranges++] = optarg;
+                options.filtered = true;
+                break;
+            case 'I':
+                if (!trace_set_window(&options.filter, optarg)) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.filtered = true;
+                break;
+            case 'T':
+                if (!trace_set_trigger(&options.filter, optarg)) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.filtered = true;
+                break;
+            case 'u':
+                options.dirty_dump = true;
+                break;
+            case 'C':
+                options.features |= EXEC_COVER;
+                options.coverage = optarg;
+                break;
+            case 'b':
+                if (strcmp(optarg, "block") == 0) {
+                    options.trace_policy = TRACE_BLOCK;
+                } else if (strcmp(optarg, "drop") == 0) {
+                    options.trace_policy = TRACE_DROP;
+                } else {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                options.features |= EXEC_STATS;
+                break;
+            case 'p':
+                options.features |= EXEC_SAMPLE;
+                options.sample_hot = true;
+                break;
+            case 'F':
+                options.features |= EXEC_SAMPLE;
+                options.folded = optarg;
+                break;
+            case 'W': {
+                char *end;
+                unsigned long addr = strtoul(optarg, &end, 0);
+                unsigned long len = 8;
+                if (*end == ':') {
+                    len = strtoul(end + 1, &end, 0);
+                }
+                if (*end != '\0' || addr >= MEMSIZE || len == 0) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                options.features |= EXEC_WATCH;
+                options.watch_lo = addr;
+                options.watch_hi = addr + len;
+                break;
+            }
+            case 'l':
+                options.limit = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                options.timeout = atof(optarg);
+                if (options.timeout <= 0) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                if (jobs < 1) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case '?':
+                usage(argv);
+                return EXIT_FAILURE;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || (options.dirty_dump && options.exec_mode != 2)) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    /* Structured results run the program; a trace is text only */
+    if (options.report != REPORT_TEXT) {
+        if (options.exec_mode == 2) {
+            usage(argv);
+            return EXIT_FAILURE;
+        }
+        options.exec_mode = 1;
+        ob_init(&results, stdout);
+        report_header(&results, options.report, options.digest);
+        ob_flush(&results);
+    }
+
+    /* Coverage needs a run */
+    if (options.coverage != NULL && options.exec_mode == 0) {
+        options.exec_mode = 1;
+    }
+
+    /* Each run appends its stacks to the -F file */
+    if (options.folded != NULL) {
+        FILE *out = fopen(options.folded, "w");
+        if (out == NULL) {
+            perror(options.folded);
+            return EXIT_FAILURE;
+        }
+        fclose(out);
+    }
+
+    /* One region has one writer, so its files run one at a time */
+    if (snap_name != NULL) {
+        options.snap = snap_create(snap_name);
+        if (options.snap == NULL) {
+            perror(snap_name);
+            return EXIT_FAILURE;
+        }
+        jobs = 1;
+    }
+
+    int status = batch_run(&argv[optind], argc - optind, jobs, run_file,
+                           &options);
+
+    /* The object is ours: readers still attached keep the final state */
+    if (snap_name != NULL) {
+        snap_close(options.snap);
+        snap_remove(snap_name);
+    }
+    return status;
+}
@@ -0,0 +1,475 @@
+/*
+ * CS 261: Many-instance SIMD interpreter
+ *
+ * Name: Aiden Smith
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "multi.h"
+#include "p3-disas.h"
+
+// lanes_t is only passed between static functions here, so the warning
+// that its calling convention depends on -mavx512f does not apply
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/**********************************************************************
+ *                           LANE HELPERS
+ *********************************************************************/
+
+static inline lanes_t splat (uint64_t v)
+{
+    lanes_t zero = { 0 };
+    return zero + v;
+}
+
+/* All-ones in every lane whose bit is set */
+static inline lanes_t lane_mask (unsigned bits)
+{
+    lanes_t r = { 0 };
+    for (int i = 0; i < MULTI_LANES; i++) {
+        r[i] = -(uint64_t)((bits >> i) & 1);
+    }
+    return r;
+}
+
+/* a in the lanes set in m, b in the others */
+#define BLEND(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+static inline bool page_test (const uint64_t *pages, address_t addr)
+{
+    address_t page = addr >> PAGEBITS;
+    return (pages[page / 64] >> (page % 64)) & 1;
+}
+
+static inline void page_set (uint64_t *pages, address_t addr)
+{
+    address_t page = addr >> PAGEBITS;
+    pages[page / 64] |= 1ULL << (page % 64);
+}
+
+/* Condition codes for cmovXX and jXX in every lane, as all-ones/zero */
+static inline lanes_t cond_lanes (y86_multi_t *m, int ifun)
+{
+    lanes_t lt = m->sf ^ m->of;
+    lanes_t c;
+    switch (ifun) {
+        case JMP: c = splat(1); break;
+        case JLE: c = lt | m->zf; break;
+        case JL:  c = lt; break;
+        case JE:  c = m->zf; break;
+        case JNE: c = m->zf ^ 1; break;
+        case JGE: c = lt ^ 1; break;
+        case JG:  c = (lt | m->zf) ^ 1; break;
+        default:  c = splat(0); break;
+    }
+    return -c;
+}
+
+/**********************************************************************
+ *                             INSTANCES
+ *********************************************************************/
+
+y86_multi_t *multi_new (const byte_t *image, address_t entry)
+{
+    y86_multi_t *m = aligned_alloc(64, sizeof(y86_multi_t));
+    if (m == NULL) {
+        return NULL;
+    }
+    memset(m, 0, sizeof(*m));
+    m->eng = engine_new();
+    if (m->eng == NULL) {
+        free(m);
+        return NULL;
+    }
+
+    memcpy(m->image, image, MEMSIZE);
+    for (int i = 0; i < MULTI_LANES; i++) {
+        memcpy(m->memory[i], image, MEMSIZE);
+        m->stat[i] = AOK;
+    }
+    m->pc = splat(entry);
+    return m;
+}
+
+void multi_free (y86_multi_t *m)
+{
+    if (m != NULL) {
+        engine_free(m->eng);
+        free(m);
+    }
+}
+
+void multi_get_cpu (y86_multi_t *m, int lane, y86_t *cpu)
+{
+    for (int r = 0; r < NUMREGS; r++) {
+        cpu->reg[r] = m->reg[r][lane];
+    }
+    cpu->zf = m->zf[lane];
+    cpu->sf = m->sf[lane];
+    cpu->of = m->of[lane];
+    cpu->pc = m->pc[lane];
+    cpu->stat = m->stat[lane];
+}
+
+void multi_set_cpu (y86_multi_t *m, int lane, const y86_t *cpu)
+{
+    for (int r = 0; r < NUMREGS; r++) {
+        m->reg[r][lane] = cpu->reg[r];
+    }
+    m->zf[lane] = cpu->zf;
+    m->sf[lane] = cpu->sf;
+    m->of[lane] = cpu->of;
+    m->pc[lane] = cpu->pc;
+    m->stat[lane] = cpu->stat;
+}
+
+/* Mark the pages where a lane's memory no longer matches the image; a
+   change to code already decoded splits the lane off, as a store would */
+static void find_dirty (y86_multi_t *m, int lane)
+{
+    for (address_t addr = 0; addr < MEMSIZE; addr += 1 << PAGEBITS) {
+        if (!page_test(m->dirty[lane], addr) &&
+                memcmp(&m->memory[lane][addr], &m->image[addr], 1 << PAGEBITS)) {
+            page_set(m->dirty[lane], addr);
+            if (page_test(m->code_pages, addr)) {
+                m->scalar |= 1u << lane;
+            }
+        }
+    }
+}
+
+/*
+ * Fetch the shared decoding of the instruction at pc for the lanes in
+ * *lanes. The first time an address is decoded, the lanes whose copy of
+ * the bytes there may differ from the image are split off, and the pages
+ * become code. Returns NULL if the instruction cannot be decoded.
+ */
+static const y86_pinst_t *shared_inst (y86_multi_t *m, address_t pc,
+        unsigned *lanes, y86_stat_t *stat)
+{
+    if (pc >= MEMSIZE) {
+        *stat = ADR;
+        return NULL;
+    }
+    if ((m->decoded[pc / 64] >> (pc % 64)) & 1) {
+        return &m->insts[pc];
+    }
+
+    // an instruction is at most ten bytes long
+    address_t last = pc + 9 < MEMSIZE ? pc + 9 : MEMSIZE - 1;
+    for (int i = 0; i < MULTI_LANES; i++) {
+        if (page_test(m->dirty[i], pc) || page_test(m->dirty[i], last)) {
+            m->scalar |= 1u << i;
+        }
+    }
+    *lanes &= ~m->scalar;
+
+    y86_inst_t inst = decode(m->image, pc, stat);
+    if (*stat != AOK) {
+        return NULL;
+    }
+    page_set(m->code_pages, pc);
+    page_set(m->code_pages, inst.valP - 1);
+    m->insts[pc] = pack_inst(&inst, pc);
+    m->decoded[pc / 64] |= 1ULL << (pc % 64);
+    return &m->insts[pc];
+}
+
+/**********************************************************************
+ *                             EXECUTION
+ *********************************************************************/
+
+static inline bool mem_ok (y86_reg_t addr)
+{
+    return addr <= MEMSIZE - 8;
+}
+
+/* Store a quad in one lane; a store into shared code splits the lane off */
+static inline void lane_store (y86_multi_t *m, int lane, y86_reg_t addr,
+        y86_reg_t v)
+{
+    memcpy(&m->memory[lane][addr], &v, 8);
+    page_set(m->dirty[lane], addr);
+    page_set(m->dirty[lane], addr + 7);
+    if (page_test(m->code_pages, addr) || page_test(m->code_pages, addr + 7)) {
+        m->scalar |= 1u << lane;
+    }
+}
+
+static inline y86_reg_t lane_load (y86_multi_t *m, int lane, y86_reg_t addr)
+{
+    y86_reg_t v;
+    memcpy(&v, &m->memory[lane][addr], 8);
+    return v;
+}
+
+/*
+ * Execute one instruction in the lanes set in bits (mask as a vector), all of
+ * which are at pc. Register updates are done for all lanes at once under
+ * the mask; memory accesses are done lane by lane. Returns true if the lanes
+ * simply move on to the next instruction, leaving m->pc for the caller to
+ * update; otherwise (control transfer, fault or split) m->pc is updated.
+ */
+static inline bool step (y86_multi_t *m, const y86_pinst_t *ip,
+        address_t pc, unsigned bits, const lanes_t *mask)
+{
+    lanes_t on = *mask;
+    int ra = ip->regs >> 4;
+    int rb = ip->regs & 0x0F;
+    address_t valP = pc + ip->len;
+    lanes_t next = splat(valP);
+    lanes_t c;
+    unsigned scalar = m->scalar;
+    bool more = true;
+
+    switch (ip->opcode >> 4) {
+        case HALT:
+            for (int i = 0; i < MULTI_LANES; i++) {
+                if (bits & (1u << i)) {
+                    m->stat[i] = HLT;
+                }
+            }
+            more = false;
+            break;
+
+        case NOP:
+        case IOTRAP:
+            break;
+
+        case CMOV:
+            c = on & cond_lanes(m, ip->opcode & 0x0F);
+            m->reg[rb] = BLEND(c, m->reg[ra], m->reg[rb]);
+            break;
+
+        case IRMOVQ:
+            m->reg[rb] = BLEND(on, splat(ip->valC), m->reg[rb]);
+            break;
+
+        case OPQ: {
+            lanes_t a = m->reg[ra], b = m->reg[rb], r;
+            switch (ip->opcode & 0x0F) {
+                case ADD: r = b + a; break;
+                case SUB: r = b - a; break;
+                case AND: r = b & a; break;
+                default:  r = b ^ a; break;
+            }
+            m->reg[rb] = BLEND(on, r, b);
+            break;
+        }
+
+        case JUMP:
+            c = cond_lanes(m, ip->opcode & 0x0F);
+            next = BLEND(c, splat(ip->valC), next);
+            more = false;
+            break;
+
+        default:
+            // memory access, stack or bad instruction: lane by lane
+            more = ip->opcode >> 4 != CALL && ip->opcode >> 4 != RET;
+            for (int i = 0; i < MULTI_LANES; i++) {
+                if (!(bits & (1u << i))) {
+                    continue;
+                }
+                y86_reg_t addr;
+                switch (ip->opcode >> 4) {
+                    case RMMOVQ:
+                        if (rb == NOREG) {
+                            m->stat[i] = INS;
+                            next[i] = pc;   // the PC stays put
+                            break;
+                        }
+                        addr = m->reg[rb][i] + ip->valC;
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            next[i] = pc;   // here as well
+                            break;
+                        }
+                        lane_store(m, i, addr, m->reg[ra][i]);
+                        break;
+                    case MRMOVQ:
+                        if (rb == NOREG) {
+                            m->stat[i] = INS;
+                            next[i] = pc;
+                            break;
+                        }
+                        addr = m->reg[rb][i] + ip->valC;
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            break;
+                        }
+                        m->reg[ra][i] = lane_load(m, i, addr);
+                        break;
+                    case CALL:
+                        addr = m->reg[RSP][i] - 8;
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            break;
+                        }
+                        m->reg[RSP][i] = addr;
+                        lane_store(m, i, addr, valP);
+                        next[i] = ip->valC;
+                        break;
+                    case RET:
+                        addr = m->reg[RSP][i];
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            break;
+                        }
+                        m->reg[RSP][i] = addr + 8;
+                        next[i] = lane_load(m, i, addr);
+                        break;
+                    case PUSHQ:
+                        addr = m->reg[RSP][i] - 8;
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            break;
+                        }
+                        lane_store(m, i, addr, m->reg[ra][i]);
+                        m->reg[RSP][i] = addr;
+                        break;
+                    case POPQ:
+                        addr = m->reg[RSP][i];
+                        if (!mem_ok(addr)) {
+                            m->stat[i] = ADR;
+                            break;
+                        }
+                        m->reg[RSP][i] = addr + 8;
+                        m->reg[ra][i] = lane_load(m, i, addr);
+                        break;
+                    default:
+                        m->stat[i] = INS;
+                        next[i] = pc;
+                        break;
+                }
+                if (m->stat[i] != AOK) {
+                    more = false;
+                }
+            }
+            more = more && m->scalar == scalar;
+            break;
+    }
+    if (!more) {
+        m->pc = BLEND(on, next, m->pc);
+    }
+    return more;
+}
+
+/*
+ * Add done instructions to the count of the lanes in bits and, if move is
+ * set, leave them at pc
+ */
+static void settle (y86_multi_t *m, unsigned bits, address_t pc,
+        uint64_t done, bool move)
+{
+    if (move) {
+        lanes_t on = lane_mask(bits);
+        m->pc = BLEND(on, splat(pc), m->pc);
+    }
+    for (int i = 0; i < MULTI_LANES; i++) {
+        if (bits & (1u << i)) {
+            m->count[i] += done;
+        }
+    }
+}
+
+/* Lanes still running in lockstep mode and under the limit */
+static unsigned runnable (y86_multi_t *m, uint64_t limit)
+{
+    unsigned bits = 0;
+    for (int i = 0; i < MULTI_LANES; i++) {
+        if (m->stat[i] == AOK && m->count[i] < limit) {
+            bits |= 1u << i;
+        }
+    }
+    return bits & ~m->scalar;
+}
+
+/* Finish one lane on the scalar engine */
+static void run_scalar (y86_multi_t *m, int lane, uint64_t limit)
+{
+    y86_t cpu;
+    multi_get_cpu(m, lane, &cpu);
+    engine_flush(m->eng);
+    m->count[lane] += engine_run(m->eng, &cpu, m->memory[lane],
+                                 limit - m->count[lane]);
+    multi_set_cpu(m, lane, &cpu);
+}
+
+uint64_t multi_run (y86_multi_t *m, uint64_t limit)
+{
+    uint64_t before = 0, after = 0;
+    for (int i = 0; i < MULTI_LANES; i++) {
+        before += m->count[i];
+        find_dirty(m, i);
+    }
+
+    unsigned live;
+    while ((live = runnable(m, limit)) != 0) {
+        // the last lane in lockstep runs faster on its own
+        if ((live & (live - 1)) == 0) {
+            m->scalar |= live;
+            break;
+        }
+
+        // step the lanes at the lowest PC; the rest wait to join them
+        address_t pc = UINT64_MAX;
+        for (int i = 0; i < MULTI_LANES; i++) {
+            if ((live & (1u << i)) && m->pc[i] < pc) {
+                pc = m->pc[i];
+            }
+        }
+        unsigned bits = 0;
+        for (int i = 0; i < MULTI_LANES; i++) {
+            if ((live & (1u << i)) && m->pc[i] == pc) {
+                bits |= 1u << i;
+            }
+        }
+
+        // run them together until control flow leaves the straight line
+        uint64_t n = UINT64_MAX;
+        for (int i = 0; i < MULTI_LANES; i++) {
+            if ((bits & (1u << i)) && limit - m->count[i] < n) {
+                n = limit - m->count[i];
+            }
+        }
+        lanes_t on = lane_mask(bits);
+        uint64_t done = 0;
+        bool more = true;
+        while (more && done < n) {
+            unsigned group = bits;
+            y86_stat_t stat = AOK;
+            const y86_pinst_t *ip = shared_inst(m, pc, &bits, &stat);
+            if (bits != group) {
+                settle(m, group & ~bits, pc, done, true);
+                on = lane_mask(bits);
+            }
+            if (ip == NULL) {
+                // undecodable: these lanes fault without executing
+                for (int i = 0; i < MULTI_LANES; i++) {
+                    if (bits & (1u << i)) {
+                        m->stat[i] = stat;
+                    }
+                }
+                break;
+            }
+            if (bits == 0) {
+                break;
+            }
+            done++;
+            more = step(m, ip, pc, bits, &on);
+            pc += ip->len;
+        }
+        settle(m, bits, pc, done, more);
+    }
+
+    for (int i = 0; i < MULTI_LANES; i++) {
+        if ((m->scalar & (1u << i)) && m->stat[i] == AOK &&
+                m->count[i] < limit) {
+            run_scalar(m, i, limit);
+        }
+        after += m->count[i];
+    }
+    return after - before;
+}
@@ -0,0 +1,92 @@
+#ifndef __CS261_MULTI__
+#define __CS261_MULTI__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "y86.h"
+
+/* Instances run side by side; one SIMD vector holds a register of each */
+#define MULTI_LANES 8
+
+/* One 64-bit value per lane (AVX-512: one register; AVX2: two) */
+typedef uint64_t lanes_t __attribute__((vector_size(8 * MULTI_LANES)));
+
+/*
+ * MULTI_LANES instances of one program, with registers, flags and PCs kept
+ * as structure-of-arrays so that each instruction updates every lane at
+ * once. Each step executes the instruction at the lowest PC among the
+ * running lanes for all lanes that are at that PC; the others are masked
+ * off and catch up when control flow joins again.
+ *
+ * Lanes that are still in lockstep decode from the shared image. A lane
+ * that stores into code the shared decoder has read, or whose memory no
+ * longer matches the image where new code is decoded, is split off and
+ * finished on the scalar engine, as is the last lane left running.
+ */
+typedef struct y86_multi {
+    lanes_t reg[NUMREGS];               // registers, one lane per instance
+    lanes_t zf, sf, of;                 // flags (0 or 1)
+    lanes_t pc;
+    y86_stat_t stat[MULTI_LANES];
+    uint64_t count[MULTI_LANES];        // instructions executed per lane
+    unsigned scalar;                    // lanes split off (bit per lane)
+
+    byte_t image[MEMSIZE];              // memory as loaded
+    byte_t memory[MULTI_LANES][MEMSIZE];
+    uint64_t dirty[MULTI_LANES][PAGEWORDS];     // pages differing from image
+    uint64_t code_pages[PAGEWORDS];     // pages read by the shared decoder
+    uint64_t decoded[MEMSIZE / 64];     // addresses with a cached instruction
+    y86_pinst_t insts[MEMSIZE];         // decoded from image
+
+    y86_engine_t *eng;                  // scalar engine for split-off lanes
+} y86_multi_t;
+
+/**
+ * @brief Allocate MULTI_LANES instances of a loaded program, all starting
+ * at the entry point with zeroed registers and flags
+ *
+ * @param image Pointer to the loaded Y86 address space
+ * @param entry Address of the first instruction
+ * @returns Pointer to the instances, or NULL if they could not be allocated
+ */
+y86_multi_t *multi_new (const byte_t *image, address_t entry);
+
+/**
+ * @brief Release a set of instances
+ *
+ * @param m Instances to free (may be NULL)
+ */
+void multi_free (y86_multi_t *m);
+
+/**
+ * @brief Copy the CPU state of one lane out of the vectors
+ *
+ * @param m Instances
+ * @param lane Lane number
+ * @param cpu Structure to fill in
+ */
+void multi_get_cpu (y86_multi_t *m, int lane, y86_t *cpu);
+
+/**
+ * @brief Set the CPU state of one lane (e.g., to give each instance its own
+ * input registers); each lane's memory may be changed directly as well
+ *
+ * @param m Instances
+ * @param lane Lane number
+ * @param cpu New state
+ */
+void multi_set_cpu (y86_multi_t *m, int lane, const y86_t *cpu);
+
+/**
+ * @brief Run every lane until it stops or has executed limit instructions
+ * in total. Each lane ends in exactly the state engine_run() would give it.
+ *
+ * @param m Instances
+ * @param limit Instruction limit per lane
+ * @returns Instructions executed by all lanes together during this call
+ */
+uint64_t multi_run (y86_multi_t *m, uint64_t limit);
+
+#endif
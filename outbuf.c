@@ -0,0 +1,137 @@
+/*
+ * CS 261: Buffered output and hex formatting
+ *
+ * Name: Aiden Smith
+ */
+
+#include "outbuf.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**********************************************************************
+ *                          OUTPUT BUFFER
+ *********************************************************************/
+
+void ob_init (outbuf_t *ob, FILE *file)
+{
+    ob->file = file;
+    ob->len = 0;
+}
+
+void ob_flush (outbuf_t *ob)
+{
+    if (ob->len > 0) {
+        fwrite(ob->data, 1, ob->len, ob->file);
+        ob->len = 0;
+    }
+}
+
+void ob_printf (outbuf_t *ob, const char *fmt, ...)
+{
+    va_list ap;
+    char *out = ob_reserve(ob, OUTBUF_SLACK);
+
+    va_start(ap, fmt);
+    int n = vsnprintf(out, OUTBUF_SLACK, fmt, ap);
+    va_end(ap);
+
+    if (n < 0) {
+        return;
+    }
+    if (n < OUTBUF_SLACK) {
+        ob_commit(ob, n);
+        return;
+    }
+
+    // too long for the slack space: go straight to the stream
+    ob_flush(ob);
+    va_start(ap, fmt);
+    vfprintf(ob->file, fmt, ap);
+    va_end(ap);
+}
+
+/**********************************************************************
+ *                           HEX ENCODING
+ *********************************************************************/
+
+#if defined(__SSE2__)
+
+/* Nibble values (0-15) to ASCII: '0' + n, plus 39 more for 'a'-'f' */
+static inline __m128i nibbles_to_hex (__m128i n)
+{
+    __m128i over9 = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    __m128i ascii = _mm_add_epi8(n, _mm_set1_epi8('0'));
+    return _mm_add_epi8(ascii, _mm_and_si128(over9, _mm_set1_epi8(39)));
+}
+
+void hex16 (char *out, const byte_t *in)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+    __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+
+    // interleave so that each byte's high digit comes first
+    __m128i first = _mm_unpacklo_epi8(nibbles_to_hex(hi), nibbles_to_hex(lo));
+    __m128i second = _mm_unpackhi_epi8(nibbles_to_hex(hi), nibbles_to_hex(lo));
+    _mm_storeu_si128((__m128i *)out, first);
+    _mm_storeu_si128((__m128i *)(out + 16), second);
+}
+
+#else
+
+void hex16 (char *out, const byte_t *in)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0xF];
+    }
+}
+
+#endif
+
+/**********************************************************************
+ *                          ZERO SCANNING
+ *********************************************************************/
+
+address_t scan_nonzero (const byte_t *memory, address_t start, address_t end)
+{
+    address_t addr = start;
+
+#if defined(__AVX2__)
+    for (; addr + 32 <= end; addr += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&memory[addr]);
+        uint32_t zero = _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        if (zero != 0xFFFFFFFFu) {
+            return addr + __builtin_ctz(~zero);
+        }
+    }
+#elif defined(__SSE2__)
+    for (; addr + 16 <= end; addr += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&memory[addr]);
+        uint32_t zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        if (zero != 0xFFFF) {
+            return addr + __builtin_ctz(~zero);
+        }
+    }
+#else
+    // a word at a time until the tail
+    for (; addr + 8 <= end; addr += 8) {
+        uint64_t word;
+        memcpy(&word, &memory[addr], 8);
+        if (word != 0) {
+            break;
+        }
+    }
+#endif
+
+    while (addr < end && memory[addr] == 0) {
+        addr++;
+    }
+    return addr;
+}
@@ -0,0 +1,131 @@
+#ifndef __CS261_OUTBUF__
+#define __CS261_OUTBUF__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "y86.h"
+
+/* Size of the in-memory output buffer */
+#define OUTBUF_SIZE (64 * 1024)
+
+/* Longest single formatted item (one memory dump row, one printf) */
+#define OUTBUF_SLACK 256
+
+/*
+ * Buffered writer for the printing routines. Output is collected in a large
+ * buffer and handed to the stream with a single fwrite() whenever it fills
+ * up, instead of going through printf() once per byte.
+ */
+typedef struct outbuf {
+    FILE *file;
+    size_t len;
+    char data[OUTBUF_SIZE];
+} outbuf_t;
+
+/**
+ * @brief Start buffering output for a stream
+ *
+ * @param ob Buffer to initialize
+ * @param file Stream that receives the output
+ */
+void ob_init (outbuf_t *ob, FILE *file);
+
+/**
+ * @brief Write everything buffered so far to the stream
+ *
+ * @param ob Buffer to flush
+ */
+void ob_flush (outbuf_t *ob);
+
+/**
+ * @brief Append printf-style formatted output
+ *
+ * @param ob Buffer to append to
+ * @param fmt Format string, as for printf()
+ */
+void ob_printf (outbuf_t *ob, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Get room for up to n bytes (n <= OUTBUF_SLACK) at the end of the
+ * buffer, flushing first if needed; finish with ob_commit()
+ */
+static inline char *ob_reserve (outbuf_t *ob, size_t n)
+{
+    if (ob->len + n > OUTBUF_SIZE) {
+        ob_flush(ob);
+    }
+    return ob->data + ob->len;
+}
+
+static inline void ob_commit (outbuf_t *ob, size_t n)
+{
+    ob->len += n;
+}
+
+static inline void ob_write (outbuf_t *ob, const char *s, size_t n)
+{
+    if (ob->len + n > OUTBUF_SIZE) {
+        ob_flush(ob);
+        if (n > OUTBUF_SIZE) {
+            fwrite(s, 1, n, ob->file);
+            return;
+        }
+    }
+    memcpy(ob->data + ob->len, s, n);
+    ob->len += n;
+}
+
+static inline void ob_puts (outbuf_t *ob, const char *s)
+{
+    ob_write(ob, s, strlen(s));
+}
+
+static inline void ob_putc (outbuf_t *ob, char c)
+{
+    if (ob->len == OUTBUF_SIZE) {
+        ob_flush(ob);
+    }
+    ob->data[ob->len++] = c;
+}
+
+/**
+ * @brief Write four lowercase hex digits, as printf("%04x") does for values
+ * below 0x10000
+ *
+ * @param out Destination for the four characters (not NUL-terminated)
+ * @param value Value to format
+ */
+static inline void hex4 (char *out, uint16_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    out[0] = digits[(value >> 12) & 0xF];
+    out[1] = digits[(value >> 8) & 0xF];
+    out[2] = digits[(value >> 4) & 0xF];
+    out[3] = digits[value & 0xF];
+}
+
+/**
+ * @brief Encode 16 bytes as 32 lowercase hex digits, two per byte
+ *
+ * @param out Destination for the 32 characters (not NUL-terminated)
+ * @param in Bytes to encode
+ */
+void hex16 (char *out, const byte_t *in);
+
+/**
+ * @brief Find the first non-zero byte in a range of memory
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param start First address to check
+ * @param end Address one past the last address to check
+ * @returns Address of the first non-zero byte, or end if there is none
+ */
+address_t scan_nonzero (const byte_t *memory, address_t start, address_t end);
+
+#endif
@@ -4,7 +4,9 @@
  * Name: Aiden Smith
  */
 
+#include "p1-check.h"
 #include "p2-load.h"
+#include "outbuf.h"
 
 /**********************************************************************
  *                         REQUIRED FUNCTIONS
@@ -71,6 +73,70 @@ bool load_segment (FILE *file, byte_t *memory, elf_phdr_t *phdr)
     return true;
 }
 
+/*
+ * Read the header and every segment into a cleared address space; the
+ * loader shared by the tools that just need a program to run.
+ */
+bool load_program (FILE *file, byte_t *memory, elf_hdr_t *hdr)
+{
+    bool ok = read_header(file, hdr);
+    memset(memory, 0, MEMSIZE);
+    for (int i = 0; ok && i < hdr->e_num_phdr; i++) {
+        elf_phdr_t phdr;
+        ok = read_phdr(file, hdr->e_phdr_start + i * sizeof(elf_phdr_t), &phdr)
+             && load_segment(file, memory, &phdr);
+    }
+    return ok;
+}
+
+/*
+ * Read the symbol table entries, stopping at the string table (or at the
+ * end of the file). A missing or unreadable table has no symbols.
+ */
+int read_symbols (FILE *file, elf_hdr_t *hdr, elf_sym_t *syms, int max)
+{
+    if (file == NULL || hdr == NULL || syms == NULL || hdr->e_symtab == 0) {
+        return 0;
+    }
+
+    int count = max;
+    if (hdr->e_strtab > hdr->e_symtab) {
+        int in_table = (hdr->e_strtab - hdr->e_symtab) / sizeof(elf_sym_t);
+        if (in_table < count) {
+            count = in_table;
+        }
+    }
+
+    if (fseek(file, hdr->e_symtab, SEEK_SET) != 0) {
+        return 0;
+    }
+    return fread(syms, sizeof(elf_sym_t), count, file);
+}
+
+/*
+ * Read the symbol's name from the string table. Names end at a NUL or at
+ * the end of the file.
+ */
+bool read_symbol_name (FILE *file, elf_hdr_t *hdr, elf_sym_t *sym,
+        char *name, size_t len)
+{
+    if (file == NULL || hdr == NULL || sym == NULL || len == 0 ||
+            hdr->e_strtab == 0) {
+        return false;
+    }
+    if (fseek(file, hdr->e_strtab + sym->st_name, SEEK_SET) != 0) {
+        return false;
+    }
+
+    size_t n = 0;
+    int c;
+    while (n + 1 < len && (c = fgetc(file)) != EOF && c != '\0') {
+        name[n++] = c;
+    }
+    name[n] = '\0';
+    return n > 0;
+}
+
 /**********************************************************************
  *                         OPTIONAL FUNCTIONS
  *********************************************************************/
@@ -124,52 +190,88 @@ void dump_phdrs (uint16_t numphdrs, elf_phdr_t *phdrs)
     }
 }
 
+/* Length of a full 16-byte dump row, including the newline */
+#define ROWLEN 57
+
+/* Column of byte i (0-15) in a dump row; bytes 8-15 get one extra space */
+#define ROWCOL(i) (8 + 3 * (i) + ((i) >= 8))
+
+/*
+ * Format one dump row of n bytes (1-16) at addr into out; returns its length.
+ * Full rows are hex-encoded 16 bytes at a time.
+ */
+static size_t format_row (char *out, const byte_t *memory, uint16_t addr, int n)
+{
+    out[0] = out[1] = ' ';
+    hex4(out + 2, addr);
+    out[6] = out[7] = ' ';
+
+    if (n == 16) {
+        char hex[32];
+        hex16(hex, &memory[addr]);
+        memset(out + 8, ' ', ROWLEN - 9);
+        for (int i = 0; i < 16; i++) {
+            memcpy(out + ROWCOL(i), hex + 2 * i, 2);
+        }
+        out[ROWLEN - 1] = '\n';
+        return ROWLEN;
+    }
+
+    // partial last row: no trailing spaces
+    static const char digits[] = "0123456789abcdef";
+    size_t len = 8;
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            out[len++] = ' ';
+        }
+        out[len++] = digits[memory[addr + i] >> 4];
+        out[len++] = digits[memory[addr + i] & 0xF];
+        if (i == 7 && n > 8) {
+            out[len++] = ' ';
+        }
+    }
+    out[len++] = '\n';
+    return len;
+}
+
 /*
  * Print contents of virtual memory from start to end.
  * 16 byte alignment and only output requested byte.
  * If not aligned bytes should be printed as empty spaces.
  */
 void dump_memory(byte_t *memory, uint16_t start, uint16_t end) {
-    
+
+    static outbuf_t out;
+    ob_init(&out, stdout);
+
     // 4 digit hexadecimal format
-    printf("Contents of memory from %04x to %04x:\n", start, end);
+    ob_printf(&out, "Contents of memory from %04x to %04x:\n", start, end);
 
     if (memory == NULL || start >= end || end > MEMSIZE) {
+        ob_flush(&out);
         return; // parameter check
     }
 
-    // Loop through range
+    // all-zero rows are copied from a template, skipping the formatting
+    char zero_row[ROWLEN];
+    byte_t zeros[16] = {0};
+    format_row(zero_row, zeros, 0, 16);
+    address_t nonzero = scan_nonzero(memory, start, end);
+
     for (uint16_t addr = start; addr < end; addr += 16) {
+        int n = (end - addr < 16) ? end - addr : 16;
+        char *row = ob_reserve(&out, ROWLEN);
 
-        // avoid trailing spaces
-        bool fb = true;
-        printf("  %04x  ", addr);
-        // Determine the last byte in the current line that should be printed
-        uint16_t line_end = (addr + 16 < end) ? addr + 16 : end;
-
-        // Print the memory. MUST ALIGN
-        for (uint16_t i = 0; i < 16; i++) {
-            uint16_t current_addr = addr + i;
-
-            if (current_addr < start || current_addr >= line_end) {
-                continue;
-            }
-
-            // pring space before if not the first byte
-            if (!fb) {
-                printf(" ");
-            } else {
-                fb = false;
-            }
-
-            // byte in hexadecimal
-            printf("%02x", memory[current_addr]);
-
-            // allignment
-            if (i == 7 && (addr + 8) < line_end) {
-                printf(" ");
-            }
+        if (n == 16 && nonzero >= addr + 16u) {
+            memcpy(row, zero_row, ROWLEN);
+            hex4(row + 2, addr);
+            ob_commit(&out, ROWLEN);
+            continue;
+        }
+        ob_commit(&out, format_row(row, memory, addr, n));
+        if (nonzero < addr + 16u) {
+            nonzero = scan_nonzero(memory, addr + 16, end);
         }
-        printf("\n");
     }
+    ob_flush(&out);
 }
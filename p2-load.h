@@ -32,6 +32,42 @@ bool read_phdr (FILE *file, uint16_t offset, elf_phdr_t *phdr);
  */
 bool load_segment (FILE *file, byte_t *memory, elf_phdr_t *phdr);
 
+/**
+ * @brief Load a whole Mini-ELF program from an open file stream: check the
+ * header, clear memory and load every segment
+ *
+ * @param file File stream to use for input
+ * @param memory Pointer to the beginning of the Y86 address space, which
+ * is cleared before the segments are loaded
+ * @param hdr Pointer to memory where the Mini-ELF header should be loaded
+ * @returns True if the header and every segment were loaded, false otherwise
+ */
+bool load_program (FILE *file, byte_t *memory, elf_hdr_t *hdr);
+
+/**
+ * @brief Load the Mini-ELF symbol table from an open file stream
+ *
+ * @param file File stream to use for input
+ * @param hdr Mini-ELF header giving the symbol and string table offsets
+ * @param syms Array into which the symbols should be loaded
+ * @param max Capacity of syms
+ * @returns Number of symbols loaded (zero if there is no symbol table)
+ */
+int read_symbols (FILE *file, elf_hdr_t *hdr, elf_sym_t *syms, int max);
+
+/**
+ * @brief Read a symbol's name from the string table of an open file stream
+ *
+ * @param file File stream to use for input
+ * @param hdr Mini-ELF header giving the string table offset
+ * @param sym Symbol whose name should be read
+ * @param name Buffer for the NUL-terminated name (cut short if too long)
+ * @param len Size of name
+ * @returns True if the name was read, false if there is no string table
+ */
+bool read_symbol_name (FILE *file, elf_hdr_t *hdr, elf_sym_t *sym,
+        char *name, size_t len);
+
 /**
  * @brief Print Mini-ELF program header information to standard out
  *
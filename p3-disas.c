@@ -5,11 +5,79 @@
  */
 
 #include "p3-disas.h"
+#include "outbuf.h"
 
 /**********************************************************************
  *                         REQUIRED FUNCTIONS
  *********************************************************************/
 
+/*
+ * Opcode descriptor table, indexed by the full opcode byte. Every valid
+ * icode/ifun pair has a non-zero length; everything else decodes as INS.
+ * Opcodes without a register byte accept only the NOREG nibbles that the
+ * decoder substitutes for them.
+ */
+#define DESC(len, valc, regs, ra_ok, rb_ok) { len, valc, regs, 0, ra_ok, rb_ok }
+#define NOREGS(len, valc) DESC(len, valc, false, REGS_NONE, REGS_NONE)
+
+const y86_opdesc_t opcode_table[256] = {
+    [0x00]          = NOREGS( 1, 0),                            // halt
+    [0x10]          = NOREGS( 1, 0),                            // nop
+    [0x20 ... 0x26] = DESC( 2, 0, true, REGS_ANY,  REGS_ANY),   // cmovXX
+    [0x30]          = DESC(10, 2, true, REGS_NONE, REGS_ANY),   // irmovq
+    [0x40]          = DESC(10, 2, true, REGS_ANY,  REGS_ALL),   // rmmovq
+    [0x50]          = DESC(10, 2, true, REGS_ANY,  REGS_ALL),   // mrmovq
+    [0x60 ... 0x63] = DESC( 2, 0, true, REGS_ANY,  REGS_ANY),   // OPq
+    [0x70 ... 0x76] = NOREGS( 9, 1),                            // jXX
+    [0x80]          = NOREGS( 9, 1),                            // call
+    [0x90]          = NOREGS( 1, 0),                            // ret
+    [0xa0]          = DESC( 2, 0, true, REGS_ANY,  REGS_NONE),  // pushq
+    [0xb0]          = DESC( 2, 0, true, REGS_ANY,  REGS_NONE),  // popq
+    [0xc0 ... 0xc5] = NOREGS( 1, 0),                            // iotrap
+};
+
+y86_inst_t decode_slow (const byte_t *memory, address_t pc, y86_stat_t *stat)
+{
+    y86_inst_t inst;
+    const y86_opdesc_t *desc = &opcode_table[memory[pc]];
+
+    inst.icode = memory[pc] >> 4;
+    inst.ifun.b = memory[pc] & 0x0F;
+    inst.ra = NOREG;
+    inst.rb = NOREG;
+    inst.valC.v = 0;
+    inst.valP = pc;
+
+    // report errors in the order the fields appear in the instruction
+    *stat = AOK;
+    if (desc->len == 0) {
+        *stat = INS;
+    } else if (desc->regs && pc + 1 >= MEMSIZE) {
+        *stat = ADR;
+    } else {
+        if (desc->regs) {
+            inst.ra = memory[pc + 1] >> 4;
+            inst.rb = memory[pc + 1] & 0x0F;
+            if (!((desc->ra_ok >> inst.ra) & (desc->rb_ok >> inst.rb) & 1)) {
+                *stat = INS;
+            }
+        }
+        if (*stat == AOK && pc + desc->len > MEMSIZE) {
+            *stat = ADR;
+        }
+    }
+
+    if (*stat != AOK) {
+        inst.icode = INVALID;
+        return inst;
+    }
+    if (desc->valc) {
+        memcpy(&inst.valC, &memory[pc + desc->valc], 8);
+    }
+    inst.valP = pc + desc->len;
+    return inst;
+}
+
 y86_inst_t fetch (y86_t *cpu, byte_t *memory)
 {
     y86_inst_t inst;
@@ -20,412 +88,255 @@ y86_inst_t fetch (y86_t *cpu, byte_t *memory)
         return inst;
     }
 
-    // the program counter and valP
-    address_t pc = cpu->pc;
-    inst.valP = pc;
-
     // Check bounds
-    if (pc >= MEMSIZE) {
+    if (cpu->pc >= MEMSIZE) {
         cpu->stat = ADR;
         inst.icode = INVALID;
+        inst.valP = cpu->pc;
         return inst;
     }
 
-    // Fetch the opcode
-    byte_t opcode = memory[pc];
-    inst.valP++; // after reading opcode
+    y86_stat_t stat;
+    inst = decode(memory, cpu->pc, &stat);
+    cpu->stat = stat;
+    return inst;
+}
 
-    // split
-    inst.icode = opcode >> 4; // High 4 bits
-    inst.ifun.b = opcode & 0x0F; // Low 4 bits
+size_t encode_inst (const y86_inst_t *inst, byte_t *out)
+{
+    byte_t opcode = (inst->icode << 4) | (inst->ifun.b & 0x0F);
+    const y86_opdesc_t *desc = &opcode_table[opcode];
 
-    // instruction based on icode
-    switch (inst.icode) {
-        case HALT:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS; // Invalid
-                inst.icode = INVALID;
-                return inst;
-            }
-            inst.icode = HALT;
-            break;
+    out[0] = opcode;
+    if (desc->regs) {
+        out[1] = (inst->ra << 4) | (inst->rb & 0x0F);
+    }
+    if (desc->valc) {
+        memcpy(&out[desc->valc], &inst->valC, 8);
+    }
+    return desc->len;
+}
 
-        case NOP:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            inst.icode = NOP;
-            break;
+y86_pinst_t pack_inst (const y86_inst_t *inst, address_t pc)
+{
+    y86_pinst_t pinst = {0};
 
-        case CMOV:
-            if (inst.ifun.cmov < RRMOVQ || inst.ifun.cmov > CMOVG) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // Read register
-            if (inst.valP >= MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                byte_t reg_byte = memory[inst.valP];
-                inst.valP++;
-                inst.ra = reg_byte >> 4;
-                inst.rb = reg_byte & 0x0F;
-
-                // Validate register numbers
-                if (inst.ra > R14 || inst.rb > R14) {
-                    cpu->stat = INS;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-            }
-            inst.icode = CMOV;
-            break;
+    pinst.opcode = (inst->icode << 4) | (inst->ifun.b & 0x0F);
+    pinst.regs = (inst->ra << 4) | (inst->rb & 0x0F);
+    pinst.len = inst->valP - pc;
+    pinst.valC = inst->valC.v;
+    return pinst;
+}
 
-        case IRMOVQ:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // Read register
-            if (inst.valP >= MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                byte_t reg_byte = memory[inst.valP];
-                inst.valP++;
-                inst.ra = reg_byte >> 4;
-                inst.rb = reg_byte & 0x0F;
-
-                // Validate registers
-                if (inst.ra != NOREG || inst.rb > R14) {
-                    cpu->stat = INS;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-
-                // Read 8-byte value
-                if (inst.valP + 8 > MEMSIZE) {
-                    cpu->stat = ADR;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-                uint64_t valC = 0;
-                memcpy(&valC, &memory[inst.valP], 8);
-                inst.valC.v = (int64_t)valC;
-                inst.valP += 8;
-            }
-            inst.icode = IRMOVQ;
-            break;
+y86_inst_t unpack_inst (const y86_pinst_t *pinst, address_t pc)
+{
+    y86_inst_t inst;
 
-        case RMMOVQ:
-        case MRMOVQ:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // Read register
-            if (inst.valP >= MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                byte_t reg_byte = memory[inst.valP];
-                inst.valP++;
-                inst.ra = reg_byte >> 4;
-                inst.rb = reg_byte & 0x0F;
-
-                // Validate registers
-                if (inst.ra > R14 || inst.rb > NOREG) {
-                    cpu->stat = INS;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-
-                // Read 8-byte displacement
-                if (inst.valP + 8 > MEMSIZE) {
-                    cpu->stat = ADR;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-                uint64_t valC = 0;
-                memcpy(&valC, &memory[inst.valP], 8);
-                inst.valC.d = (int64_t)valC;
-                inst.valP += 8;
-            }
-            inst.icode = inst.icode;  // RMMOVQ or MRMOVQ
-            break;
+    inst.icode = pinst->opcode >> 4;
+    inst.ifun.b = pinst->opcode & 0x0F;
+    inst.ra = pinst->regs >> 4;
+    inst.rb = pinst->regs & 0x0F;
+    inst.valC.v = pinst->valC;
+    inst.valP = pc + pinst->len;
+    return inst;
+}
 
-        case OPQ:
-            // Validate OPQ
-            if (inst.ifun.op < ADD || inst.ifun.op > XOR) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // Read register
-            if (inst.valP >= MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                byte_t reg_byte = memory[inst.valP];
-                inst.valP++;
-                inst.ra = reg_byte >> 4;
-                inst.rb = reg_byte & 0x0F;
-
-                // Validate registers
-                if (inst.ra > R14 || inst.rb > R14) {
-                    cpu->stat = INS;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-            }
-            inst.icode = OPQ;
-            break;
+/**********************************************************************
+ *                         OPTIONAL FUNCTIONS
+ *********************************************************************/
 
-        case JUMP:
-            // Validate JUMP
-            if (inst.ifun.jump < JMP || inst.ifun.jump > JG) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // 8-byte address
-            if (inst.valP + 8 > MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                uint64_t dest = 0;
-                memcpy(&dest, &memory[inst.valP], 8);
-                inst.valC.dest = dest;
-                inst.valP += 8;
-            }
-            inst.icode = JUMP;
-            break;
+/* Register names, indexed by register number */
+static const char *const reg_names[16] = {
+    "%rax", "%rcx", "%rdx", "%rbx",
+    "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8",  "%r9",  "%r10", "%r11",
+    "%r12", "%r13", "%r14", "NOREG"
+};
 
-        case CALL:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            if (inst.valP + 8 > MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                uint64_t dest = 0;
-                memcpy(&dest, &memory[inst.valP], 8);
-                inst.valC.dest = dest;
-                inst.valP += 8;
-            }
-            inst.icode = CALL;
-            break;
+// names for OPq
+static const char *const opq_names[4] = {
+    "addq ", "subq ", "andq ", "xorq "
+};
 
-        case RET:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            inst.icode = RET;
-            break;
+static const char *const cmov_names[7] = {
+    "rrmovq ", "cmovle ", "cmovl ", "cmove ", "cmovne ", "cmovge ", "cmovg "
+};
 
-        case PUSHQ:
-        case POPQ:
-            if (inst.ifun.b != 0) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            // Read register byte
-            if (inst.valP >= MEMSIZE) {
-                cpu->stat = ADR;
-                inst.icode = INVALID;
-                return inst;
-            }
-            {
-                byte_t reg_byte = memory[inst.valP];
-                inst.valP++;
-                inst.ra = reg_byte >> 4;
-                inst.rb = reg_byte & 0x0F;
-
-                // rb should be NOREG
-                if (inst.ra > R14 || inst.rb != NOREG) {
-                    cpu->stat = INS;
-                    inst.icode = INVALID;
-                    return inst;
-                }
-            }
-            inst.icode = inst.icode;  // PUSHQ or POPQ
-            break;
+static const char *const jump_names[7] = {
+    "jmp ", "jle ", "jl ", "je ", "jne ", "jge ", "jg "
+};
 
-        case IOTRAP:
-            if (inst.ifun.b > FLUSH) {
-                cpu->stat = INS;
-                inst.icode = INVALID;
-                return inst;
-            }
-            inst.icode = IOTRAP;
-            break;
-        default:
-            // Invalid
-            cpu->stat = INS;
-            inst.icode = INVALID;
-            return inst;
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Shared output buffer for the segment disassemblers */
+static outbuf_t disas_out;
+
+static inline char *put_str (char *out, const char *s)
+{
+    while (*s) {
+        *out++ = *s++;
     }
-    cpu->stat = AOK;  // CPU is AOK
-    return inst; // successful
+    return out;
+}
 
+/* Lowercase hex without leading zeros, padded to at least width digits */
+static inline char *put_hex (char *out, uint64_t v, int width)
+{
+    int n = v ? (67 - __builtin_clzll(v)) / 4 : 1;
+    if (n < width) {
+        n = width;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        out[i] = hex_digits[v & 0xF];
+        v >>= 4;
+    }
+    return out + n;
 }
 
-/**********************************************************************
- *                         OPTIONAL FUNCTIONS
- *********************************************************************/
+/* "0x" followed by put_hex(), as printf("0x%lx") */
+static inline char *put_addr (char *out, uint64_t v, int width)
+{
+    *out++ = '0';
+    *out++ = 'x';
+    return put_hex(out, v, width);
+}
 
-void disassemble (y86_inst_t *inst)
+/* Bytes as "xx " groups, space-padded to at least width characters */
+static inline char *put_bytes (char *out, const byte_t *bytes, int n, int width)
+{
+    char *end = out + width;
+    for (int i = 0; i < n; i++) {
+        *out++ = hex_digits[bytes[i] >> 4];
+        *out++ = hex_digits[bytes[i] & 0xF];
+        *out++ = ' ';
+    }
+    while (out < end) {
+        *out++ = ' ';
+    }
+    return out;
+}
+
+size_t format_inst (char *out, const y86_inst_t *inst)
 {
-    // numbers to registers
-    const char *reg_names[16] = {
-        "%rax", "%rcx", "%rdx", "%rbx",
-        "%rsp", "%rbp", "%rsi", "%rdi",
-        "%r8",  "%r9",  "%r10", "%r11",
-        "%r12", "%r13", "%r14", "NOREG"
-    };
-
-    // names for OPq
-    const char *opq_names[4] = {
-        "addq", "subq", "andq", "xorq"
-    };
-
-    const char *cmov_names[] = {
-        "rrmovq", // 0
-        "cmovle", // 1
-        "cmovl",  // 2
-        "cmove",  // 3
-        "cmovne", // 4
-        "cmovge", // 5
-        "cmovg"   // 6
-    };
-
-    const char *jump_names[] = {
-        "jmp",    // 0
-        "jle",    // 1
-        "jl",     // 2
-        "je",     // 3
-        "jne",    // 4
-        "jge",    // 5
-        "jg"      // 6
-    };
+    char *p = out;
 
     switch (inst->icode) {
         case HALT:
-            printf("halt");
+            p = put_str(p, "halt");
             break;
 
         case NOP:
-            printf("nop");
+            p = put_str(p, "nop");
             break;
 
         case CMOV:
             if (inst->ifun.cmov >= RRMOVQ && inst->ifun.cmov <= CMOVG) {
-                printf("%s %s, %s",
-                    cmov_names[inst->ifun.cmov],
-                    reg_names[inst->ra],
-                    reg_names[inst->rb]);
+                p = put_str(p, cmov_names[inst->ifun.cmov]);
+                p = put_str(p, reg_names[inst->ra]);
+                p = put_str(p, ", ");
+                p = put_str(p, reg_names[inst->rb]);
             }
             break;
 
         case IRMOVQ:
-            printf("irmovq 0x%lx, %s",
-                   inst->valC.v,
-                   reg_names[inst->rb]);
+            p = put_str(p, "irmovq ");
+            p = put_addr(p, inst->valC.v, 1);
+            p = put_str(p, ", ");
+            p = put_str(p, reg_names[inst->rb]);
             break;
 
         case RMMOVQ:
+            p = put_str(p, "rmmovq ");
+            p = put_str(p, reg_names[inst->ra]);
+            p = put_str(p, ", ");
+            p = put_addr(p, inst->valC.d, 1);
             if (inst->rb != NOREG) {
-            printf("rmmovq %s, 0x%lx(%s)",
-                reg_names[inst->ra],
-                inst->valC.d,
-                reg_names[inst->rb]);
-            } else {
-                printf("rmmovq %s, 0x%lx",
-                    reg_names[inst->ra],
-                    inst->valC.d);
+                *p++ = '(';
+                p = put_str(p, reg_names[inst->rb]);
+                *p++ = ')';
             }
             break;
 
         case MRMOVQ:
+            p = put_str(p, "mrmovq ");
+            p = put_addr(p, inst->valC.d, 1);
             if (inst->rb != NOREG) {
-            printf("mrmovq 0x%lx(%s), %s",
-                inst->valC.d,
-                reg_names[inst->rb],
-                reg_names[inst->ra]);
-            } else {
-                printf("mrmovq 0x%lx, %s",
-                    inst->valC.d,
-                    reg_names[inst->ra]);
+                *p++ = '(';
+                p = put_str(p, reg_names[inst->rb]);
+                *p++ = ')';
             }
+            p = put_str(p, ", ");
+            p = put_str(p, reg_names[inst->ra]);
             break;
 
         case OPQ:
             if (inst->ifun.op >= ADD && inst->ifun.op <= XOR) {
-                printf("%s %s, %s",
-                       opq_names[inst->ifun.op],
-                       reg_names[inst->ra],
-                       reg_names[inst->rb]);
+                p = put_str(p, opq_names[inst->ifun.op]);
+                p = put_str(p, reg_names[inst->ra]);
+                p = put_str(p, ", ");
+                p = put_str(p, reg_names[inst->rb]);
             }
             break;
 
         case JUMP:
             if (inst->ifun.jump >= JMP && inst->ifun.jump <= JG) {
-                printf("%s 0x%lx",
-                       jump_names[inst->ifun.jump],
-                       inst->valC.dest);
+                p = put_str(p, jump_names[inst->ifun.jump]);
+                p = put_addr(p, inst->valC.dest, 1);
             }
             break;
 
         case CALL:
-            printf("call 0x%lx", inst->valC.dest);
+            p = put_str(p, "call ");
+            p = put_addr(p, inst->valC.dest, 1);
             break;
 
         case RET:
-            printf("ret");
+            p = put_str(p, "ret");
             break;
 
         case PUSHQ:
-            printf("pushq %s", reg_names[inst->ra]);
+            p = put_str(p, "pushq ");
+            p = put_str(p, reg_names[inst->ra]);
             break;
 
         case POPQ:
-            printf("popq %s", reg_names[inst->ra]);
+            p = put_str(p, "popq ");
+            p = put_str(p, reg_names[inst->ra]);
             break;
 
         case IOTRAP:
-            printf("iotrap %d", inst->ifun.b);
+            p += sprintf(p, "iotrap %d", inst->ifun.b);
             break;
 
         default:
             break;
     }
+    *p = '\0';
+    return p - out;
+}
+
+size_t format_code_line (char *out, const byte_t *memory, address_t addr,
+        const y86_inst_t *inst)
+{
+    // "  0x<addr>: <hex bytes padded to 30>|   <assembly>"
+    char *p = put_str(out, "  ");
+    p = put_addr(p, addr, 3);
+    *p++ = ':';
+    *p++ = ' ';
+    p = put_bytes(p, &memory[addr], inst->valP - addr, 30);
+    p = put_str(p, "|   ");
+    p += format_inst(p, inst);
+    *p++ = '\n';
+    return p - out;
+}
+
+void disassemble (y86_inst_t *inst)
+{
+    char text[Y86_TEXTLEN];
+    format_inst(text, inst);
+    fputs(text, stdout);
 }
 
-#define MAX_HEX_BYTES_CODE 30
 void disassemble_code(byte_t *memory, elf_phdr_t *phdr, elf_hdr_t *hdr)
 {
 
@@ -435,7 +346,8 @@ void disassemble_code(byte_t *memory, elf_phdr_t *phdr, elf_hdr_t *hdr)
     address_t end_addr = start_addr + phdr->p_size;
     cpu.pc = start_addr;
 
-    printf("  0x%03lx:                               | .pos 0x%03lx code\n", start_addr, start_addr);
+    ob_init(&disas_out, stdout);
+    ob_printf(&disas_out, "  0x%03lx:                               | .pos 0x%03lx code\n", start_addr, start_addr);
 
     // Loop over instructions
     while (cpu.pc < end_addr) {
@@ -444,41 +356,24 @@ void disassemble_code(byte_t *memory, elf_phdr_t *phdr, elf_hdr_t *hdr)
 
         // print error and break
         if (inst.icode == INVALID) {
-            printf("Invalid opcode: 0x%02x\n", memory[instr_addr]);
+            ob_printf(&disas_out, "Invalid opcode: 0x%02x\n", memory[instr_addr]);
             break;
         }
 
         // instruction matches the entry point
         if (instr_addr == hdr->e_entry) {
-            printf("  0x%03lx:                               | _start:\n", instr_addr);
+            ob_printf(&disas_out, "  0x%03lx:                               | _start:\n", instr_addr);
         }
 
-        printf("  0x%03lx: ", instr_addr);
-
-        // get hex bytes of the instruction
-        char hex_bytes[MAX_HEX_BYTES_CODE];
-        int hex_len = 0;
-        for (address_t addr = instr_addr; addr < inst.valP && addr < MEMSIZE; addr++) {
-            if (hex_len + 3 > MAX_HEX_BYTES_CODE) {
-                break;
-            }
-            hex_len += snprintf(&hex_bytes[hex_len], MAX_HEX_BYTES_CODE - hex_len + 1, "%02x ", memory[addr]);
-        }
-
-        // Pad the hex_bytes characters
-        printf("%-30s", hex_bytes);
-
-        // Print the assembly code
-        printf("|   ");
-        disassemble(&inst);
-        printf("\n");
+        char *line = ob_reserve(&disas_out, OUTBUF_SLACK);
+        ob_commit(&disas_out, format_code_line(line, memory, instr_addr, &inst));
 
         // Update the PC to the next instruction
         cpu.pc = inst.valP;
     }
+    ob_flush(&disas_out);
 }
 
-#define MAX_HEX_BYTES_DATA 24
 void disassemble_data (byte_t *memory, elf_phdr_t *phdr)
 {
     if (memory == NULL || phdr == NULL) {
@@ -495,7 +390,8 @@ void disassemble_data (byte_t *memory, elf_phdr_t *phdr)
     }
 
     // Print the .pos and data label
-    printf("  0x%lx:                               | .pos 0x%lx data\n", start_addr, start_addr);
+    ob_init(&disas_out, stdout);
+    ob_printf(&disas_out, "  0x%lx:                               | .pos 0x%lx data\n", start_addr, start_addr);
 
     // Loop in 8-byte increments
     for (address_t addr = start_addr; addr < end_addr; addr += 8) {
@@ -507,27 +403,28 @@ void disassemble_data (byte_t *memory, elf_phdr_t *phdr)
             bytes_left = (int)(end_addr - addr);
         }
 
-
-        printf("  0x%lx: ", addr); // print address
-
-        char hex_bytes[MAX_HEX_BYTES_DATA];
-        int hex_len = 0;
-        for (int i = 0; i < bytes_left; i++) {
-            hex_len += snprintf(&hex_bytes[hex_len], MAX_HEX_BYTES_DATA - hex_len + 1, "%02x ", memory[addr + i]);
-        }
-
-        // Pad the hex_bytes characters
-        printf("%-24s", hex_bytes);
-
         // Read the 8-byte value
         uint64_t quad_value = 0;
         memcpy(&quad_value, &memory[addr], bytes_left);
 
-        // Print the .quad in hex
-        printf("      |   .quad 0x%lx\n", quad_value);
+        // "  0x<addr>: <hex bytes padded to 24>      |   .quad 0x<value>"
+        char *line = ob_reserve(&disas_out, OUTBUF_SLACK);
+        char *p = put_str(line, "  ");
+        p = put_addr(p, addr, 1);
+        *p++ = ':';
+        *p++ = ' ';
+        p = put_bytes(p, &memory[addr], bytes_left, 24);
+        p = put_str(p, "      |   .quad ");
+        p = put_addr(p, quad_value, 1);
+        *p++ = '\n';
+        ob_commit(&disas_out, p - line);
     }
+    ob_flush(&disas_out);
 }
 
+/* Bytes shown on each line of a rodata string */
+#define RODATA_LINE 10
+
 void disassemble_rodata(byte_t *memory, elf_phdr_t *phdr)
 {
     if (memory == NULL || phdr == NULL) {
@@ -543,64 +440,41 @@ void disassemble_rodata(byte_t *memory, elf_phdr_t *phdr)
     }
 
     // Print the .pos and rodata label
-    printf("  0x%lx:                               | .pos 0x%lx rodata\n", start_addr, start_addr);
-
-    address_t addr = start_addr;
-    while (addr < end_addr) {
-        // Initialize buffers
-        char hex_bytes[MAX_HEX_BYTES_CODE] = {0};
-        char ascii_str[256] = {0};
-        int hex_len = 0;
-        int str_len = 0;
-
-        // starting address
-        address_t string_start_addr = addr;
-
-        // Read characters until end
-        while (addr < end_addr) {
-            // Append hex
-            if (hex_len + 3 <= MAX_HEX_BYTES_CODE) {
-                hex_len += snprintf(&hex_bytes[hex_len], MAX_HEX_BYTES_CODE - hex_len + 1, "%02x ", memory[addr]);
-            }
-
-            // Append character to string
-            ascii_str[str_len++] = memory[addr];
-
-            addr++;
-        }
-
-        // Print the address
-        printf("  0x%lx: ", string_start_addr);
-
-        // Pad the hex_bytes characters
-        printf("%-30s", hex_bytes);
-
-        // Print and ASCII string
-        printf("|   .string \"%s\"\n", ascii_str);
-
-        // If the string was longer than the hex_bytes field, print additional lines for the remaining hex bytes
-        address_t extra_addr = string_start_addr + (MAX_HEX_BYTES_CODE / 3);
-        while (addr > extra_addr) {
-            // bytes already printed
-            int bytes_printed = (MAX_HEX_BYTES_CODE / 3);
-            int bytes_remaining = (addr - string_start_addr) - bytes_printed;
-
-            if (bytes_remaining <= 0) {
-                break;
-            }
-
-            // Prepare the next line
-            hex_len = 0;
-            for (int i = 0; i < 10 && bytes_remaining > 0; i++, bytes_printed++, bytes_remaining--) {
-                hex_len += snprintf(&hex_bytes[hex_len], MAX_HEX_BYTES_CODE - hex_len + 1, "%02x ", memory[string_start_addr + bytes_printed]);
-            }
-
-            // Print the address and hex bytes
-            printf("  0x%lx: ", extra_addr);
-            printf("%-30s|\n", hex_bytes);
-
-            extra_addr += (MAX_HEX_BYTES_CODE / 3);
+    ob_init(&disas_out, stdout);
+    ob_printf(&disas_out, "  0x%lx:                               | .pos 0x%lx rodata\n", start_addr, start_addr);
+
+    // the whole segment is printed as a single string
+    if (start_addr < end_addr) {
+        int total = end_addr - start_addr;
+        int first = total < RODATA_LINE ? total : RODATA_LINE;
+        int more = total < 2 * RODATA_LINE ? total - RODATA_LINE : RODATA_LINE;
+        const byte_t *bytes = &memory[start_addr];
+        size_t str_len = strnlen((const char *)bytes, total);
+
+        char *line = ob_reserve(&disas_out, OUTBUF_SLACK);
+        char *p = put_str(line, "  ");
+        p = put_addr(p, start_addr, 1);
+        *p++ = ':';
+        *p++ = ' ';
+        p = put_bytes(p, bytes, first, 30);
+        p = put_str(p, "|   .string \"");
+        ob_commit(&disas_out, p - line);
+        ob_write(&disas_out, (const char *)bytes, str_len);
+        ob_write(&disas_out, "\"\n", 2);
+
+        // continuation lines all repeat the string's second group of bytes
+        for (address_t extra_addr = start_addr + RODATA_LINE;
+                extra_addr < end_addr; extra_addr += RODATA_LINE) {
+            line = ob_reserve(&disas_out, OUTBUF_SLACK);
+            p = put_str(line, "  ");
+            p = put_addr(p, extra_addr, 1);
+            *p++ = ':';
+            *p++ = ' ';
+            p = put_bytes(p, bytes + RODATA_LINE, more, 30);
+            *p++ = '|';
+            *p++ = '\n';
+            ob_commit(&disas_out, p - line);
         }
     }
+    ob_flush(&disas_out);
 }
-
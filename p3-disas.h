@@ -11,6 +11,115 @@
 #include "elf.h"
 #include "y86.h"
 
+/* Register-byte rules: bit n is set if register nibble n is allowed */
+#define REGS_ANY  0x7fff        // %rax through %r14
+#define REGS_NONE 0x8000        // NOREG only
+#define REGS_ALL  0xffff        // any register, including NOREG
+
+/* Longest Y86 instruction, in bytes */
+#define Y86_MAXLEN 10
+
+/* Length of every valid instruction, one nibble per icode from halt up.
+   Equal to opcode_table[].len, but computing valP from the opcode alone
+   keeps the table load off the path from one instruction to the next. */
+#define ICODE_LENGTHS 0x1221992aaa211ULL
+
+/* Shape of the instruction named by one opcode byte */
+typedef struct y86_opdesc {
+    uint8_t len;                // length in bytes (0 if the opcode is invalid)
+    uint8_t valc;               // offset of valC (0 if there is none)
+    bool regs;                  // true if there is a register byte
+    uint8_t pad;
+    uint16_t ra_ok;             // allowed rA values
+    uint16_t rb_ok;             // allowed rB values
+} y86_opdesc_t;
+
+/* Descriptor table shared by every decoder, indexed by opcode byte */
+extern const y86_opdesc_t opcode_table[256];
+
+/**
+ * @brief Decode an instruction that may be invalid or run past the end of
+ * memory, checking every read (the out-of-line half of decode())
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param pc Address of the instruction (must be less than MEMSIZE)
+ * @param stat Set to AOK, or to INS/ADR if the instruction cannot be decoded
+ * @returns Decoded instruction (icode INVALID on failure)
+ */
+y86_inst_t decode_slow (const byte_t *memory, address_t pc, y86_stat_t *stat);
+
+/**
+ * @brief Decode the instruction at pc with opcode_table. This is the decoder
+ * shared by fetch(), the disassembler and the execution engines; it is
+ * inline so the common case compiles to a table lookup and fixed-shape reads.
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param pc Address of the instruction (must be less than MEMSIZE)
+ * @param stat Set to AOK, or to INS/ADR if the instruction cannot be decoded
+ * @returns Decoded instruction (icode INVALID on failure)
+ */
+static inline y86_inst_t decode (const byte_t *memory, address_t pc,
+        y86_stat_t *stat)
+{
+    y86_inst_t inst;
+    byte_t opcode = memory[pc];
+    const y86_opdesc_t *desc = &opcode_table[opcode];
+
+    if (desc->len == 0 || pc > MEMSIZE - Y86_MAXLEN) {
+        return decode_slow(memory, pc, stat);
+    }
+
+    // the register byte and eight bytes at the valC offset are in bounds
+    // here, so read them unconditionally and mask off unused fields
+    unsigned reg_byte = desc->regs ? memory[pc + 1] : 0xFF;
+    int64_t valC;
+    memcpy(&valC, &memory[pc + desc->valc], 8);
+
+    inst.icode = opcode >> 4;
+    inst.ifun.b = opcode & 0x0F;
+    inst.ra = reg_byte >> 4;
+    inst.rb = reg_byte & 0x0F;
+    inst.valC.v = desc->valc ? valC : 0;
+    inst.valP = pc + ((ICODE_LENGTHS >> (4 * inst.icode)) & 0xF);
+
+    *stat = AOK;
+    if (!((desc->ra_ok >> inst.ra) & (desc->rb_ok >> inst.rb) & 1)) {
+        *stat = INS;
+        inst.icode = INVALID;
+        inst.valP = pc;
+    }
+    return inst;
+}
+
+/**
+ * @brief Encode an instruction back into machine code (the inverse of
+ * decode())
+ *
+ * @param inst Pointer to a valid instruction
+ * @param out Destination with room for at least Y86_MAXLEN bytes
+ * @returns Length of the encoded instruction in bytes
+ */
+size_t encode_inst (const y86_inst_t *inst, byte_t *out);
+
+/**
+ * @brief Convert a decoded instruction to the compact form
+ *
+ * @param inst Pointer to a valid decoded instruction
+ * @param pc Address the instruction was decoded from
+ * @returns Compact form of the instruction
+ */
+y86_pinst_t pack_inst (const y86_inst_t *inst, address_t pc);
+
+/**
+ * @brief Convert a compact instruction back to the full form (e.g., for the
+ * printing functions)
+ *
+ * @param pinst Pointer to a compact instruction
+ * @param pc Address of the instruction
+ * @returns Full decoded instruction
+ */
+y86_inst_t unpack_inst (const y86_pinst_t *pinst, address_t pc);
+
 /**
  * @brief Load a Y86 instruction from memory
  *
@@ -20,6 +129,35 @@
  */
 y86_inst_t fetch (y86_t *cpu, byte_t *memory);
 
+/* Longest disassembled instruction text, including the terminating NUL */
+#define Y86_TEXTLEN 64
+
+/**
+ * @brief Format the disassembly of a Y86 instruction (as printed by
+ * disassemble()) into a string
+ *
+ * @param out Destination with room for at least Y86_TEXTLEN characters
+ * @param inst Pointer to Y86 instruction structure to be formatted
+ * @returns Length of the text, not counting the terminating NUL
+ */
+size_t format_inst (char *out, const y86_inst_t *inst);
+
+/* Longest line produced by format_code_line() */
+#define Y86_LINELEN (40 + Y86_TEXTLEN)
+
+/**
+ * @brief Format one line of a code listing, as printed by disassemble_code():
+ * the address, the instruction bytes and the disassembly
+ *
+ * @param out Destination with room for at least Y86_LINELEN characters
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param addr Address of the instruction
+ * @param inst Pointer to the valid instruction decoded at addr
+ * @returns Length of the line, including the newline (not NUL-terminated)
+ */
+size_t format_code_line (char *out, const byte_t *memory, address_t addr,
+        const y86_inst_t *inst);
+
 /**
  * @brief Print the disassembly of a Y86 instruction to standard out
  *
@@ -5,10 +5,22 @@
  */
 
 #include "p4-interp.h"
+#include "p2-load.h"
 #include <inttypes.h>
 
 bool Cond(flag_t zf, flag_t sf, flag_t of, int ifun);
 
+/* Note a quad store at addr (in bounds) in the dirty-page bitmap, if any */
+static inline void mark_dirty (uint64_t *dirty, address_t addr)
+{
+    if (dirty == NULL) {
+        return;
+    }
+    address_t first = addr >> PAGEBITS, last = (addr + 7) >> PAGEBITS;
+    dirty[first / 64] |= 1ULL << (first % 64);
+    dirty[last / 64] |= 1ULL << (last % 64);
+}
+
 /**********************************************************************
  *                         REQUIRED FUNCTIONS
  *********************************************************************/
@@ -189,6 +201,12 @@ y86_reg_t decode_execute (y86_t *cpu, y86_inst_t *inst, bool *cnd, y86_reg_t *va
 
 void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
         bool cnd, y86_reg_t valA, y86_reg_t valE)
+{
+    memory_wb_pc_dirty(cpu, inst, memory, cnd, valA, valE, NULL);
+}
+
+void memory_wb_pc_dirty (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
+        bool cnd, y86_reg_t valA, y86_reg_t valE, uint64_t *dirty)
 {
     // Check for NULL pointers
     if (!cpu || !inst || !memory) {
@@ -256,6 +274,7 @@ void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
                 for (int i = 0; i < 8; i++) {
                     memory[valE + i] = (valA >> (8 * i)) & 0xFF;
                 }
+                mark_dirty(dirty, valE);
             }
             // PC update
             cpu->pc = inst->valP;
@@ -316,6 +335,7 @@ void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
                     for (int i = 0; i < 8; i++) {
                         memory[valE + i] = (inst->valP >> (8 * i)) & 0xFF;
                     }
+                    mark_dirty(dirty, valE);
                     // Write Back stage
                     cpu->reg[RSP] = valE; // R[%rsp] ← valE
                 }
@@ -364,6 +384,7 @@ void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
                 for (int i = 0; i < 8; i++) {
                     memory[valE + i] = (valA >> (8 * i)) & 0xFF;
                 }
+                mark_dirty(dirty, valE);
                 // Write Back stage
                 cpu->reg[RSP] = valE; // R[%rsp] ← valE
             }
@@ -420,54 +441,110 @@ void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
  *                         OPTIONAL FUNCTIONS
  *********************************************************************/
 
-void dump_cpu_state (y86_t *cpu)
+static inline char *put_text (char *p, const char *s)
 {
-    if (!cpu) {
-        printf("CPU state is NULL\n");
-        return;
+    size_t n = strlen(s);
+    memcpy(p, s, n);
+    return p + n;
+}
+
+/* Sixteen lowercase hex digits, as printf("%016" PRIx64) */
+static inline char *put_hex64 (char *p, uint64_t v)
+{
+    hex4(p, v >> 48);
+    hex4(p + 4, v >> 32);
+    hex4(p + 8, v >> 16);
+    hex4(p + 12, v);
+    return p + 16;
+}
+
+void dirty_clear (uint64_t *dirty)
+{
+    memset(dirty, 0, PAGEWORDS * sizeof(uint64_t));
+}
+
+void dirty_restore (byte_t *memory, const byte_t *pristine, uint64_t *dirty)
+{
+    for (int w = 0; w < PAGEWORDS; w++) {
+        uint64_t bits = dirty[w];
+        while (bits != 0) {
+            address_t at = (address_t)(w * 64 + __builtin_ctzll(bits)) << PAGEBITS;
+            memcpy(&memory[at], &pristine[at], 1 << PAGEBITS);
+            bits &= bits - 1;
+        }
+        dirty[w] = 0;
     }
+}
 
-    // Map status codes to strings
-    const char *stat_str;
-    switch (cpu->stat) {
-        case AOK:
-            stat_str = "AOK";
-            break;
-        case HLT:
-            stat_str = "HLT";
-            break;
-        case ADR:
-            stat_str = "ADR";
-            break;
-        case INS:
-            stat_str = "INS";
-            break;
-        default:
-            stat_str = "UNK"; // Unknown status
-            break;
+void dump_dirty_memory (byte_t *memory, const uint64_t *dirty)
+{
+    // one dump per run of consecutive dirty pages
+    int page = 0;
+    while (page < NUMPAGES) {
+        if (!((dirty[page / 64] >> (page % 64)) & 1)) {
+            page++;
+            continue;
+        }
+        int end = page;
+        while (end < NUMPAGES && ((dirty[end / 64] >> (end % 64)) & 1)) {
+            end++;
+        }
+        dump_memory(memory, page << PAGEBITS, end << PAGEBITS);
+        page = end;
     }
+}
+
+void format_cpu_state (outbuf_t *ob, const y86_t *cpu)
+{
+    const char *stat_str = y86_stat_name(cpu->stat);
 
     // Print CPU state
-    printf("    PC: %016" PRIx64 "   flags: Z%d S%d O%d     %s\n",
-           cpu->pc, cpu->zf, cpu->sf, cpu->of, stat_str);
-
-    // Print registers in the expected format
-    printf("  %%rax: %016" PRIx64 "    %%rcx: %016" PRIx64 "\n",
-           cpu->reg[RAX], cpu->reg[RCX]);
-    printf("  %%rdx: %016" PRIx64 "    %%rbx: %016" PRIx64 "\n",
-           cpu->reg[RDX], cpu->reg[RBX]);
-    printf("  %%rsp: %016" PRIx64 "    %%rbp: %016" PRIx64 "\n",
-           cpu->reg[RSP], cpu->reg[RBP]);
-    printf("  %%rsi: %016" PRIx64 "    %%rdi: %016" PRIx64 "\n",
-           cpu->reg[RSI], cpu->reg[RDI]);
-    printf("   %%r8: %016" PRIx64 "     %%r9: %016" PRIx64 "\n",
-           cpu->reg[R8], cpu->reg[R9]);
-    printf("  %%r10: %016" PRIx64 "    %%r11: %016" PRIx64 "\n",
-           cpu->reg[R10], cpu->reg[R11]);
-    printf("  %%r12: %016" PRIx64 "    %%r13: %016" PRIx64 "\n",
-           cpu->reg[R12], cpu->reg[R13]);
-    printf("  %%r14: %016" PRIx64 "\n",
-           cpu->reg[R14]);
+    char *out = ob_reserve(ob, OUTBUF_SLACK);
+    char *p = out;
+    p = put_text(p, "    PC: ");
+    p = put_hex64(p, cpu->pc);
+    p = put_text(p, "   flags: Z");
+    *p++ = '0' + cpu->zf;
+    p = put_text(p, " S");
+    *p++ = '0' + cpu->sf;
+    p = put_text(p, " O");
+    *p++ = '0' + cpu->of;
+    p = put_text(p, "     ");
+    p = put_text(p, stat_str);
+    *p++ = '\n';
+    ob_commit(ob, p - out);
+
+    // Print registers in the expected format, two per row
+    static const char *const labels[NUMREGS] = {
+        "  %rax: ", "    %rcx: ", "  %rdx: ", "    %rbx: ",
+        "  %rsp: ", "    %rbp: ", "  %rsi: ", "    %rdi: ",
+        "   %r8: ", "     %r9: ", "  %r10: ", "    %r11: ",
+        "  %r12: ", "    %r13: ", "  %r14: "
+    };
+    for (int r = 0; r < NUMREGS; r += 2) {
+        out = ob_reserve(ob, OUTBUF_SLACK);
+        p = put_text(out, labels[r]);
+        p = put_hex64(p, cpu->reg[r]);
+        if (r + 1 < NUMREGS) {
+            p = put_text(p, labels[r + 1]);
+            p = put_hex64(p, cpu->reg[r + 1]);
+        }
+        *p++ = '\n';
+        ob_commit(ob, p - out);
+    }
+}
+
+void dump_cpu_state (y86_t *cpu)
+{
+    static outbuf_t out;
+
+    if (!cpu) {
+        printf("CPU state is NULL\n");
+        return;
+    }
+    ob_init(&out, stdout);
+    format_cpu_state(&out, cpu);
+    ob_flush(&out);
 }
 
 
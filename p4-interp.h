@@ -10,6 +10,7 @@
 #include <unistd.h>
 
 #include "elf.h"
+#include "outbuf.h"
 #include "y86.h"
 
 /**
@@ -37,6 +38,56 @@ y86_reg_t decode_execute (y86_t *cpu, y86_inst_t *inst, bool *cnd, y86_reg_t *va
 void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
         bool cnd, y86_reg_t valA, y86_reg_t valE);
 
+/**
+ * @brief memory_wb_pc(), also noting the pages it stores to
+ *
+ * @param cpu Y86 CPU structure
+ * @param inst Y86 instruction structure for currently-executing instruction
+ * @param memory Pointer to beginning of the Y86 address space
+ * @param cnd Flag that indicates whether a conditional jumps or move should happen
+ * @param valA Register with valA from earlier stages
+ * @param valE Register with valE from earlier stages
+ * @param dirty Dirty-page bitmap of this address space (PAGEWORDS words),
+ * or NULL to not track stores
+ */
+void memory_wb_pc_dirty (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
+        bool cnd, y86_reg_t valA, y86_reg_t valE, uint64_t *dirty);
+
+/*
+ * A dirty-page bitmap has a bit for each page (of 1 << PAGEBITS bytes) that
+ * memory_wb_pc_dirty() has stored to since the last dirty_clear() or
+ * dirty_restore(). It belongs to one address space and is kept by whoever
+ * runs the stages on it. Stores set a bit, so tracking costs next to
+ * nothing, and resetting or dumping memory afterwards only has to visit
+ * what the program wrote.
+ */
+
+/**
+ * @brief Mark every page clean (e.g., after loading a program)
+ *
+ * @param dirty Dirty-page bitmap
+ */
+void dirty_clear (uint64_t *dirty);
+
+/**
+ * @brief Copy the dirty pages back from the image a run started from, and
+ * mark every page clean; memory then matches the image again
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param pristine Copy of the address space before the run
+ * @param dirty Dirty-page bitmap of memory
+ */
+void dirty_restore (byte_t *memory, const byte_t *pristine, uint64_t *dirty);
+
+/**
+ * @brief Print the dirty pages as dump_memory() does, one dump per run of
+ * consecutive dirty pages
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @param dirty Dirty-page bitmap of memory
+ */
+void dump_dirty_memory (byte_t *memory, const uint64_t *dirty);
+
 /**
  * @brief Print info about a Y86 CPU to standard out
  *
@@ -44,4 +95,12 @@ void memory_wb_pc (y86_t *cpu, y86_inst_t *inst, byte_t *memory,
  */
 void dump_cpu_state (y86_t *cpu);
 
+/**
+ * @brief Format info about a Y86 CPU as dump_cpu_state() prints it
+ *
+ * @param ob Output buffer to append to
+ * @param cpu Pointer to Y86 CPU structure to format
+ */
+void format_cpu_state (outbuf_t *ob, const y86_t *cpu);
+
 #endif
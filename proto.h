@@ -0,0 +1,95 @@
+#ifndef __CS261_PROTO__
+#define __CS261_PROTO__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "y86.h"
+
+/*
+ * Protocol between y86-server and its clients over a Unix domain socket.
+ * Both ends are on the same host, so the fixed-size headers are sent as
+ * they are in memory. Each request is a proto_request_t followed by
+ * image_len bytes of Mini-ELF file and input_len bytes of guest input; each
+ * reply is a proto_reply_t followed by output_len bytes of guest output
+ * and, if asked for, MEMSIZE bytes of final memory. A connection may carry
+ * any number of requests, one at a time.
+ */
+
+#define PROTO_SOCKET   "/tmp/y86.sock"
+#define PROTO_MAGIC    0x53363859u      // "Y86S"
+#define PROTO_MAXIMAGE (1u << 20)
+#define PROTO_MAXINPUT (16u << 20)
+
+/* Request flags */
+#define PROTO_CACHED 1          // run the cached image with this digest
+#define PROTO_MEMORY 2          // send the final memory back
+
+/* Reply results */
+typedef enum {
+    PROTO_OK = 0,               // ran (see stat)
+    PROTO_UNKNOWN,              // PROTO_CACHED digest not in the cache
+    PROTO_BAD_IMAGE,            // image failed to load
+    PROTO_BAD_REQUEST,          // malformed request
+    PROTO_BUSY                  // out of memory
+} proto_result_t;
+
+/* SHA-256 digest of a Mini-ELF file, naming it in the server's cache */
+#define PROTO_DIGEST 32
+typedef struct proto_digest {
+    byte_t b[PROTO_DIGEST];
+} proto_digest_t;
+
+typedef struct proto_request {
+    uint32_t magic;
+    uint32_t flags;
+    proto_digest_t digest;      // image digest (with PROTO_CACHED)
+    uint64_t limit;             // instruction budget (0: none)
+    uint32_t timeout_ms;        // time limit (0: none)
+    uint32_t image_len;         // 0 with PROTO_CACHED
+    uint32_t input_len;
+    uint32_t reserved;
+} proto_request_t;
+
+typedef struct proto_reply {
+    uint32_t magic;
+    uint32_t result;            // proto_result_t
+    proto_digest_t digest;      // digest of the image that ran
+    uint64_t count;             // instructions executed
+    y86_t cpu;                  // final state
+    uint32_t output_len;
+    uint32_t memory_len;        // MEMSIZE with PROTO_MEMORY, else 0
+} proto_reply_t;
+
+/**
+ * @brief Digest a Mini-ELF file (SHA-256). A client that sends only the
+ * digest gets the image with that digest, so it has to be collision-proof.
+ *
+ * @param data File contents
+ * @param len Number of bytes
+ * @returns Digest identifying the image in the server's cache
+ */
+proto_digest_t proto_digest (const void *data, size_t len);
+
+/**
+ * @brief Read exactly len bytes from a socket
+ *
+ * @param fd Socket
+ * @param buf Destination
+ * @param len Number of bytes
+ * @returns False on error or if the peer closed the connection first
+ */
+bool proto_recv (int fd, void *buf, size_t len);
+
+/**
+ * @brief Write exactly len bytes to a socket
+ *
+ * @param fd Socket
+ * @param buf Source
+ * @param len Number of bytes
+ * @returns False on error
+ */
+bool proto_send (int fd, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * CS 261: Structured run results
+ *
+ * Name: Aiden Smith
+ */
+
+#include <inttypes.h>
+
+#include "report.h"
+
+static const char *reg_names[NUMREGS] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14"
+};
+
+bool report_parse (const char *name, report_fmt_t *fmt)
+{
+    if (strcmp(name, "json") == 0) {
+        *fmt = REPORT_JSON;
+    } else if (strcmp(name, "csv") == 0) {
+        *fmt = REPORT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint64_t report_digest (const byte_t *memory)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < MEMSIZE; i++) {
+        hash = (hash ^ memory[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Sixteen hex digits, with the JSON quotes if asked for */
+static void put_hex64 (outbuf_t *ob, uint64_t value, bool quoted)
+{
+    char *out = ob_reserve(ob, 18);
+    int n = 0;
+    if (quoted) {
+        out[n++] = '"';
+    }
+    hex4(out + n, value >> 48);
+    hex4(out + n + 4, value >> 32);
+    hex4(out + n + 8, value >> 16);
+    hex4(out + n + 12, value);
+    n += 16;
+    if (quoted) {
+        out[n++] = '"';
+    }
+    ob_commit(ob, n);
+}
+
+/* A file name as a JSON string */
+static void put_json_string (outbuf_t *ob, const char *s)
+{
+    ob_putc(ob, '"');
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            ob_putc(ob, '\\');
+            ob_putc(ob, c);
+        } else if (c < 0x20) {
+            ob_printf(ob, "\\u%04x", c);
+        } else {
+            ob_putc(ob, c);
+        }
+    }
+    ob_putc(ob, '"');
+}
+
+/* A file name as a CSV field, quoted only if it has to be */
+static void put_csv_string (outbuf_t *ob, const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        ob_puts(ob, s);
+        return;
+    }
+    ob_putc(ob, '"');
+    for (; *s != '\0'; s++) {
+        if (*s == '"') {
+            ob_putc(ob, '"');
+        }
+        ob_putc(ob, *s);
+    }
+    ob_putc(ob, '"');
+}
+
+void report_header (outbuf_t *ob, report_fmt_t fmt, bool digest)
+{
+    if (fmt != REPORT_CSV) {
+        return;
+    }
+    ob_puts(ob, "file,status,pc,zf,sf,of");
+    for (int r = 0; r < NUMREGS; r++) {
+        ob_putc(ob, ',');
+        ob_puts(ob, reg_names[r]);
+    }
+    ob_puts(ob, ",count,wall_ns");
+    ob_puts(ob, digest ? ",digest\n" : "\n");
+}
+
+static void write_json (outbuf_t *ob, const run_report_t *rep)
+{
+    const y86_t *cpu = &rep->cpu;
+
+    ob_puts(ob, "{\"file\":");
+    put_json_string(ob, rep->file);
+    if (!rep->loaded) {
+        ob_puts(ob, ",\"status\":\"ERR\"}\n");
+        return;
+    }
+    ob_printf(ob, ",\"status\":\"%s\",\"pc\":",
+              y86_stat_name(cpu->stat));
+    put_hex64(ob, cpu->pc, true);
+    ob_printf(ob, ",\"zf\":%d,\"sf\":%d,\"of\":%d,\"regs\":{",
+              cpu->zf, cpu->sf, cpu->of);
+    for (int r = 0; r < NUMREGS; r++) {
+        ob_printf(ob, "%s\"%s\":", r > 0 ? "," : "", reg_names[r]);
+        put_hex64(ob, cpu->reg[r], true);
+    }
+    ob_printf(ob, "},\"count\":%" PRIu64 ",\"wall_ns\":%" PRIu64,
+              rep->count, rep->wall_ns);
+    if (rep->has_digest) {
+        ob_puts(ob, ",\"digest\":");
+        put_hex64(ob, rep->digest, true);
+    }
+    ob_puts(ob, "}\n");
+}
+
+static void write_csv (outbuf_t *ob, const run_report_t *rep)
+{
+    const y86_t *cpu = &rep->cpu;
+
+    put_csv_string(ob, rep->file);
+    if (!rep->loaded) {
+        // keep the column count of the header
+        ob_puts(ob, ",ERR,,,,");
+        for (int r = 0; r < NUMREGS; r++) {
+            ob_putc(ob, ',');
+        }
+        ob_puts(ob, rep->has_digest ? ",,,\n" : ",,\n");
+        return;
+    }
+    ob_printf(ob, ",%s,", y86_stat_name(cpu->stat));
+    put_hex64(ob, cpu->pc, false);
+    ob_printf(ob, ",%d,%d,%d", cpu->zf, cpu->sf, cpu->of);
+    for (int r = 0; r < NUMREGS; r++) {
+        ob_putc(ob, ',');
+        put_hex64(ob, cpu->reg[r], false);
+    }
+    ob_printf(ob, ",%" PRIu64 ",%" PRIu64, rep->count, rep->wall_ns);
+    if (rep->has_digest) {
+        ob_putc(ob, ',');
+        put_hex64(ob, rep->digest, false);
+    }
+    ob_putc(ob, '\n');
+}
+
+void report_write (outbuf_t *ob, report_fmt_t fmt, const run_report_t *rep)
+{
+    if (fmt == REPORT_JSON) {
+        write_json(ob, rep);
+    } else if (fmt == REPORT_CSV) {
+        write_csv(ob, rep);
+    }
+}
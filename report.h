@@ -0,0 +1,66 @@
+#ifndef __CS261_REPORT__
+#define __CS261_REPORT__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+#include "y86.h"
+
+/* Run result formats */
+typedef enum {
+    REPORT_TEXT = 0,            // dump_cpu_state() and the execution count
+    REPORT_JSON,                // one JSON object per line (JSON Lines)
+    REPORT_CSV                  // one row per run, after a header row
+} report_fmt_t;
+
+/* Result of running one file */
+typedef struct run_report {
+    const char *file;           // name of the Mini-ELF file
+    bool loaded;                // false: the file failed to load
+    y86_t cpu;                  // final state
+    uint64_t count;             // instructions executed
+    uint64_t wall_ns;           // host time spent running
+    bool has_digest;            // digest is valid (CSV: digest column present)
+    uint64_t digest;            // report_digest() of the final memory
+} run_report_t;
+
+/**
+ * @brief Parse a format name ("json" or "csv")
+ *
+ * @param name Format name from the command line
+ * @param fmt Set to the format
+ * @returns False if the name is not a structured format
+ */
+bool report_parse (const char *name, report_fmt_t *fmt);
+
+/**
+ * @brief Hash the whole address space (64-bit FNV-1a, as proto_hash())
+ *
+ * @param memory Pointer to the beginning of the Y86 address space
+ * @returns Digest of the MEMSIZE bytes of memory
+ */
+uint64_t report_digest (const byte_t *memory);
+
+/**
+ * @brief Write the header row for a format (CSV only; nothing for JSON)
+ *
+ * @param ob Output buffer
+ * @param fmt Format
+ * @param digest Include the digest column
+ */
+void report_header (outbuf_t *ob, report_fmt_t fmt, bool digest);
+
+/**
+ * @brief Write one result as a JSON line or CSV row. Registers, the PC and
+ * the digest are written as fixed-width hex strings, since JSON numbers
+ * cannot hold every 64-bit value; a file that failed to load has status
+ * "ERR" and no other fields.
+ *
+ * @param ob Output buffer
+ * @param fmt Format
+ * @param rep Result to write
+ */
+void report_write (outbuf_t *ob, report_fmt_t fmt, const run_report_t *rep);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * CS 261: Sampling profiler
+ *
+ * Name: Aiden Smith
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sample.h"
+
+volatile sig_atomic_t sample_due;
+
+static void on_prof (int sig)
+{
+    (void)sig;
+    sample_due = 1;
+}
+
+void sample_init (y86_sampler_t *s, address_t entry)
+{
+    memset(s, 0, sizeof(*s));
+    s->entry = entry;
+    sample_due = 0;
+}
+
+bool sample_start (int hz)
+{
+    struct sigaction sa = { .sa_handler = on_prof, .sa_flags = SA_RESTART };
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) < 0) {
+        return false;
+    }
+    struct itimerval it = { 0 };
+    it.it_interval.tv_usec = 1000000 / hz;
+    it.it_value = it.it_interval;
+    return setitimer(ITIMER_PROF, &it, NULL) == 0;
+}
+
+void sample_stop (void)
+{
+    struct itimerval it = { 0 };
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+/**********************************************************************
+ *                             RECORDING
+ *********************************************************************/
+
+static inline uint32_t hash_stack (const y86_sample_t *key)
+{
+    uint32_t h = 2166136261u ^ key->nframes ^ (key->truncated << 8);
+    for (int i = 0; i < key->nframes; i++) {
+        h = (h ^ key->frames[i]) * 16777619u;
+    }
+    return h;
+}
+
+static inline bool same_stack (const y86_sample_t *a, const y86_sample_t *b)
+{
+    return a->nframes == b->nframes && a->truncated == b->truncated &&
+           memcmp(a->frames, b->frames, a->nframes * sizeof(uint16_t)) == 0;
+}
+
+/* Count one sample in the per-block and per-stack totals */
+static void fold (y86_sampler_t *s, const y86_sample_t *smp)
+{
+    s->total++;
+    s->blocks[smp->block]++;
+
+    uint32_t i = hash_stack(smp) & (SAMPLE_STACKS - 1);
+    while (s->stacks[i].count != 0 && !same_stack(&s->stacks[i].key, smp)) {
+        i = (i + 1) & (SAMPLE_STACKS - 1);
+    }
+    if (s->stacks[i].count == 0) {
+        if (s->nstacks == SAMPLE_STACKS - 1) {
+            s->lost++;          // keep one slot free so probes end
+            return;
+        }
+        s->stacks[i].key = *smp;
+        s->nstacks++;
+    }
+    s->stacks[i].count++;
+}
+
+void sample_record (y86_sampler_t *s, address_t block)
+{
+    sample_due = 0;
+    if (s->nring == SAMPLE_RING) {
+        sample_flush(s);
+    }
+
+    // the innermost SAMPLE_DEPTH frames, outermost first, counting the
+    // entry point as the frame below the first call
+    y86_sample_t *smp = &s->ring[s->nring++];
+    uint32_t frames = s->depth + 1;
+    uint32_t n = frames < SAMPLE_DEPTH ? frames : SAMPLE_DEPTH;
+    smp->block = block;
+    smp->nframes = n;
+    smp->truncated = frames > SAMPLE_DEPTH;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t level = frames - n + i;    // 0 is the entry point
+        smp->frames[i] = level == 0 ? s->entry
+                                    : s->calls[(level - 1) % SAMPLE_DEPTH];
+    }
+}
+
+void sample_flush (y86_sampler_t *s)
+{
+    for (uint32_t i = 0; i < s->nring; i++) {
+        fold(s, &s->ring[i]);
+    }
+    s->nring = 0;
+}
+
+/**********************************************************************
+ *                              REPORTS
+ *********************************************************************/
+
+void sample_write_folded (y86_sampler_t *s, outbuf_t *ob, const char *root,
+        const char *const *names)
+{
+    for (uint32_t i = 0; i < SAMPLE_STACKS; i++) {
+        const sample_stack_t *st = &s->stacks[i];
+        if (st->count == 0) {
+            continue;
+        }
+
+        // build the line first so that it reaches the stream in one piece
+        char line[OUTBUF_SLACK * 4];
+        size_t n = snprintf(line, OUTBUF_SLACK, "%.180s%s", root,
+                            st->key.truncated ? ";..." : "");
+        for (int f = 0; f < st->key.nframes; f++) {
+            uint16_t addr = st->key.frames[f];
+            if (names != NULL && names[addr] != NULL) {
+                n += snprintf(line + n, OUTBUF_SLACK / 2, ";%.60s",
+                              names[addr]);
+            } else {
+                n += snprintf(line + n, OUTBUF_SLACK / 2, ";0x%03x", addr);
+            }
+        }
+        n += snprintf(line + n, OUTBUF_SLACK / 2, " %" PRIu64 "\n",
+                      st->count);
+        ob_write(ob, line, n);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef __CS261_SAMPLE__
+#define __CS261_SAMPLE__
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "outbuf.h"
+#include "y86.h"
+
+/*
+ * Sampling profiler. A SIGPROF interval timer sets sample_due; the run
+ * loop (EXEC_SAMPLE) looks at it only when control leaves a block, and then
+ * records the start of that block and the innermost calls of a shadow call
+ * stack into a ring. Full rings are folded into per-block counts and a
+ * table of distinct stacks, which are reported when the run ends.
+ */
+
+#define SAMPLE_HZ     1000      // default samples per second of CPU time
+#define SAMPLE_DEPTH  8         // calls kept per sample (a power of two)
+#define SAMPLE_RING   4096      // samples held before they are folded
+#define SAMPLE_STACKS 4096      // distinct stacks kept (a power of two)
+
+/* One sample: a block and the calls that led to it, outermost first */
+typedef struct y86_sample {
+    uint16_t block;
+    uint8_t nframes;
+    bool truncated;             // outer calls were dropped
+    uint16_t frames[SAMPLE_DEPTH];
+} y86_sample_t;
+
+/* Distinct stack and its sample count */
+typedef struct sample_stack {
+    y86_sample_t key;           // block is ignored
+    uint64_t count;
+} sample_stack_t;
+
+typedef struct y86_sampler {
+    // shadow call stack, kept by the run loop
+    address_t entry;                    // outermost frame
+    uint32_t depth;                     // calls in progress
+    uint16_t calls[SAMPLE_DEPTH];       // targets, indexed by depth - 1
+
+    y86_sample_t ring[SAMPLE_RING];
+    uint32_t nring;
+
+    uint64_t total;                     // samples taken
+    uint64_t blocks[MEMSIZE];           // samples per block start
+    sample_stack_t stacks[SAMPLE_STACKS];
+    uint32_t nstacks;
+    uint64_t lost;                      // samples with no room in stacks
+} y86_sampler_t;
+
+/* Set by the timer signal, cleared when a sample is recorded */
+extern volatile sig_atomic_t sample_due;
+
+/**
+ * @brief Reset a sampler for a run starting at entry
+ *
+ * @param s Sampler
+ * @param entry Entry point, used as the outermost frame
+ */
+void sample_init (y86_sampler_t *s, address_t entry);
+
+/**
+ * @brief Start the SIGPROF interval timer
+ *
+ * @param hz Samples per second of CPU time
+ * @returns False if the timer could not be set
+ */
+bool sample_start (int hz);
+
+/**
+ * @brief Stop the interval timer
+ */
+void sample_stop (void);
+
+/**
+ * @brief Record a sample (called by the run loop when sample_due is set)
+ *
+ * @param s Sampler
+ * @param block Start address of the block being left
+ */
+void sample_record (y86_sampler_t *s, address_t block);
+
+/**
+ * @brief Fold the samples still in the ring into the totals
+ *
+ * @param s Sampler
+ */
+void sample_flush (y86_sampler_t *s);
+
+/**
+ * @brief Write the samples as folded stacks ("root;f;g count" lines), for
+ * flame graph tools; calls to an address with a name show the name
+ *
+ * @param s Sampler, after sample_flush()
+ * @param ob Output buffer (each line is written whole)
+ * @param root Outermost frame name (the program file)
+ * @param names Symbol name for each address (MEMSIZE entries, NULL for
+ * none), or NULL
+ */
+void sample_write_folded (y86_sampler_t *s, outbuf_t *ob, const char *root,
+        const char *const *names);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * CS 261: Cooperative VM scheduler
+ *
+ * Name: Aiden Smith
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+
+/**********************************************************************
+ *                                VMS
+ *********************************************************************/
+
+/* IOTRAP handler: the VM's own I/O buffers */
+static bool vm_trap (void *ctx, y86_t *cpu, byte_t *memory, int trap)
+{
+    y86_vm_t *vm = ctx;
+    return io_trap(&vm->io, cpu, memory, trap) == IO_DONE;
+}
+
+y86_vm_t *vm_new (const byte_t *image, address_t entry)
+{
+    y86_vm_t *vm = calloc(1, sizeof(y86_vm_t));
+    if (vm == NULL) {
+        return NULL;
+    }
+    vm->eng = engine_new();
+    if (vm->eng == NULL) {
+        free(vm);
+        return NULL;
+    }
+    engine_set_trap(vm->eng, vm_trap, vm);
+    io_init(&vm->io, NULL, NULL);
+    io_init(&vm->pending, NULL, NULL);
+
+    memcpy(vm->memory, image, MEMSIZE);
+    vm->cpu.pc = entry;
+    vm->cpu.stat = AOK;
+    vm->state = VM_NEW;
+    return vm;
+}
+
+void vm_free (y86_vm_t *vm)
+{
+    if (vm != NULL) {
+        engine_free(vm->eng);
+        io_free(&vm->io);
+        io_free(&vm->pending);
+        free(vm);
+    }
+}
+
+/**********************************************************************
+ *                             RUN QUEUE
+ *********************************************************************/
+
+/* Queue a VM to run; called with the lock held */
+static void make_ready (y86_sched_t *s, y86_vm_t *vm)
+{
+    vm->state = VM_READY;
+    vm->next = NULL;
+    if (s->tail != NULL) {
+        s->tail->next = vm;
+    } else {
+        s->head = vm;
+    }
+    s->tail = vm;
+    pthread_cond_signal(&s->work);
+}
+
+static y86_vm_t *take_ready (y86_sched_t *s)
+{
+    y86_vm_t *vm = s->head;
+    s->head = vm->next;
+    if (s->head == NULL) {
+        s->tail = NULL;
+    }
+    vm->state = VM_RUNNING;
+    return vm;
+}
+
+/* Move input that arrived during the VM's turn into its buffers; returns
+   true if there was any */
+static bool take_pending (y86_vm_t *vm)
+{
+    y86_io_t *p = &vm->pending;
+    bool fresh = p->in_len > p->in_pos || p->in_eof;
+    if (fresh) {
+        io_input(&vm->io, p->in + p->in_pos, p->in_len - p->in_pos, p->in_eof);
+        io_reset(p);
+    }
+    return fresh;
+}
+
+/* Run one VM for a quantum; called without the lock */
+static bool run_turn (y86_sched_t *s, y86_vm_t *vm)
+{
+    uint64_t quantum = s->quantum;
+    if (vm->limit != 0 && vm->limit - vm->count < quantum) {
+        quantum = vm->limit - vm->count;
+    }
+    vm->count += engine_run(vm->eng, &vm->cpu, vm->memory, quantum);
+
+    if (vm->limit != 0 && vm->count >= vm->limit && vm->cpu.stat == AOK) {
+        vm->cpu.stat = TMO;
+    }
+    bool finished = vm->cpu.stat != AOK;
+    if (finished) {
+        io_flush(&vm->io);
+    }
+    return finished;
+}
+
+static void *worker (void *arg)
+{
+    y86_sched_t *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    while (true) {
+        while (s->head == NULL && !s->stopping) {
+            pthread_cond_wait(&s->work, &s->lock);
+        }
+        if (s->stopping) {
+            break;
+        }
+        y86_vm_t *vm = take_ready(s);
+        pthread_mutex_unlock(&s->lock);
+
+        bool finished = run_turn(s, vm);
+
+        pthread_mutex_lock(&s->lock);
+        s->switches++;
+        bool fresh = take_pending(vm);
+        if (finished) {
+            vm->state = VM_DONE;
+            pthread_mutex_unlock(&s->lock);
+            if (s->done != NULL) {
+                s->done(s, vm);
+            }
+            pthread_mutex_lock(&s->lock);
+            s->live--;
+            pthread_cond_broadcast(&s->idle);
+        } else if (vm->eng->blocked && !fresh) {
+            vm->state = VM_WAITING;     // parked: sched_input() requeues it
+            s->parks++;
+        } else {
+            make_ready(s, vm);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/**********************************************************************
+ *                             SCHEDULER
+ *********************************************************************/
+
+y86_sched_t *sched_new (int nthreads, uint64_t quantum)
+{
+    y86_sched_t *s = calloc(1, sizeof(y86_sched_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->threads = calloc(nthreads, sizeof(pthread_t));
+    if (s->threads == NULL) {
+        free(s);
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->idle, NULL);
+    s->quantum = quantum ? quantum : DEFAULT_QUANTUM;
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&s->threads[i], NULL, worker, s) != 0) {
+            break;
+        }
+        s->nthreads++;
+    }
+    if (s->nthreads == 0) {
+        sched_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void sched_free (y86_sched_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = 0; i < s->nthreads; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->idle);
+    free(s->threads);
+    free(s);
+}
+
+void sched_add (y86_sched_t *s, y86_vm_t *vm)
+{
+    pthread_mutex_lock(&s->lock);
+    s->live++;
+    make_ready(s, vm);
+    pthread_mutex_unlock(&s->lock);
+}
+
+bool sched_input (y86_sched_t *s, y86_vm_t *vm, const void *data,
+        size_t len, bool eof)
+{
+    bool ok;
+
+    pthread_mutex_lock(&s->lock);
+    if (vm->state == VM_RUNNING) {
+        // its worker owns vm->io until the turn ends
+        ok = io_input(&vm->pending, data, len, eof);
+    } else {
+        ok = io_input(&vm->io, data, len, eof);
+        if (vm->state == VM_WAITING) {
+            make_ready(s, vm);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+void sched_wait (y86_sched_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    while (s->live > 0) {
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,127 @@
+#ifndef __CS261_SCHED__
+#define __CS261_SCHED__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "io.h"
+#include "y86.h"
+
+/* Instructions a VM runs before the next one gets its turn */
+#define DEFAULT_QUANTUM 100000
+
+/* Where a VM is in its life */
+typedef enum {
+    VM_NEW,                     // not added to a scheduler yet
+    VM_READY,                   // in the run queue
+    VM_RUNNING,                 // on a worker thread
+    VM_WAITING,                 // parked until input arrives
+    VM_DONE                     // stopped (see cpu.stat)
+} y86_vm_state_t;
+
+/*
+ * Guest program instance: CPU state, memory, I/O buffers and its own
+ * instruction cache, so that switching VMs is only a change of pointer.
+ */
+typedef struct y86_vm {
+    y86_t cpu;
+    byte_t memory[MEMSIZE];
+    y86_io_t io;                // guest I/O (touched only while running)
+    y86_io_t pending;           // input that arrived while it was running
+    y86_engine_t *eng;
+    uint64_t count;             // instructions executed
+    uint64_t limit;             // instruction budget (0: none); the VM
+                                // stops with TMO when it is used up, or
+                                // when eng->deadline passes
+    y86_vm_state_t state;
+    struct y86_vm *next;        // run queue link
+    void *user;                 // owner's data
+} y86_vm_t;
+
+/*
+ * Cooperative scheduler: a few worker threads take turns running many VMs
+ * for a quantum each. A VM whose input trap blocks is parked, holding no
+ * thread, until sched_input() gives it more input.
+ */
+typedef struct y86_sched {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // run queue not empty, or stopping
+    pthread_cond_t idle;        // a VM finished
+    y86_vm_t *head, *tail;      // run queue
+    pthread_t *threads;
+    int nthreads;
+    uint64_t quantum;
+    int live;                   // VMs added and not done
+    bool stopping;
+    uint64_t switches;          // quanta run
+    uint64_t parks;             // times a VM was parked for input
+
+    /* Called (without the lock) when a VM stops; may be NULL */
+    void (*done) (struct y86_sched *sched, y86_vm_t *vm);
+} y86_sched_t;
+
+/**
+ * @brief Create a VM with a copy of a loaded program
+ *
+ * @param image Pointer to the loaded Y86 address space
+ * @param entry Address of the first instruction
+ * @returns Pointer to the VM, or NULL if it could not be allocated
+ */
+y86_vm_t *vm_new (const byte_t *image, address_t entry);
+
+/**
+ * @brief Release a VM that is not in a scheduler (or is done)
+ *
+ * @param vm VM to free (may be NULL)
+ */
+void vm_free (y86_vm_t *vm);
+
+/**
+ * @brief Start the worker threads
+ *
+ * @param nthreads Number of worker threads
+ * @param quantum Instructions per turn
+ * @returns Pointer to the scheduler, or NULL if it could not be started
+ */
+y86_sched_t *sched_new (int nthreads, uint64_t quantum);
+
+/**
+ * @brief Stop the worker threads (after their current turns) and release
+ * the scheduler; VMs still in it are left as they are
+ *
+ * @param sched Scheduler to free
+ */
+void sched_free (y86_sched_t *sched);
+
+/**
+ * @brief Make a new VM runnable
+ *
+ * @param sched Scheduler
+ * @param vm VM in state VM_NEW
+ */
+void sched_add (y86_sched_t *sched, y86_vm_t *vm);
+
+/**
+ * @brief Give a VM input, waking it if it is parked waiting for input
+ *
+ * @param sched Scheduler
+ * @param vm VM added to the scheduler
+ * @param data Input bytes
+ * @param len Number of bytes
+ * @param eof True if no more input will follow
+ * @returns False if the input could not be buffered
+ */
+bool sched_input (y86_sched_t *sched, y86_vm_t *vm, const void *data,
+        size_t len, bool eof);
+
+/**
+ * @brief Wait until every VM added has stopped (parked VMs count as live,
+ * so all of them must eventually get their input or end of input)
+ *
+ * @param sched Scheduler
+ */
+void sched_wait (y86_sched_t *sched);
+
+#endif
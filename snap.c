@@ -0,0 +1,157 @@
+/*
+ * CS 261: Shared-memory state snapshots
+ *
+ * Name: Aiden Smith
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snap.h"
+
+y86_snap_t *snap_create (const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(y86_snap_t)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    y86_snap_t *snap = mmap(NULL, sizeof(y86_snap_t), PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+    close(fd);
+    if (snap == MAP_FAILED) {
+        return NULL;
+    }
+    snap->magic = SNAP_MAGIC;
+    snap->size = sizeof(y86_snap_t);
+    return snap;
+}
+
+y86_snap_t *snap_open (const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    y86_snap_t *snap = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == sizeof(y86_snap_t)) {
+        snap = mmap(NULL, sizeof(y86_snap_t), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (snap == MAP_FAILED) {
+        return NULL;
+    }
+    if (snap->magic != SNAP_MAGIC || snap->size != sizeof(y86_snap_t)) {
+        snap_close(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+void snap_close (y86_snap_t *snap)
+{
+    munmap(snap, sizeof(y86_snap_t));
+}
+
+void snap_remove (const char *name)
+{
+    shm_unlink(name);
+}
+
+/**********************************************************************
+ *                              WRITER
+ *********************************************************************/
+
+static inline void write_begin (y86_snap_t *snap)
+{
+    uint64_t seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void write_end (y86_snap_t *snap)
+{
+    uint64_t seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_release);
+}
+
+void snap_begin (y86_snap_t *snap, const char *file, const y86_t *cpu)
+{
+    write_begin(snap);
+    snap->cpu = *cpu;
+    snap->count = 0;
+    snap->time_ns = y86_clock_ns();
+    snap->nhot = 0;
+    strncpy(snap->file, file, SNAP_FILE - 1);
+    snap->file[SNAP_FILE - 1] = '\0';
+    write_end(snap);
+}
+
+/* Keep the SNAP_TOP most executed addresses, hottest first */
+static uint32_t find_hot (const uint64_t *profile, snap_hot_t *hot)
+{
+    uint32_t n = 0;
+    for (address_t pc = 0; pc < MEMSIZE; pc++) {
+        uint64_t c = profile[pc];
+        if (c == 0 || (n == SNAP_TOP && c <= hot[n - 1].count)) {
+            continue;
+        }
+        uint32_t i = n < SNAP_TOP ? n++ : n - 1;
+        while (i > 0 && hot[i - 1].count < c) {
+            hot[i] = hot[i - 1];
+            i--;
+        }
+        hot[i].pc = pc;
+        hot[i].count = c;
+    }
+    return n;
+}
+
+void snap_publish (y86_snap_t *snap, const y86_t *cpu, uint64_t count,
+        const uint64_t *profile)
+{
+    // rank the addresses before taking the lock, to keep the window short
+    snap_hot_t hot[SNAP_TOP];
+    uint32_t nhot = profile ? find_hot(profile, hot) : 0;
+
+    write_begin(snap);
+    snap->cpu = *cpu;
+    snap->count = count;
+    snap->time_ns = y86_clock_ns();
+    snap->nhot = nhot;
+    memcpy(snap->hot, hot, nhot * sizeof(snap_hot_t));
+    write_end(snap);
+}
+
+/**********************************************************************
+ *                              READER
+ *********************************************************************/
+
+void snap_read (const y86_snap_t *snap, y86_snap_t *copy)
+{
+    uint64_t before, after;
+    do {
+        before = atomic_load_explicit((_Atomic uint64_t *)&snap->seq,
+                                      memory_order_acquire);
+        if (before & 1) {
+            continue;           // writer in the middle of an update
+        }
+        memcpy((char *)copy + offsetof(y86_snap_t, cpu),
+               (const char *)snap + offsetof(y86_snap_t, cpu),
+               sizeof(y86_snap_t) - offsetof(y86_snap_t, cpu));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit((_Atomic uint64_t *)&snap->seq,
+                                     memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    copy->magic = snap->magic;
+    copy->size = snap->size;
+    atomic_init(&copy->seq, before);
+}
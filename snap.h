@@ -0,0 +1,108 @@
+#ifndef __CS261_SNAP__
+#define __CS261_SNAP__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "y86.h"
+
+/*
+ * Live snapshots of a running program in a POSIX shared-memory object, for
+ * y86-top to watch without stopping it. The run loop is the only writer and
+ * never waits: it bumps seq to an odd value, copies the state in and bumps
+ * seq again (a seqlock). A reader copies the state out and keeps it only if
+ * seq was even and unchanged across the copy, so a torn read is retried
+ * rather than shown. The writer owns the object: y86 creates it for -v and
+ * removes it when its last run has ended, so a reader has to attach while
+ * the run is going (its mapping stays valid after the removal).
+ */
+
+#define SNAP_MAGIC    0x50414e53u       // "SNAP"
+#define SNAP_TOP      8                 // hottest addresses published
+#define SNAP_FILE     128               // longest file name kept
+#define SNAP_INTERVAL 1000000           // default instructions between updates
+
+/* One hot address (with EXEC_PROFILE) */
+typedef struct snap_hot {
+    uint64_t pc;
+    uint64_t count;
+} snap_hot_t;
+
+/* Layout of the shared object */
+typedef struct y86_snap {
+    uint32_t magic;
+    uint32_t size;                      // sizeof(y86_snap_t)
+    _Atomic uint64_t seq;               // odd while an update is in progress
+
+    // written under seq
+    y86_t cpu;
+    uint64_t count;                     // instructions executed
+    uint64_t time_ns;                   // y86_clock_ns() of the update
+    uint32_t nhot;                      // entries in hot (0: not profiling)
+    snap_hot_t hot[SNAP_TOP];
+    char file[SNAP_FILE];               // program being run
+} y86_snap_t;
+
+/**
+ * @brief Create (or reuse) the shared object and map it for writing
+ *
+ * @param name Object name, as for shm_open() (e.g., "/y86")
+ * @returns Mapped snapshot, or NULL on error
+ */
+y86_snap_t *snap_create (const char *name);
+
+/**
+ * @brief Map an existing shared object for reading
+ *
+ * @param name Object name given to snap_create()
+ * @returns Mapped snapshot, or NULL if there is none (or it does not match
+ * this build)
+ */
+y86_snap_t *snap_open (const char *name);
+
+/**
+ * @brief Unmap a snapshot (the object stays until snap_remove())
+ *
+ * @param snap Snapshot from snap_create() or snap_open()
+ */
+void snap_close (y86_snap_t *snap);
+
+/**
+ * @brief Remove the shared object
+ *
+ * @param name Object name given to snap_create()
+ */
+void snap_remove (const char *name);
+
+/**
+ * @brief Start publishing a new run: its file name and a zero count
+ *
+ * @param snap Snapshot from snap_create()
+ * @param file Name of the program file
+ * @param cpu Initial CPU state
+ */
+void snap_begin (y86_snap_t *snap, const char *file, const y86_t *cpu);
+
+/**
+ * @brief Publish the current state; never blocks
+ *
+ * @param snap Snapshot from snap_create()
+ * @param cpu Current CPU state
+ * @param count Instructions executed so far
+ * @param profile Executions per address (MEMSIZE entries), or NULL; the
+ * hottest SNAP_TOP addresses are published
+ */
+void snap_publish (y86_snap_t *snap, const y86_t *cpu, uint64_t count,
+        const uint64_t *profile);
+
+/**
+ * @brief Take a consistent copy of the published state, retrying while an
+ * update is in progress
+ *
+ * @param snap Snapshot from snap_open()
+ * @param copy Destination (the seq field of the copy is the sequence read)
+ */
+void snap_read (const y86_snap_t *snap, y86_snap_t *copy);
+
+#endif
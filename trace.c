@@ -0,0 +1,417 @@
+/*
+ * CS 261: Asynchronous trace writer
+ *
+ * Name: Aiden Smith
+ */
+
+#include <inttypes.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "p2-load.h"
+#include "p3-disas.h"
+#include "p4-interp.h"
+#include "trace.h"
+
+/* Empty polls before the writer starts sleeping between polls */
+#define TRACE_SPIN 64
+
+/* Most symbols searched for -R */
+#define TRACE_MAXSYMS 1024
+
+/**********************************************************************
+ *                              FILTERS
+ *********************************************************************/
+
+static const char *const reg_names[NUMREGS] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14"
+};
+
+void trace_filter_init (trace_filter_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->to = UINT64_MAX;
+    f->fired = true;
+}
+
+bool trace_set_window (trace_filter_t *f, const char *spec)
+{
+    char *end;
+    const char *colon = strchr(spec, ':');
+    if (colon == NULL) {
+        return false;
+    }
+    if (colon != spec) {
+        f->from = strtoull(spec, &end, 0);
+        if (end != colon) {
+            return false;
+        }
+    }
+    if (colon[1] != '\0') {
+        f->to = strtoull(colon + 1, &end, 0);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return f->from < f->to;
+}
+
+bool trace_set_trigger (trace_filter_t *f, const char *spec)
+{
+    char what[16];
+    const char *eq = strchr(spec, '=');
+    size_t len = eq ? (size_t)(eq - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(what)) {
+        return false;
+    }
+    memcpy(what, spec, len);
+    what[len] = '\0';
+
+    char *end;
+    if (what[0] == '%') {
+        int r = 0;
+        while (r < NUMREGS && strcmp(what, reg_names[r]) != 0) {
+            r++;
+        }
+        if (r == NUMREGS) {
+            return false;
+        }
+        f->trigger = TRIGGER_REG;
+        f->reg = r;
+    } else {
+        f->addr = strtoull(what, &end, 0);
+        if (*end != '\0' || f->addr > MEMSIZE - 8) {
+            return false;
+        }
+        f->trigger = TRIGGER_MEM;
+    }
+    if (eq != NULL) {
+        f->match = true;
+        f->value = strtoull(eq + 1, &end, 0);
+        if (eq[1] == '\0' || *end != '\0') {
+            return false;
+        }
+    }
+    f->fired = false;
+    return true;
+}
+
+static void mark_range (trace_filter_t *f, address_t lo, address_t hi)
+{
+    for (address_t a = lo; a < hi && a < MEMSIZE; a++) {
+        f->traced_pcs[a / 64] |= 1ULL << (a % 64);
+    }
+    f->ranges = true;
+}
+
+bool trace_add_range (trace_filter_t *f, const char *spec, FILE *file,
+        elf_hdr_t *hdr)
+{
+    char *end;
+    address_t lo = strtoull(spec, &end, 0);
+    if (end != spec && *end == ':') {
+        address_t hi = strtoull(end + 1, &end, 0);
+        if (*end != '\0' || lo >= hi) {
+            return false;
+        }
+        mark_range(f, lo, hi);
+        return true;
+    }
+
+    // a symbol runs up to the next symbol above it
+    static elf_sym_t syms[TRACE_MAXSYMS];
+    int nsyms = read_symbols(file, hdr, syms, TRACE_MAXSYMS);
+    for (int i = 0; i < nsyms; i++) {
+        char name[64];
+        if (!read_symbol_name(file, hdr, &syms[i], name, sizeof(name)) ||
+                strcmp(name, spec) != 0) {
+            continue;
+        }
+        address_t start = syms[i].st_value, next = MEMSIZE;
+        for (int j = 0; j < nsyms; j++) {
+            if (syms[j].st_value > start && syms[j].st_value < next) {
+                next = syms[j].st_value;
+            }
+        }
+        mark_range(f, start, next);
+        return true;
+    }
+    return false;
+}
+
+void trace_filter_start (trace_filter_t *f, const y86_t *cpu,
+        const byte_t *memory)
+{
+    if (f->trigger != TRIGGER_NONE) {
+        f->seen = trigger_value(f, cpu, memory);
+        f->fired = f->match && f->seen == f->value;
+    }
+
+    // filled from the top down, so each entry is one step
+    uint16_t next = MEMSIZE;
+    for (address_t a = MEMSIZE; a-- > 0; ) {
+        if ((f->traced_pcs[a / 64] >> (a % 64)) & 1) {
+            next = a;
+        }
+        f->next_pc[a] = next;
+    }
+}
+
+/**********************************************************************
+ *                             PRODUCER
+ *********************************************************************/
+
+/* Free slots, reading the writer's position only when the cached one says
+   the ring is full */
+static inline uint64_t room (y86_tracer_t *t, uint64_t head)
+{
+    if (head - t->tail_seen == TRACE_RING) {
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+    }
+    return TRACE_RING - (head - t->tail_seen);
+}
+
+/* Claim n slots (n < TRACE_RING); NULL if the policy is to drop and there
+   is no room */
+static trace_rec_t *claim (y86_tracer_t *t, uint64_t n)
+{
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    while (room(t, head) < n) {
+        if (t->policy == TRACE_DROP) {
+            return NULL;
+        }
+        sched_yield();
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+    }
+    return &t->ring[head & (TRACE_RING - 1)];
+}
+
+static inline void publish (y86_tracer_t *t)
+{
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+static inline void set_state (trace_rec_t *rec, const y86_t *cpu)
+{
+    rec->next_pc = cpu->pc;
+    rec->stat = cpu->stat;
+    rec->flags = cpu->zf | (cpu->sf << 1) | (cpu->of << 2);
+}
+
+/* After dropped or skipped records, send the whole current state so the
+   writer's copy is right again (final: and shown); false if the policy is
+   to drop and there is still no room */
+static bool resync (y86_tracer_t *t, const y86_t *cpu, bool final)
+{
+    const int nrecs = (NUMREGS + 1) / 2;
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    while (room(t, head) < (uint64_t)nrecs + 1) {
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (room(t, head) >= (uint64_t)nrecs + 1) {
+            break;
+        }
+        if (t->policy == TRACE_DROP) {
+            return false;
+        }
+        sched_yield();
+    }
+    t->last = *cpu;
+    for (int i = 0; i < nrecs; i++) {
+        trace_rec_t *rec = &t->ring[(head + i) & (TRACE_RING - 1)];
+        rec->kind = (final && i == nrecs - 1) ? TRACE_FINAL : TRACE_SYNC;
+        rec->inst.valC = i == 0 ? t->dropped : 0;
+        set_state(rec, &t->last);
+        rec->nregs = 0;
+        for (int r = 2 * i; r < 2 * i + 2 && r < NUMREGS; r++) {
+            rec->regs[rec->nregs] = r;
+            rec->vals[rec->nregs++] = t->last.reg[r];
+        }
+    }
+    atomic_store_explicit(&t->head, head + nrecs, memory_order_release);
+    t->resync = false;
+    t->dropped = 0;
+    return true;
+}
+
+void trace_step (y86_tracer_t *t, address_t pc, const y86_inst_t *inst,
+        const y86_t *cpu)
+{
+    trace_rec_t *rec = NULL;
+    if (!t->resync || resync(t, cpu, false)) {
+        rec = claim(t, 1);
+    }
+    if (rec == NULL) {
+        t->resync = true;
+        t->dropped++;
+        return;
+    }
+
+    // an instruction writes at most two registers (popq: %rsp and rA)
+    rec->kind = TRACE_STEP;
+    rec->pc = pc;
+    rec->inst = pack_inst(inst, pc);
+    set_state(rec, cpu);
+    rec->nregs = 0;
+    for (int r = 0; r < NUMREGS; r++) {
+        if (cpu->reg[r] != t->last.reg[r]) {
+            rec->regs[rec->nregs] = r;
+            rec->vals[rec->nregs++] = cpu->reg[r];
+            if (rec->nregs == 2) {
+                break;
+            }
+        }
+    }
+    publish(t);
+    t->last = *cpu;
+}
+
+void trace_watch (y86_tracer_t *t, address_t pc, address_t addr,
+        uint64_t before, uint64_t after, const y86_t *cpu)
+{
+    if (t->resync && !resync(t, cpu, false)) {
+        return;                 // dropped along with its step
+    }
+    trace_rec_t *rec = claim(t, 1);
+    if (rec == NULL) {
+        return;
+    }
+    rec->kind = TRACE_WATCH;
+    rec->pc = pc;
+    rec->next_pc = addr;
+    rec->vals[0] = before;
+    rec->vals[1] = after;
+    publish(t);
+}
+
+/**********************************************************************
+ *                              WRITER
+ *********************************************************************/
+
+static void write_rec (y86_tracer_t *t, const trace_rec_t *rec,
+        bool *newline)
+{
+    outbuf_t *ob = &t->out;
+    y86_t *cpu = &t->shown;
+
+    for (int i = 0; i < rec->nregs; i++) {
+        cpu->reg[rec->regs[i]] = rec->vals[i];
+    }
+
+    switch (rec->kind) {
+        case TRACE_WATCH:
+            ob_printf(ob, "\nWatch: 0x%04" PRIx64 ": %016" PRIx64 " -> %016"
+                      PRIx64 " (pc 0x%04x)\n", rec->next_pc, rec->vals[0],
+                      rec->vals[1], rec->pc);
+            *newline = true;
+            return;
+        case TRACE_SYNC:
+        case TRACE_FINAL:
+            if (rec->inst.valC != 0) {
+                ob_printf(ob, "\n(%" PRIu64 " instructions not traced)\n",
+                          (uint64_t)rec->inst.valC);
+            }
+            break;
+        case TRACE_STEP: {
+            char text[Y86_TEXTLEN];
+            y86_inst_t inst = unpack_inst(&rec->inst, rec->pc);
+            format_inst(text, &inst);
+            if (!*newline) {
+                ob_putc(ob, '\n');
+            }
+            *newline = false;
+            ob_puts(ob, "Executing: ");
+            ob_puts(ob, text);
+            ob_puts(ob, "\nY86 CPU state:\n");
+            break;
+        }
+    }
+
+    cpu->pc = rec->next_pc;
+    cpu->stat = rec->stat;
+    cpu->zf = rec->flags & 1;
+    cpu->sf = (rec->flags >> 1) & 1;
+    cpu->of = (rec->flags >> 2) & 1;
+    if (rec->kind == TRACE_FINAL) {
+        ob_puts(ob, "Y86 CPU state:\n");
+    }
+    if (rec->kind == TRACE_STEP || rec->kind == TRACE_FINAL) {
+        format_cpu_state(ob, cpu);
+    }
+}
+
+static void *writer (void *arg)
+{
+    y86_tracer_t *t = arg;
+    bool newline = false;       // a watch line already started this step
+    uint64_t tail = 0;
+    int idle = 0;
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        if (head == tail) {
+            if (atomic_load_explicit(&t->done, memory_order_acquire) &&
+                    atomic_load_explicit(&t->head, memory_order_acquire)
+                    == tail) {
+                break;
+            }
+            // nothing to do: write what is formatted, then back off
+            ob_flush(&t->out);
+            if (++idle < TRACE_SPIN) {
+                sched_yield();
+            } else {
+                nanosleep(&(struct timespec){ .tv_nsec = 50000 }, NULL);
+            }
+            continue;
+        }
+        idle = 0;
+        for (; tail != head; tail++) {
+            write_rec(t, &t->ring[tail & (TRACE_RING - 1)], &newline);
+            // hand back slots a batch at a time
+            if ((tail & 255) == 255) {
+                atomic_store_explicit(&t->tail, tail + 1,
+                                      memory_order_release);
+            }
+        }
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+    ob_flush(&t->out);
+    return NULL;
+}
+
+y86_tracer_t *trace_start (FILE *file, const y86_t *cpu,
+        trace_policy_t policy)
+{
+    y86_tracer_t *t = aligned_alloc(64, sizeof(y86_tracer_t));
+    if (t == NULL) {
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->last = *cpu;
+    t->shown = *cpu;
+    t->policy = policy;
+    ob_init(&t->out, file);
+    if (pthread_create(&t->thread, NULL, writer, t) != 0) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void trace_finish (y86_tracer_t *t, const y86_t *cpu)
+{
+    if (t->resync) {
+        // report the records dropped or skipped at the end of the run, and
+        // where it ended
+        while (!resync(t, cpu, true)) {
+            sched_yield();
+        }
+    }
+    atomic_store_explicit(&t->done, true, memory_order_release);
+    pthread_join(t->thread, NULL);
+    fflush(t->out.file);
+    free(t);
+}
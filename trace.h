@@ -0,0 +1,270 @@
+#ifndef __CS261_TRACE__
+#define __CS261_TRACE__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "elf.h"
+#include "outbuf.h"
+#include "y86.h"
+
+/*
+ * Trace mode (-E) split over two threads. The run loop packs each executed
+ * instruction and the registers it changed into a record and pushes it into
+ * a single-producer, single-consumer ring; a writer thread keeps its own
+ * copy of the CPU state, formats the records exactly as the synchronous
+ * trace did, and writes the text in OUTBUF_SIZE pieces.
+ */
+
+/* Records in the ring (a power of two) */
+#define TRACE_RING (1 << 16)
+
+/* What to do when the ring is full */
+typedef enum {
+    TRACE_BLOCK,                // wait for the writer (output is complete)
+    TRACE_DROP                  // skip records and say how many were lost
+} trace_policy_t;
+
+/* Record kinds */
+typedef enum {
+    TRACE_STEP,                 // an instruction and the state after it
+    TRACE_WATCH,                // a store changed a watched quad
+    TRACE_SYNC,                 // state only (after dropped records)
+    TRACE_FINAL                 // last record of the sync at the end of a
+                                // run: show the state
+} trace_kind_t;
+
+typedef struct trace_rec {
+    y86_pinst_t inst;           // the instruction (STEP); dropped count (SYNC)
+    uint64_t next_pc;           // PC afterwards; address stored to (WATCH)
+    uint64_t vals[2];           // changed registers; old and new quad (WATCH)
+    uint16_t pc;                // address of the instruction
+    uint8_t kind;               // trace_kind_t
+    uint8_t stat;               // status afterwards
+    uint8_t flags;              // ZF | SF << 1 | OF << 2
+    uint8_t nregs;              // registers in vals (0-2)
+    uint8_t regs[2];            // their numbers
+} trace_rec_t;
+
+typedef struct y86_tracer {
+    // producer side
+    _Alignas(64) _Atomic uint64_t head;     // records pushed
+    uint64_t tail_seen;                     // last tail read by the producer
+    y86_t last;                             // state after the last record
+    trace_policy_t policy;
+    bool resync;                            // records were dropped
+    uint64_t dropped;                       // dropped since the last push
+
+    // consumer side
+    _Alignas(64) _Atomic uint64_t tail;     // records written
+    _Atomic bool done;                      // no more records will come
+    y86_t shown;                            // state after the last written
+    pthread_t thread;
+    outbuf_t out;
+
+    trace_rec_t ring[TRACE_RING];
+} y86_tracer_t;
+
+/* Most -R ranges */
+#define TRACE_MAXRANGES 16
+
+/* What starts a triggered trace */
+typedef enum {
+    TRIGGER_NONE,
+    TRIGGER_REG,                // a register changes or takes a value
+    TRIGGER_MEM                 // a memory quad changes or takes a value
+} trace_trigger_t;
+
+/*
+ * Which instructions to trace. An instruction is traced once the trigger
+ * (if any) has fired, while the instruction number is in [from, to), and
+ * if its address is in one of the ranges (if any were given). A trace with
+ * only a filter runs the instructions it leaves out on the plain loop, which
+ * asks the filter again only when the answer could change: at the start of
+ * the window, when control reaches a traced address, and when a write
+ * touches what the trigger watches.
+ */
+typedef struct trace_filter {
+    bool ranges;                        // only traced_pcs are traced
+    uint64_t traced_pcs[MEMSIZE / 64];  // bitmap of addresses
+    uint16_t next_pc[MEMSIZE];          // first traced address at or after
+                                        // each one (MEMSIZE: none)
+    uint64_t from, to;                  // instruction numbers, from 0
+    trace_trigger_t trigger;
+    uint8_t reg;                        // TRIGGER_REG register
+    address_t addr;                     // TRIGGER_MEM address
+    bool match;                         // fire on a value, not any change
+    uint64_t value;                     // value to match
+    uint64_t seen;                      // last value seen
+    bool fired;                         // tracing has started
+} trace_filter_t;
+
+/**
+ * @brief Set a filter to trace everything
+ *
+ * @param f Filter
+ */
+void trace_filter_init (trace_filter_t *f);
+
+/**
+ * @brief Parse an instruction window "from:to" (either may be empty)
+ *
+ * @param f Filter
+ * @param spec Window
+ * @returns False if the window cannot be parsed
+ */
+bool trace_set_window (trace_filter_t *f, const char *spec);
+
+/**
+ * @brief Parse a trigger: "%reg" or "addr" fires when the register or the
+ * quad at addr changes, and "%reg=value" or "addr=value" when it takes
+ * that value
+ *
+ * @param f Filter
+ * @param spec Trigger
+ * @returns False if the trigger cannot be parsed
+ */
+bool trace_set_trigger (trace_filter_t *f, const char *spec);
+
+/**
+ * @brief Add an address range "lo:hi" ([lo, hi)) or a symbol, which covers
+ * the addresses up to the next symbol
+ *
+ * @param f Filter
+ * @param spec Range or symbol name
+ * @param file Open Mini-ELF file, for symbols
+ * @param hdr Its header
+ * @returns False if the range cannot be parsed or the symbol is unknown
+ */
+bool trace_add_range (trace_filter_t *f, const char *spec, FILE *file,
+        elf_hdr_t *hdr);
+
+/**
+ * @brief Start the trigger watching a program's initial state, once the
+ * ranges have been added
+ *
+ * @param f Filter
+ * @param cpu State before the first instruction
+ * @param memory Memory before the first instruction
+ */
+void trace_filter_start (trace_filter_t *f, const y86_t *cpu,
+        const byte_t *memory);
+
+/* Current value watched by the trigger */
+static inline uint64_t trigger_value (const trace_filter_t *f,
+        const y86_t *cpu, const byte_t *memory)
+{
+    if (f->trigger == TRIGGER_REG) {
+        return cpu->reg[f->reg];
+    }
+    uint64_t v;
+    memcpy(&v, &memory[f->addr], 8);
+    return v;
+}
+
+/**
+ * @brief Decide whether to trace an instruction (called by the run loop
+ * after it has executed)
+ *
+ * @param f Filter
+ * @param pc Address of the instruction
+ * @param n Instructions executed before it
+ * @param cpu State after it
+ * @param memory Memory after it
+ * @returns True if the instruction should be traced
+ */
+static inline bool trace_wanted (trace_filter_t *f, address_t pc, uint64_t n,
+        const y86_t *cpu, const byte_t *memory)
+{
+    if (!f->fired) {
+        uint64_t v = trigger_value(f, cpu, memory);
+        bool fire = f->match ? v == f->value : v != f->seen;
+        f->seen = v;
+        if (!fire) {
+            return false;
+        }
+        f->fired = true;
+    }
+    if (n < f->from || n >= f->to) {
+        return false;
+    }
+    return !f->ranges || (f->traced_pcs[pc / 64] >> (pc % 64)) & 1;
+}
+
+/**
+ * @brief Start the writer thread
+ *
+ * @param file Stream for the trace (flush any earlier output first)
+ * @param cpu State before the first instruction
+ * @param policy What to do when the writer falls behind
+ * @returns New tracer, or NULL if it could not be started
+ */
+y86_tracer_t *trace_start (FILE *file, const y86_t *cpu,
+        trace_policy_t policy);
+
+/**
+ * @brief Queue an executed instruction (called by the run loop)
+ *
+ * @param t Tracer
+ * @param pc Address of the instruction
+ * @param inst The instruction
+ * @param cpu State after it
+ */
+void trace_step (y86_tracer_t *t, address_t pc, const y86_inst_t *inst,
+        const y86_t *cpu);
+
+/**
+ * @brief Note an instruction left out of the trace; the next traced one
+ * is preceded by a count of those left out
+ *
+ * @param t Tracer
+ */
+static inline void trace_skip (y86_tracer_t *t)
+{
+    t->resync = true;
+    t->dropped++;
+}
+
+/**
+ * @brief Note n instructions left out of the trace at once
+ *
+ * @param t Tracer
+ * @param n Instructions left out
+ */
+static inline void trace_skip_n (y86_tracer_t *t, uint64_t n)
+{
+    if (n != 0) {
+        t->resync = true;
+        t->dropped += n;
+    }
+}
+
+/**
+ * @brief Queue a watchpoint report (before the step that caused it)
+ *
+ * @param t Tracer
+ * @param pc Address of the storing instruction
+ * @param addr Address of the watched quad
+ * @param before Old value
+ * @param after New value
+ * @param cpu State after the storing instruction
+ */
+void trace_watch (y86_tracer_t *t, address_t pc, address_t addr,
+        uint64_t before, uint64_t after, const y86_t *cpu);
+
+/**
+ * @brief Wait for the writer to write everything queued, and free the
+ * tracer; the stream is flushed. If instructions were dropped or skipped
+ * since the last one traced, the trace ends with their count and the
+ * final state.
+ *
+ * @param t Tracer from trace_start()
+ * @param cpu State at the end of the run
+ */
+void trace_finish (y86_tracer_t *t, const y86_t *cpu);
+
+#endif
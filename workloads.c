@@ -0,0 +1,299 @@
+/*
+ * CS 261: Benchmark workloads
+ *
+ * Name: Aiden Smith
+ */
+
+#include <string.h>
+
+#include "workloads.h"
+
+/* Fixed image layout shared by every workload */
+#define CODE_VADDR  0x100
+#define DATA_VADDR  0x800
+#define DATA_SIZE   0x200
+#define STACK_VADDR 0xe00
+#define STACK_SIZE  0x200
+#define STACK_TOP   (STACK_VADDR + STACK_SIZE)
+
+/**********************************************************************
+ *                         TINY Y86 ASSEMBLER
+ *********************************************************************/
+
+/* Code buffer being assembled; addresses are guest virtual addresses */
+typedef struct {
+    byte_t code[MEMSIZE];
+    address_t base;
+    size_t len;
+} asm_t;
+
+static address_t here (asm_t *a)
+{
+    return a->base + a->len;
+}
+
+static void emit_byte (asm_t *a, byte_t b)
+{
+    if (a->len < sizeof(a->code)) {
+        a->code[a->len] = b;
+    }
+    a->len++;
+}
+
+static void emit_quad (asm_t *a, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        emit_byte(a, (v >> (8 * i)) & 0xFF);
+    }
+}
+
+static void emit_regs (asm_t *a, y86_regnum_t ra, y86_regnum_t rb)
+{
+    emit_byte(a, (ra << 4) | rb);
+}
+
+static void emit_op (asm_t *a, y86_icode_t icode, int ifun)
+{
+    emit_byte(a, (icode << 4) | ifun);
+}
+
+static void emit_irmovq (asm_t *a, uint64_t v, y86_regnum_t rb)
+{
+    emit_op(a, IRMOVQ, 0);
+    emit_regs(a, NOREG, rb);
+    emit_quad(a, v);
+}
+
+static void emit_rmmovq (asm_t *a, y86_regnum_t ra, int64_t d, y86_regnum_t rb)
+{
+    emit_op(a, RMMOVQ, 0);
+    emit_regs(a, ra, rb);
+    emit_quad(a, d);
+}
+
+static void emit_mrmovq (asm_t *a, int64_t d, y86_regnum_t rb, y86_regnum_t ra)
+{
+    emit_op(a, MRMOVQ, 0);
+    emit_regs(a, ra, rb);
+    emit_quad(a, d);
+}
+
+static void emit_opq (asm_t *a, y86_op_t op, y86_regnum_t ra, y86_regnum_t rb)
+{
+    emit_op(a, OPQ, op);
+    emit_regs(a, ra, rb);
+}
+
+static void emit_cmov (asm_t *a, y86_cmov_t cmov, y86_regnum_t ra, y86_regnum_t rb)
+{
+    emit_op(a, CMOV, cmov);
+    emit_regs(a, ra, rb);
+}
+
+/* Jumps and calls return the offset of their destination for patching */
+static size_t emit_jump (asm_t *a, y86_jump_t jump, address_t dest)
+{
+    emit_op(a, JUMP, jump);
+    size_t at = a->len;
+    emit_quad(a, dest);
+    return at;
+}
+
+static size_t emit_call (asm_t *a, address_t dest)
+{
+    emit_op(a, CALL, 0);
+    size_t at = a->len;
+    emit_quad(a, dest);
+    return at;
+}
+
+static void patch_quad (asm_t *a, size_t at, uint64_t v)
+{
+    for (int i = 0; i < 8 && at + i < sizeof(a->code); i++) {
+        a->code[at + i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+/*
+ * Wrap the assembled code in a Mini-ELF image with a code, data and stack
+ * segment. Returns the image size, or zero if it does not fit.
+ */
+static size_t write_image (asm_t *a, const byte_t *data, byte_t *buf, size_t cap)
+{
+    const uint16_t nphdr = 3;
+    size_t offset = sizeof(elf_hdr_t) + nphdr * sizeof(elf_phdr_t);
+    size_t total = offset + a->len + DATA_SIZE + STACK_SIZE;
+
+    if (a->len > DATA_VADDR - CODE_VADDR || total > cap) {
+        return 0;
+    }
+
+    elf_hdr_t hdr = {
+        .e_version = 1, .e_entry = CODE_VADDR,
+        .e_phdr_start = sizeof(elf_hdr_t), .e_num_phdr = nphdr,
+        .e_symtab = 0, .e_strtab = 0, .magic = 0x00464C45
+    };
+    elf_phdr_t phdrs[3] = {
+        { offset, a->len, CODE_VADDR, CODE, 5, 0xDEADBEEF },
+        { offset + a->len, DATA_SIZE, DATA_VADDR, DATA, 6, 0xDEADBEEF },
+        { offset + a->len + DATA_SIZE, STACK_SIZE, STACK_VADDR, STACK, 6,
+          0xDEADBEEF },
+    };
+
+    memset(buf, 0, total);
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), phdrs, sizeof(phdrs));
+    memcpy(buf + offset, a->code, a->len);
+    if (data != NULL) {
+        memcpy(buf + offset + a->len, data, DATA_SIZE);
+    }
+    return total;
+}
+
+/**********************************************************************
+ *                              WORKLOADS
+ *********************************************************************/
+
+/*
+ * Tight register-only loop of OPq, irmovq and rrmovq instructions.
+ */
+static size_t build_alu (byte_t *buf, size_t cap)
+{
+    asm_t a = { .base = CODE_VADDR };
+
+    emit_irmovq(&a, 1, RAX);
+    emit_irmovq(&a, 3, RCX);
+    emit_irmovq(&a, 0x55aa, RDX);
+    address_t loop = here(&a);
+    for (int i = 0; i < 4; i++) {
+        emit_opq(&a, ADD, RAX, RBX);
+        emit_opq(&a, SUB, RCX, RSI);
+        emit_opq(&a, XOR, RDX, RDI);
+        emit_opq(&a, AND, RBX, R8);
+        emit_cmov(&a, RRMOVQ, RBX, R9);
+        emit_opq(&a, ADD, R9, R10);
+        emit_irmovq(&a, 0x1234 + i, R11);
+        emit_opq(&a, XOR, R11, R12);
+    }
+    emit_jump(&a, JMP, loop);
+    return write_image(&a, NULL, buf, cap);
+}
+
+/*
+ * Repeated 32-deep chain of CALL/RET with a push/pop pair in every frame.
+ */
+#define CALL_DEPTH 32
+static size_t build_calls (byte_t *buf, size_t cap)
+{
+    asm_t a = { .base = CODE_VADDR };
+    size_t fix[CALL_DEPTH];
+
+    address_t loop = here(&a);
+    emit_irmovq(&a, STACK_TOP, RSP);
+    fix[0] = emit_call(&a, 0);
+    emit_jump(&a, JMP, loop);
+
+    for (int i = 0; i < CALL_DEPTH; i++) {
+        patch_quad(&a, fix[i], here(&a));
+        emit_op(&a, PUSHQ, 0);
+        emit_regs(&a, RBP, NOREG);
+        emit_cmov(&a, RRMOVQ, RSP, RBP);
+        emit_opq(&a, ADD, RAX, RBX);
+        if (i + 1 < CALL_DEPTH) {
+            fix[i + 1] = emit_call(&a, 0);
+        }
+        emit_op(&a, POPQ, 0);
+        emit_regs(&a, RBP, NOREG);
+        emit_op(&a, RET, 0);
+    }
+    return write_image(&a, NULL, buf, cap);
+}
+
+/*
+ * Unrolled copy of the data segment's first half into its second half.
+ */
+#define COPY_QUADS (DATA_SIZE / 16)
+static size_t build_memcpy (byte_t *buf, size_t cap)
+{
+    asm_t a = { .base = CODE_VADDR };
+    byte_t data[DATA_SIZE];
+
+    for (int i = 0; i < DATA_SIZE; i++) {
+        data[i] = (byte_t)(i * 7 + 1);
+    }
+
+    emit_irmovq(&a, 8, R8);
+    address_t loop = here(&a);
+    emit_irmovq(&a, DATA_VADDR, RSI);
+    emit_irmovq(&a, DATA_VADDR + DATA_SIZE / 2, RDI);
+    for (int i = 0; i < COPY_QUADS; i++) {
+        emit_mrmovq(&a, 0, RSI, RAX);
+        emit_rmmovq(&a, RAX, 0, RDI);
+        emit_opq(&a, ADD, R8, RSI);
+        emit_opq(&a, ADD, R8, RDI);
+    }
+    emit_jump(&a, JMP, loop);
+    return write_image(&a, data, buf, cap);
+}
+
+/*
+ * Chains of conditional jumps and moves, mixing taken and fall-through
+ * edges for every condition code.
+ */
+static size_t build_branch (byte_t *buf, size_t cap)
+{
+    asm_t a = { .base = CODE_VADDR };
+
+    emit_irmovq(&a, 1, RAX);
+    address_t loop = here(&a);
+    for (int i = 0; i < 6; i++) {
+        for (y86_jump_t j = JLE; j <= JG; j++) {
+            size_t at = emit_jump(&a, j, 0);
+            emit_opq(&a, ADD, RAX, RBX);
+            patch_quad(&a, at, here(&a));
+            emit_cmov(&a, (y86_cmov_t)j, RBX, RCX);
+        }
+    }
+    emit_jump(&a, JMP, loop);
+    return write_image(&a, NULL, buf, cap);
+}
+
+/*
+ * Output-only I/O traps interleaved with pointer setup for the traps.
+ */
+static size_t build_iotrap (byte_t *buf, size_t cap)
+{
+    asm_t a = { .base = CODE_VADDR };
+    byte_t data[DATA_SIZE] = "y86\n";
+
+    address_t loop = here(&a);
+    emit_irmovq(&a, DATA_VADDR, RSI);
+    for (int i = 0; i < 8; i++) {
+        emit_op(&a, IOTRAP, CHAROUT);
+        emit_op(&a, IOTRAP, DECOUT);
+        emit_op(&a, IOTRAP, STROUT);
+        emit_op(&a, NOP, 0);
+    }
+    emit_op(&a, IOTRAP, FLUSH);
+    emit_jump(&a, JMP, loop);
+    return write_image(&a, data, buf, cap);
+}
+
+const workload_t workloads[] = {
+    { "alu",    "tight register ALU loop",          build_alu },
+    { "calls",  "32-deep CALL/RET recursion",       build_calls },
+    { "memcpy", "unrolled memory copy loop",        build_memcpy },
+    { "branch", "conditional jump and cmov chains", build_branch },
+    { "iotrap", "IOTRAP-heavy output loop",         build_iotrap },
+};
+const int num_workloads = sizeof(workloads) / sizeof(workloads[0]);
+
+const workload_t *find_workload (const char *name)
+{
+    for (int i = 0; i < num_workloads; i++) {
+        if (strcmp(workloads[i].name, name) == 0) {
+            return &workloads[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef __CS261_WORKLOADS__
+#define __CS261_WORKLOADS__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elf.h"
+#include "y86.h"
+
+/* Largest Mini-ELF image produced by any of the benchmark workloads */
+#define WORKLOAD_MAXSIZE (2 * MEMSIZE)
+
+/*
+ * Benchmark workload descriptor. Every workload is a small Mini-ELF image
+ * whose main body loops forever, so a run is bounded by the harness'
+ * instruction budget rather than by the 4 KiB address space.
+ */
+typedef struct workload {
+    const char *name;       // short name used on the command line
+    const char *desc;       // one-line description for reports
+
+    /* Assemble the image into buf (at most cap bytes); returns its size */
+    size_t (*build) (byte_t *buf, size_t cap);
+} workload_t;
+
+/* All workloads, in report order */
+extern const workload_t workloads[];
+extern const int num_workloads;
+
+/**
+ * @brief Find a workload by name
+ *
+ * @param name Short workload name
+ * @returns Pointer to the workload descriptor, or NULL if there is none
+ */
+const workload_t *find_workload (const char *name);
+
+#endif
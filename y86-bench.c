@@ -0,0 +1,385 @@
+/*
+ * CS 261: Benchmark harness
+ *
+ * Name: Aiden Smith
+ *
+ * Runs every workload from workloads.c on every available engine and
+ * reports median host time, guest MIPS and run-to-run variation.
+ *
+ * Build: gcc -O2 -pthread -o y86-bench y86-bench.c workloads.c engine.c
+ *            multi.c exec.c cfg.c cover.c sample.c snap.c trace.c
+ *            p1-check.c p2-load.c p3-disas.c p4-interp.c outbuf.c -lm
+ */
+
+#include <math.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "p3-disas.h"
+#include "p4-interp.h"
+#include "engine.h"
+#include "exec.h"
+#include "multi.h"
+#include "workloads.h"
+
+#define DEFAULT_REPS  7
+#define DEFAULT_INSTS 5000000ULL
+#define MAX_REPS      101
+
+/* Execution engine under test */
+typedef struct engine {
+    const char *name;
+
+    /* Run from the current CPU state until it stops or limit instructions
+       have executed; returns the number of instructions executed */
+    uint64_t (*run) (y86_t *cpu, byte_t *memory, uint64_t limit);
+} engine_t;
+
+/* Pages the reference engine has stored to (one workload runs at a time) */
+static uint64_t stages_dirty[PAGEWORDS];
+
+/*
+ * Reference engine: the fetch/decode_execute/memory_wb_pc stage functions,
+ * stepped exactly like the driver loop in main.c.
+ */
+static uint64_t run_stages (y86_t *cpu, byte_t *memory, uint64_t limit)
+{
+    uint64_t count = 0;
+
+    while (count < limit && cpu->stat == AOK) {
+        y86_inst_t inst = fetch(cpu, memory);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            break;
+        }
+        count++;
+
+        bool cnd = false;
+        y86_reg_t valA = 0;
+        y86_reg_t valE = decode_execute(cpu, &inst, &cnd, &valA);
+        if (cpu->stat == ADR || cpu->stat == INS) {
+            break;
+        }
+        memory_wb_pc_dirty(cpu, &inst, memory, cnd, valA, valE, stages_dirty);
+    }
+    return count;
+}
+
+/*
+ * The run loop that y86 -e uses (exec.c), with no features on: the stages
+ * inlined, with the registers and PC held in locals.
+ */
+static uint64_t run_loop (y86_t *cpu, byte_t *memory, uint64_t limit)
+{
+    static y86_exec_t ex;
+
+    memset(&ex, 0, sizeof(ex));
+    ex.cpu = *cpu;
+    ex.memory = memory;
+    ex.limit = limit;
+    exec_select(0)(&ex);
+    *cpu = ex.cpu;
+    if (cpu->stat == TMO) {
+        cpu->stat = AOK;        // used up the budget, like the other engines
+    }
+    return ex.count;
+}
+
+/*
+ * Predecoded engine from engine.c, starting from an empty cache every run.
+ */
+static uint64_t run_fast (y86_t *cpu, byte_t *memory, uint64_t limit)
+{
+    static y86_engine_t *eng = NULL;
+
+    if (eng == NULL && (eng = engine_new()) == NULL) {
+        return 0;
+    }
+    engine_flush(eng);
+    return engine_run(eng, cpu, memory, limit);
+}
+
+/*
+ * SIMD engine: MULTI_LANES copies of the program share the instruction
+ * budget, so the MIPS column is aggregate throughput. Lane 0 is copied back
+ * as the result.
+ */
+static uint64_t run_multi (y86_t *cpu, byte_t *memory, uint64_t limit)
+{
+    y86_multi_t *m = multi_new(memory, cpu->pc);
+    if (m == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < MULTI_LANES; i++) {
+        multi_set_cpu(m, i, cpu);
+    }
+    uint64_t count = multi_run(m, limit / MULTI_LANES);
+    multi_get_cpu(m, 0, cpu);
+    memcpy(memory, m->memory[0], MEMSIZE);
+    multi_free(m);
+    return count;
+}
+
+static const engine_t engines[] = {
+    { "stages", run_stages },
+    { "loop",   run_loop },
+    { "fast",   run_fast },
+    { "multi",  run_multi },
+};
+static const int num_engines = sizeof(engines) / sizeof(engines[0]);
+
+/**********************************************************************
+ *                           HARNESS HELPERS
+ *********************************************************************/
+
+static int cmp_u64 (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Load an in-memory image through the regular Mini-ELF loader so that the
+ * benchmark exercises the same path as the command-line driver.
+ */
+static bool load_image (const byte_t *image, size_t size, byte_t *memory,
+        elf_hdr_t *hdr)
+{
+    FILE *file = tmpfile();
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(image, 1, size, file) == size &&
+              load_program(file, memory, hdr);
+    fclose(file);
+    return ok;
+}
+
+static bool write_file (const char *dir, const char *name, const byte_t *image,
+        size_t size)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.o", dir, name);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(image, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+/*
+ * Median, mean and coefficient of variation of reps timings; sorts times.
+ */
+static uint64_t summarize (uint64_t *times, int reps, double *cv)
+{
+    double mean = 0.0, var = 0.0;
+    for (int r = 0; r < reps; r++) {
+        mean += times[r];
+    }
+    mean /= reps;
+    for (int r = 0; r < reps; r++) {
+        var += (times[r] - mean) * (times[r] - mean);
+    }
+    var = (reps > 1) ? var / (reps - 1) : 0.0;
+    *cv = mean > 0 ? 100.0 * sqrt(var) / mean : 0.0;
+
+    qsort(times, reps, sizeof(uint64_t), cmp_u64);
+    return times[reps / 2];
+}
+
+/*
+ * Time reps runs of one workload on one engine and print a report line.
+ */
+static void bench_one (const workload_t *w, const engine_t *e,
+        const byte_t *pristine, elf_hdr_t *hdr, int reps, uint64_t limit)
+{
+    static byte_t memory[MEMSIZE];
+    uint64_t times[MAX_REPS];
+    uint64_t insts = 0;
+    y86_stat_t stat = AOK;
+
+    // the stages track the pages they write, so only those are reset
+    memcpy(memory, pristine, MEMSIZE);
+    dirty_clear(stages_dirty);
+    for (int r = 0; r < reps; r++) {
+        if (r > 0 && e->run == run_stages) {
+            dirty_restore(memory, pristine, stages_dirty);
+        } else if (r > 0) {
+            memcpy(memory, pristine, MEMSIZE);
+        }
+        y86_t cpu = {0};
+        cpu.pc = hdr->e_entry;
+        cpu.stat = AOK;
+
+        uint64_t start = y86_clock_ns();
+        insts = e->run(&cpu, memory, limit);
+        times[r] = y86_clock_ns() - start;
+        stat = cpu.stat;
+    }
+
+    double cv;
+    uint64_t median = summarize(times, reps, &cv);
+    double mips = median ? (double)insts * 1e3 / median : 0.0;
+
+    printf("%-8s %-8s %12" PRIu64 " %12.3f %10.2f %7.2f%%%s\n",
+           w->name, e->name, insts, median / 1e6, mips, cv,
+           stat == AOK ? "" : "  (stopped early)");
+}
+
+/*
+ * Decode microbenchmark: linearly decode the code segment, restarting at
+ * the entry point at the first halt or invalid byte past its end, until
+ * limit instructions have been decoded. Measures either the fetch() API or
+ * the inline decode() that the disassembler and engines share.
+ */
+static void bench_decode (const workload_t *w, byte_t *memory, elf_hdr_t *hdr,
+        int reps, uint64_t limit, bool use_fetch)
+{
+    uint64_t times[MAX_REPS];
+    volatile uint64_t sink = 0;
+
+    for (int r = 0; r < reps; r++) {
+        y86_t cpu = {0};
+        cpu.pc = hdr->e_entry;
+        uint64_t checksum = 0;
+
+        uint64_t start = y86_clock_ns();
+        for (uint64_t n = 0; n < limit; n++) {
+            y86_stat_t stat;
+            y86_inst_t inst = use_fetch ? fetch(&cpu, memory)
+                : decode(memory, cpu.pc, &stat);
+            if (inst.icode == INVALID || inst.icode == HALT) {
+                cpu.pc = hdr->e_entry;
+                continue;
+            }
+            checksum += inst.valC.v + inst.ifun.b;
+            cpu.pc = inst.valP;
+        }
+        times[r] = y86_clock_ns() - start;
+        sink += checksum;
+    }
+
+    double cv;
+    uint64_t median = summarize(times, reps, &cv);
+    printf("%-8s %-8s %12" PRIu64 " %12.3f %10.2f %7.2f%%\n",
+           w->name, use_fetch ? "fetch" : "decode", limit, median / 1e6,
+           median ? (double)limit * 1e3 / median : 0.0, cv);
+}
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)>\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -l          List workloads and engines\n");
+    printf("  -n reps     Runs per workload and engine (default %d)\n",
+           DEFAULT_REPS);
+    printf("  -i insts    Guest instructions per run (default %llu)\n",
+           DEFAULT_INSTS);
+    printf("  -w name     Only run the named workload\n");
+    printf("  -e name     Only run the named engine\n");
+    printf("  -d          Run the decode microbenchmark instead\n");
+    printf("  -o dir      Write the workload images to dir and exit\n");
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    int reps = DEFAULT_REPS;
+    uint64_t limit = DEFAULT_INSTS;
+    const char *only_workload = NULL;
+    const char *only_engine = NULL;
+    const char *outdir = NULL;
+    bool decode_only = false;
+
+    while ((opt = getopt(argc, argv, "hln:i:w:e:o:d")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'l':
+                for (int i = 0; i < num_workloads; i++) {
+                    printf("workload %-8s %s\n", workloads[i].name,
+                           workloads[i].desc);
+                }
+                for (int i = 0; i < num_engines; i++) {
+                    printf("engine   %s\n", engines[i].name);
+                }
+                return EXIT_SUCCESS;
+            case 'n':
+                reps = atoi(optarg);
+                if (reps < 1 || reps > MAX_REPS) {
+                    usage(argv);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'i':
+                limit = strtoull(optarg, NULL, 0);
+                break;
+            case 'w':
+                only_workload = optarg;
+                break;
+            case 'e':
+                only_engine = optarg;
+                break;
+            case 'o':
+                outdir = optarg;
+                break;
+            case 'd':
+                decode_only = true;
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+
+    static byte_t image[WORKLOAD_MAXSIZE];
+    static byte_t pristine[MEMSIZE];
+
+    if (outdir == NULL) {
+        printf("%-8s %-8s %12s %12s %10s %8s\n",
+               "workload", "engine", "insts", "median(ms)", "MIPS", "cv");
+    }
+
+    for (int i = 0; i < num_workloads; i++) {
+        const workload_t *w = &workloads[i];
+        if (only_workload && strcmp(only_workload, w->name) != 0) {
+            continue;
+        }
+
+        size_t size = w->build(image, sizeof(image));
+        if (size == 0) {
+            printf("%s: image too large\n", w->name);
+            return EXIT_FAILURE;
+        }
+        if (outdir != NULL) {
+            if (!write_file(outdir, w->name, image, size)) {
+                printf("Failed to write %s/%s.o\n", outdir, w->name);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        elf_hdr_t hdr;
+        if (!load_image(image, size, pristine, &hdr)) {
+            printf("%s: failed to load image\n", w->name);
+            return EXIT_FAILURE;
+        }
+
+        if (decode_only) {
+            bench_decode(w, pristine, &hdr, reps, limit, true);
+            bench_decode(w, pristine, &hdr, reps, limit, false);
+            continue;
+        }
+        for (int j = 0; j < num_engines; j++) {
+            if (only_engine && strcmp(only_engine, engines[j].name) != 0) {
+                continue;
+            }
+            bench_one(w, &engines[j], pristine, &hdr, reps, limit);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*
+ * CS 261: Local execution client
+ *
+ * Name: Aiden Smith
+ *
+ * Sends a Mini-ELF file and its input to y86-server and prints the guest
+ * output and final CPU state. With -c it first asks for the image by digest
+ * and sends the file only if the server has not cached it; -n repeats the
+ * request on one connection and reports the request rate.
+ *
+ * Build: gcc -O2 -o y86-client y86-client.c proto.c p1-check.c p2-load.c
+ *            p3-disas.c p4-interp.c outbuf.c
+ */
+
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "p4-interp.h"
+#include "proto.h"
+
+static const char *results[] = {
+    "ok", "image not cached", "bad image", "bad request", "server busy"
+};
+
+static byte_t *read_file (const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    byte_t *data = malloc(*size + 1);
+    if (data != NULL && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+/* Send one request and read the reply; output and memory are returned in
+   malloc'd buffers */
+static bool request (int fd, proto_request_t *req, const byte_t *image,
+        const byte_t *input, proto_reply_t *reply, char **output,
+        byte_t **memory)
+{
+    if (!proto_send(fd, req, sizeof(*req)) ||
+            !proto_send(fd, image, req->image_len) ||
+            !proto_send(fd, input, req->input_len) ||
+            !proto_recv(fd, reply, sizeof(*reply)) ||
+            reply->magic != PROTO_MAGIC ||
+            reply->memory_len > MEMSIZE) {
+        return false;
+    }
+    *output = malloc(reply->output_len + 1);
+    *memory = malloc(MEMSIZE);
+    return *output != NULL && *memory != NULL &&
+           proto_recv(fd, *output, reply->output_len) &&
+           proto_recv(fd, *memory, reply->memory_len);
+}
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> mini-elf-file\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -s path     Server socket (default %s)\n", PROTO_SOCKET);
+    printf("  -i file     Guest input (default none)\n");
+    printf("  -l insts    Instruction budget (default: server's)\n");
+    printf("  -t secs     Time limit (default none)\n");
+    printf("  -c          Send the image digest first, and the image only if "
+           "needed\n");
+    printf("  -m          Print the final memory\n");
+    printf("  -n reqs     Repeat the request and report requests per second\n");
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    const char *path = PROTO_SOCKET;
+    const char *input_path = NULL;
+    proto_request_t req = { .magic = PROTO_MAGIC };
+    bool cached = false;
+    int reps = 1;
+
+    while ((opt = getopt(argc, argv, "hs:i:l:t:cmn:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 's':
+                path = optarg;
+                break;
+            case 'i':
+                input_path = optarg;
+                break;
+            case 'l':
+                req.limit = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                req.timeout_ms = atof(optarg) * 1000;
+                break;
+            case 'c':
+                cached = true;
+                break;
+            case 'm':
+                req.flags |= PROTO_MEMORY;
+                break;
+            case 'n':
+                reps = atoi(optarg);
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || reps < 1 ||
+            strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    size_t image_len = 0, input_len = 0;
+    byte_t *image = read_file(argv[optind], &image_len);
+    byte_t *input = input_path ? read_file(input_path, &input_len)
+                               : calloc(1, 1);
+    if (image == NULL || input == NULL ||
+            image_len > PROTO_MAXIMAGE || input_len > PROTO_MAXINPUT) {
+        printf("Failed to read file\n");
+        return EXIT_FAILURE;
+    }
+    req.input_len = input_len;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    proto_reply_t reply;
+    char *output = NULL;
+    byte_t *memory = NULL;
+    uint64_t start = y86_clock_ns();
+    for (int r = 0; r < reps; r++) {
+        free(output);
+        free(memory);
+        if (cached) {
+            req.flags |= PROTO_CACHED;
+            req.digest = proto_digest(image, image_len);
+            req.image_len = 0;
+        } else {
+            req.image_len = image_len;
+        }
+        if (!request(fd, &req, image, input, &reply, &output, &memory)) {
+            printf("Server connection failed\n");
+            return EXIT_FAILURE;
+        }
+        if (reply.result == PROTO_UNKNOWN && cached) {
+            // not cached (any more): send the file this time
+            free(output);
+            free(memory);
+            req.flags &= ~PROTO_CACHED;
+            req.image_len = image_len;
+            if (!request(fd, &req, image, input, &reply, &output, &memory)) {
+                printf("Server connection failed\n");
+                return EXIT_FAILURE;
+            }
+        }
+        if (reply.result != PROTO_OK) {
+            printf("Server error: %s\n", reply.result < 5 ?
+                   results[reply.result] : "unknown");
+            return EXIT_FAILURE;
+        }
+    }
+    double secs = (y86_clock_ns() - start) / 1e9;
+    close(fd);
+
+    fwrite(output, 1, reply.output_len, stdout);
+    if (reply.output_len > 0) {
+        printf("\n");
+    }
+    printf("Y86 CPU state:\n");
+    dump_cpu_state(&reply.cpu);
+    printf("Total execution count: %" PRIu64 "\n", reply.count);
+    if (reply.memory_len > 0) {
+        printf("\n");
+        dump_memory(memory, 0, MEMSIZE);
+    }
+    if (reps > 1) {
+        printf("%d requests in %.3f s (%.0f per second)\n", reps, secs,
+               reps / secs);
+    }
+
+    free(output);
+    free(memory);
+    free(image);
+    free(input);
+    return EXIT_SUCCESS;
+}
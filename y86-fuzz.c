@@ -0,0 +1,459 @@
+/*
+ * CS 261: In-process fuzzer
+ *
+ * Name: Aiden Smith
+ *
+ * Feeds mutated input to a Mini-ELF program through CHARIN/DECIN. The
+ * program is loaded once, and every run starts again from its state at
+ * e_entry: the engine keeps its decoded code, and only the pages the last
+ * run wrote are copied back from the loaded image. Control transfers
+ * between blocks are counted in an AFL-style edge map; an input that
+ * reaches a new edge, or an edge a new number of times (in AFL's buckets),
+ * is written to out/queue and mutated further. An input that faults with
+ * ADR or INS is written to out/crashes, once per faulting PC and status.
+ *
+ * Build: gcc -O2 -o y86-fuzz y86-fuzz.c io.c engine.c outbuf.c p1-check.c
+ *            p2-load.c p3-disas.c
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "engine.h"
+#include "io.h"
+
+#define DEFAULT_RUNS   1000000
+#define DEFAULT_LIMIT  100000
+#define DEFAULT_OUTDIR "fuzz-out"
+
+#define FUZZ_MAXLEN    1024     // longest input
+#define FUZZ_MAXQUEUE  4096     // most inputs kept for mutation
+#define FUZZ_ROUNDS    64       // mutations of a queue entry per turn
+
+/* Input kept for mutation */
+typedef struct entry {
+    byte_t *data;
+    size_t len;
+} entry_t;
+
+typedef struct fuzzer {
+    y86_engine_t *eng;
+    y86_io_t io;
+    y86_t start;                        // state at e_entry
+    byte_t pristine[MEMSIZE];           // memory at e_entry
+    byte_t memory[MEMSIZE];
+    uint64_t limit;                     // instructions per run
+    _Alignas(64) uint8_t edges[EDGE_MAP];   // hit counts of the last run
+    uint8_t seen[EDGE_MAP];             // buckets reached so far, per edge
+    uint8_t crashed[MEMSIZE];           // statuses seen faulting, per PC
+    entry_t queue[FUZZ_MAXQUEUE];
+    int nqueue;
+    const char *outdir;
+    uint64_t rng;
+    uint64_t runs, crashes, hangs, nedges;
+} fuzzer_t;
+
+/* AFL's hit-count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+ */
+static uint8_t bucket[256];
+
+static void init_buckets (void)
+{
+    for (int n = 1; n < 256; n++) {
+        bucket[n] = n == 1 ? 1 : n == 2 ? 2 : n == 3 ? 4 : n < 8 ? 8 :
+                    n < 16 ? 16 : n < 32 ? 32 : n < 128 ? 64 : 128;
+    }
+}
+
+/**********************************************************************
+ *                               FILES
+ *********************************************************************/
+
+static bool load_file (const char *path, byte_t *memory, elf_hdr_t *hdr)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = load_program(file, memory, hdr);
+    fclose(file);
+    return ok;
+}
+
+/* Read at most FUZZ_MAXLEN bytes of a file */
+static size_t read_seed (const char *path, byte_t *data)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    size_t len = fread(data, 1, FUZZ_MAXLEN, file);
+    fclose(file);
+    return len;
+}
+
+static bool make_dir (const char *path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static void write_input (fuzzer_t *fz, const char *sub, const char *name,
+        const byte_t *data, size_t len)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s/%s", fz->outdir, sub, name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+    fwrite(data, 1, len, file);
+    fclose(file);
+}
+
+/**********************************************************************
+ *                             MUTATION
+ *********************************************************************/
+
+/* xorshift64* */
+static inline uint64_t next_random (fuzzer_t *fz)
+{
+    fz->rng ^= fz->rng >> 12;
+    fz->rng ^= fz->rng << 25;
+    fz->rng ^= fz->rng >> 27;
+    return fz->rng * 2685821657736338717ULL;
+}
+
+static inline size_t below (fuzzer_t *fz, size_t n)
+{
+    return next_random(fz) % n;
+}
+
+/* Bytes and numbers that tend to reach boundary cases */
+static const byte_t interesting_bytes[] = {
+    0, 0xff, 0x7f, 0x80, ' ', '\n', '-', '+', '0', '1', '9'
+};
+static const int64_t interesting_values[] = {
+    0, 1, -1, 2, 7, 8, 16, 127, 128, 255, 256, 4095, 4096, 65535, 65536,
+    INT32_MAX, INT32_MIN, INT64_MAX, INT64_MIN
+};
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+/* Replace [at, at + del) with ins (ins_len bytes), keeping the length at
+   most FUZZ_MAXLEN */
+static size_t splice (byte_t *buf, size_t len, size_t at, size_t del,
+        const byte_t *ins, size_t ins_len)
+{
+    if (len - del + ins_len > FUZZ_MAXLEN) {
+        ins_len = FUZZ_MAXLEN - (len - del);
+    }
+    memmove(buf + at + ins_len, buf + at + del, len - at - del);
+    if (ins_len > 0) {
+        memcpy(buf + at, ins, ins_len);
+    }
+    return len - del + ins_len;
+}
+
+/* Apply a few random changes (AFL's "havoc" stage) */
+static size_t mutate (fuzzer_t *fz, byte_t *buf, size_t len)
+{
+    int changes = 1 << below(fz, 4);
+    for (int c = 0; c < changes; c++) {
+        size_t at = below(fz, len + 1);
+        switch (below(fz, 7)) {
+            case 0:                     // flip a bit
+                if (at < len) {
+                    buf[at] ^= 1 << below(fz, 8);
+                }
+                break;
+            case 1:                     // random byte
+                if (at < len) {
+                    buf[at] = next_random(fz);
+                }
+                break;
+            case 2: {                   // insert an interesting byte
+                byte_t b = interesting_bytes[below(fz, COUNT(interesting_bytes))];
+                len = splice(buf, len, at, 0, &b, 1);
+                break;
+            }
+            case 3: {                   // insert a number for DECIN
+                char text[24];
+                int64_t v = below(fz, 2) ? (int64_t)next_random(fz) >> below(fz, 64)
+                          : interesting_values[below(fz, COUNT(interesting_values))];
+                int n = snprintf(text, sizeof(text), "%" PRId64 " ", v);
+                len = splice(buf, len, at, 0, (const byte_t *)text, n);
+                break;
+            }
+            case 4:                     // delete a few bytes
+                if (at < len) {
+                    size_t del = 1 + below(fz, len - at < 8 ? len - at : 8);
+                    len = splice(buf, len, at, del, NULL, 0);
+                }
+                break;
+            case 5:                     // duplicate a byte
+                if (at < len) {
+                    byte_t b = buf[at];
+                    len = splice(buf, len, at, 0, &b, 1);
+                }
+                break;
+            case 6: {                   // tail of another queue entry
+                const entry_t *e = &fz->queue[below(fz, fz->nqueue)];
+                if (e->len > 0) {
+                    size_t from = below(fz, e->len);
+                    len = splice(buf, len, at, len - at, e->data + from,
+                                 e->len - from);
+                }
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+/**********************************************************************
+ *                               RUNS
+ *********************************************************************/
+
+static bool fuzz_trap (void *ctx, y86_t *cpu, byte_t *memory, int trap)
+{
+    return io_trap(ctx, cpu, memory, trap) == IO_DONE;
+}
+
+/* Run the program on one input (edges starts out clear) and put memory
+   back as it was; returns the final status (TMO if the budget ran out) and
+   the final PC */
+static y86_stat_t run_one (fuzzer_t *fz, const byte_t *data, size_t len,
+        address_t *pc)
+{
+    io_reset(&fz->io);
+    io_input(&fz->io, data, len, true);
+    engine_set_edges(fz->eng, fz->edges);
+
+    y86_t cpu = fz->start;
+    engine_run(fz->eng, &cpu, fz->memory, fz->limit);
+    engine_restore(fz->eng, fz->memory, fz->pristine);
+
+    fz->runs++;
+    *pc = cpu.pc;
+    return cpu.stat == AOK ? TMO : cpu.stat;
+}
+
+/* Merge the last run's edge counts into seen if merge is set, and clear
+   them for the next run; true if any edge reached a new bucket */
+static bool take_edges (fuzzer_t *fz, bool merge)
+{
+    bool found = false;
+    for (int w = 0; merge && w < EDGE_MAP; w += 8) {
+        uint64_t word;
+        memcpy(&word, &fz->edges[w], 8);
+        if (word == 0) {
+            continue;                   // most of the map is untouched
+        }
+        for (int i = w; i < w + 8; i++) {
+            uint8_t b = bucket[fz->edges[i]];
+            if (b & ~fz->seen[i]) {
+                fz->nedges += fz->seen[i] == 0;
+                fz->seen[i] |= b;
+                found = true;
+            }
+        }
+    }
+    memset(fz->edges, 0, EDGE_MAP);
+    return found;
+}
+
+/* Run an input and keep it if it crashed or found something new */
+static void try_input (fuzzer_t *fz, const byte_t *data, size_t len)
+{
+    char name[64];
+    address_t pc;
+    y86_stat_t stat = run_one(fz, data, len, &pc);
+    bool fresh = take_edges(fz, stat == HLT);
+
+    if (stat == ADR || stat == INS) {
+        uint8_t bit = 1 << stat;
+        if (pc < MEMSIZE && !(fz->crashed[pc] & bit)) {
+            fz->crashed[pc] |= bit;
+            snprintf(name, sizeof(name), "id_%06" PRIu64 "_pc_%03" PRIx64
+                     "_%s", fz->crashes, pc, y86_stat_name(stat));
+            write_input(fz, "crashes", name, data, len);
+            fz->crashes++;
+        }
+        return;
+    }
+    if (stat == TMO) {
+        fz->hangs++;
+        return;
+    }
+    if (fresh && fz->nqueue < FUZZ_MAXQUEUE) {
+        entry_t *e = &fz->queue[fz->nqueue];
+        e->data = malloc(len ? len : 1);
+        if (e->data == NULL) {
+            return;
+        }
+        memcpy(e->data, data, len);
+        e->len = len;
+        snprintf(name, sizeof(name), "id_%06d", fz->nqueue);
+        write_input(fz, "queue", name, data, len);
+        fz->nqueue++;
+    }
+}
+
+/* Run every file in dir as a starting input */
+static void add_seeds (fuzzer_t *fz, const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        perror(dir);
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        char path[4096];
+        byte_t data[FUZZ_MAXLEN];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        try_input(fz, data, read_seed(path, data));
+    }
+    closedir(d);
+}
+
+/**********************************************************************
+ *                               DRIVER
+ *********************************************************************/
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> mini-elf-file\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -i dir      Starting inputs (default: one empty input)\n");
+    printf("  -o dir      Output directory (default %s)\n", DEFAULT_OUTDIR);
+    printf("  -n runs     Runs to do (default %d)\n", DEFAULT_RUNS);
+    printf("  -l insts    Instruction limit per run (default %d)\n",
+           DEFAULT_LIMIT);
+    printf("  -T secs     Stop after this long (default none)\n");
+    printf("  -s seed     Random seed (default 1)\n");
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    static fuzzer_t fz;
+    const char *seed_dir = NULL;
+    uint64_t max_runs = DEFAULT_RUNS;
+    double timeout = 0;
+
+    fz.limit = DEFAULT_LIMIT;
+    fz.outdir = DEFAULT_OUTDIR;
+    fz.rng = 1;
+    while ((opt = getopt(argc, argv, "hi:o:n:l:T:s:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'i':
+                seed_dir = optarg;
+                break;
+            case 'o':
+                fz.outdir = optarg;
+                break;
+            case 'n':
+                max_runs = strtoull(optarg, NULL, 0);
+                break;
+            case 'l':
+                fz.limit = strtoull(optarg, NULL, 0);
+                break;
+            case 'T':
+                timeout = atof(optarg);
+                break;
+            case 's':
+                fz.rng = strtoull(optarg, NULL, 0) | 1;
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || fz.limit == 0) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    elf_hdr_t hdr;
+    if (!load_file(argv[optind], fz.pristine, &hdr)) {
+        printf("Failed to read file\n");
+        return EXIT_FAILURE;
+    }
+    char sub[4096];
+    snprintf(sub, sizeof(sub), "%s/queue", fz.outdir);
+    bool dirs = make_dir(fz.outdir) && make_dir(sub);
+    snprintf(sub, sizeof(sub), "%s/crashes", fz.outdir);
+    if (!dirs || !make_dir(sub)) {
+        perror(sub);
+        return EXIT_FAILURE;
+    }
+    if ((fz.eng = engine_new()) == NULL) {
+        printf("Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    init_buckets();
+    io_init(&fz.io, NULL, NULL);
+    engine_set_trap(fz.eng, fuzz_trap, &fz.io);
+    memcpy(fz.memory, fz.pristine, MEMSIZE);
+    fz.start.pc = hdr.e_entry;
+    fz.start.stat = AOK;
+
+    uint64_t start = y86_clock_ns();
+    uint64_t deadline = timeout > 0 ? start + (uint64_t)(timeout * 1e9) : 0;
+
+    static byte_t buf[FUZZ_MAXLEN];
+    if (seed_dir != NULL) {
+        add_seeds(&fz, seed_dir);
+    } else {
+        try_input(&fz, buf, 0);
+    }
+    if (fz.nqueue == 0) {
+        // every starting input crashed or hung: mutate the empty input
+        if ((fz.queue[0].data = malloc(1)) == NULL) {
+            printf("Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        fz.queue[0].len = 0;
+        fz.nqueue = 1;
+    }
+
+    // each turn mutates the next queue entry FUZZ_ROUNDS times
+    for (int cur = 0; fz.runs < max_runs; cur = (cur + 1) % fz.nqueue) {
+        if (deadline != 0 && y86_clock_ns() >= deadline) {
+            break;
+        }
+        for (int r = 0; r < FUZZ_ROUNDS && fz.runs < max_runs; r++) {
+            const entry_t *e = &fz.queue[cur];
+            memcpy(buf, e->data, e->len);
+            size_t len = mutate(&fz, buf, e->len);
+            try_input(&fz, buf, len);
+        }
+    }
+    double secs = (y86_clock_ns() - start) / 1e9;
+
+    printf("%" PRIu64 " runs in %.3f s (%.0f per second)\n", fz.runs, secs,
+           fz.runs / secs);
+    printf("%d inputs in %s/queue, %" PRIu64 " edges\n", fz.nqueue,
+           fz.outdir, fz.nedges);
+    printf("%" PRIu64 " crashes in %s/crashes, %" PRIu64 " runs out of "
+           "budget\n", fz.crashes, fz.outdir, fz.hangs);
+
+    for (int i = 0; i < fz.nqueue; i++) {
+        free(fz.queue[i].data);
+    }
+    io_free(&fz.io);
+    engine_free(fz.eng);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,674 @@
+/*
+ * CS 261: GDB remote stub
+ *
+ * Name: Aiden Smith
+ *
+ * Loads a Mini-ELF program and waits for GDB on a local TCP port, then
+ * serves the GDB remote serial protocol: registers (described to GDB by a
+ * target description), memory reads and writes, single-step, continue,
+ * software breakpoints and write watchpoints. Stepping and continuing use
+ * the predecoded engine, so running to a breakpoint costs no more than
+ * running the program.
+ *
+ *   (gdb) target remote :1234
+ *
+ * Build: gcc -O2 -o y86-gdb y86-gdb.c engine.c outbuf.c p1-check.c
+ *            p2-load.c p3-disas.c
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "engine.h"
+
+#define DEFAULT_PORT 1234
+#define MAXPACKET    4096
+#define RUN_CHUNK    1000000    // instructions between checks for Ctrl-C
+
+/* GDB register numbers after the 15 general-purpose registers */
+#define REG_PC     NUMREGS
+#define REG_EFLAGS (NUMREGS + 1)
+#define NUM_GDB_REGS (NUMREGS + 2)
+
+/* x86-style flag bits, so GDB shows them as names */
+#define EFLAGS_ZF 0x040
+#define EFLAGS_SF 0x080
+#define EFLAGS_OF 0x800
+
+/* Signals reported in stop replies */
+#define SIGNAL_ILL  4
+#define SIGNAL_TRAP 5
+#define SIGNAL_SEGV 11
+
+static const char *reg_names[NUMREGS] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14"
+};
+
+/* The program being debugged */
+static struct {
+    y86_t cpu;
+    byte_t memory[MEMSIZE];
+    y86_engine_t *eng;
+    uint64_t count;
+    int fd;                     // GDB connection
+    bool no_ack;                // QStartNoAckMode in effect
+} target;
+
+/**********************************************************************
+ *                              PACKETS
+ *********************************************************************/
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int hex_value (char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Read one byte from GDB; returns -1 when the connection is gone */
+static int get_byte (void)
+{
+    byte_t c;
+    return read(target.fd, &c, 1) == 1 ? c : -1;
+}
+
+static void put_bytes (const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(target.fd, data, len);
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+/* Send a packet, framed as $data#checksum, until GDB acknowledges it */
+static void put_packet (const char *data)
+{
+    static char buf[2 * MAXPACKET + 8];
+    size_t len = strlen(data);
+    byte_t sum = 0;
+
+    buf[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        buf[i + 1] = data[i];
+        sum += (byte_t)data[i];
+    }
+    buf[len + 1] = '#';
+    buf[len + 2] = hexdigits[sum >> 4];
+    buf[len + 3] = hexdigits[sum & 0xF];
+
+    int c = '+';
+    do {
+        put_bytes(buf, len + 4);
+        if (!target.no_ack) {
+            // resend only on a negative acknowledgement
+            while ((c = get_byte()) != '+' && c != '-' && c != -1) {
+            }
+        }
+    } while (c == '-');
+}
+
+/*
+ * Receive the next packet into buf (NUL-terminated). A lone Ctrl-C byte
+ * outside a packet is returned as the packet "\x03". Returns false when the
+ * connection is closed.
+ */
+static bool get_packet (char *buf, size_t size)
+{
+    while (true) {
+        int c = get_byte();
+        while (c != '$' && c != 0x03) {
+            if (c == -1) {
+                return false;
+            }
+            c = get_byte();
+        }
+        if (c == 0x03) {
+            strcpy(buf, "\x03");
+            return true;
+        }
+
+        size_t len = 0;
+        byte_t sum = 0;
+        while ((c = get_byte()) != '#') {
+            if (c == -1) {
+                return false;
+            }
+            if (len + 1 < size) {
+                buf[len++] = c;
+            }
+            sum += c;
+        }
+        int hi = hex_value(get_byte());
+        int lo = hex_value(get_byte());
+        buf[len] = '\0';
+
+        if (target.no_ack) {
+            return true;
+        }
+        if (hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum) {
+            put_bytes("+", 1);
+            return true;
+        }
+        put_bytes("-", 1);
+    }
+}
+
+/* Append n bytes as hex */
+static char *put_hex (char *out, const byte_t *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        *out++ = hexdigits[data[i] >> 4];
+        *out++ = hexdigits[data[i] & 0xF];
+    }
+    *out = '\0';
+    return out;
+}
+
+/* Parse n bytes of hex; returns false on a bad digit, before writing any
+   of data */
+static bool get_hex (const char *in, byte_t *data, size_t n)
+{
+    for (size_t i = 0; i < 2 * n; i++) {
+        if (hex_value(in[i]) < 0) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        data[i] = (hex_value(in[2 * i]) << 4) | hex_value(in[2 * i + 1]);
+    }
+    return true;
+}
+
+/**********************************************************************
+ *                             REGISTERS
+ *********************************************************************/
+
+/* Register layout for GDB; the sizes must match reg_bytes() */
+static const char *target_xml (void)
+{
+    static char xml[4096];
+    if (xml[0] != '\0') {
+        return xml;
+    }
+    char *p = xml;
+    p += sprintf(p, "<?xml version=\"1.0\"?>\n"
+            "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+            "<target>\n<feature name=\"org.cs261.y86.core\">\n"
+            "<flags id=\"y86_flags\" size=\"4\">\n"
+            "<field name=\"ZF\" start=\"6\" end=\"6\"/>\n"
+            "<field name=\"SF\" start=\"7\" end=\"7\"/>\n"
+            "<field name=\"OF\" start=\"11\" end=\"11\"/>\n"
+            "</flags>\n");
+    for (int r = 0; r < NUMREGS; r++) {
+        p += sprintf(p, "<reg name=\"%s\" bitsize=\"64\" type=\"%s\"/>\n",
+                     reg_names[r], (r == RSP || r == RBP) ? "data_ptr"
+                                                          : "int64");
+    }
+    sprintf(p, "<reg name=\"pc\" bitsize=\"64\" type=\"code_ptr\"/>\n"
+            "<reg name=\"eflags\" bitsize=\"32\" type=\"y86_flags\"/>\n"
+            "</feature>\n</target>\n");
+    return xml;
+}
+
+/* Target-order bytes of GDB register n; returns the size, or 0 */
+static size_t reg_bytes (int n, byte_t *out)
+{
+    uint64_t v;
+    if (n < NUMREGS) {
+        v = target.cpu.reg[n];
+    } else if (n == REG_PC) {
+        v = target.cpu.pc;
+    } else if (n == REG_EFLAGS) {
+        uint32_t f = (target.cpu.zf ? EFLAGS_ZF : 0) |
+                     (target.cpu.sf ? EFLAGS_SF : 0) |
+                     (target.cpu.of ? EFLAGS_OF : 0);
+        memcpy(out, &f, 4);
+        return 4;
+    } else {
+        return 0;
+    }
+    memcpy(out, &v, 8);
+    return 8;
+}
+
+/* Set GDB register n from target-order bytes */
+static void set_reg (int n, const byte_t *in)
+{
+    uint64_t v;
+    if (n == REG_EFLAGS) {
+        uint32_t f;
+        memcpy(&f, in, 4);
+        target.cpu.zf = (f & EFLAGS_ZF) != 0;
+        target.cpu.sf = (f & EFLAGS_SF) != 0;
+        target.cpu.of = (f & EFLAGS_OF) != 0;
+        return;
+    }
+    memcpy(&v, in, 8);
+    if (n == REG_PC) {
+        target.cpu.pc = v;
+    } else if (n < NUMREGS) {
+        target.cpu.reg[n] = v;
+    }
+}
+
+/**********************************************************************
+ *                             EXECUTION
+ *********************************************************************/
+
+/* Has GDB sent Ctrl-C while the program runs? */
+static bool interrupted (void)
+{
+    struct pollfd p = { .fd = target.fd, .events = POLLIN };
+    if (poll(&p, 1, 0) <= 0) {
+        return false;
+    }
+    return get_byte() == 0x03;
+}
+
+/* Stop reply for the current state */
+static void stop_reply (char *out, int signal)
+{
+    switch (target.cpu.stat) {
+        case HLT:
+            strcpy(out, "W00");
+            return;
+        case ADR:
+            signal = SIGNAL_SEGV;
+            break;
+        case INS:
+            signal = SIGNAL_ILL;
+            break;
+        default:
+            break;
+    }
+    if (target.eng->stopped == STOP_WATCH) {
+        sprintf(out, "T%02xwatch:%" PRIx64 ";", SIGNAL_TRAP,
+                target.eng->stop_addr);
+    } else {
+        sprintf(out, "S%02x", signal);
+    }
+}
+
+/* Run one instruction, or until something stops the program */
+static void resume (char *out, bool step)
+{
+    if (target.cpu.stat != AOK) {
+        stop_reply(out, SIGNAL_TRAP);
+        return;
+    }
+    uint64_t limit = step ? 1 : RUN_CHUNK;
+    while (true) {
+        target.count += engine_run(target.eng, &target.cpu, target.memory,
+                                   limit);
+        if (step || target.cpu.stat != AOK ||
+                target.eng->stopped != STOP_NONE) {
+            break;
+        }
+        if (interrupted()) {
+            stop_reply(out, 2);     // SIGINT
+            return;
+        }
+    }
+    stop_reply(out, SIGNAL_TRAP);
+}
+
+/**********************************************************************
+ *                             COMMANDS
+ *********************************************************************/
+
+/* qXfer:features:read:target.xml:offset,length */
+static void read_features (const char *args, char *out)
+{
+    unsigned long off, len;
+    if (sscanf(args, "target.xml:%lx,%lx", &off, &len) != 2) {
+        strcpy(out, "E01");
+        return;
+    }
+    const char *xml = target_xml();
+    size_t size = strlen(xml);
+    if (off >= size) {
+        strcpy(out, "l");
+        return;
+    }
+    if (len > MAXPACKET - 2) {
+        len = MAXPACKET - 2;
+    }
+    size_t n = size - off < len ? size - off : len;
+    out[0] = (off + n < size) ? 'm' : 'l';
+    memcpy(out + 1, xml + off, n);
+    out[n + 1] = '\0';
+}
+
+/* qRcmd: "monitor count" and "monitor state" */
+static void monitor (const char *hex, char *out)
+{
+    char cmd[64] = "";
+    size_t n = strlen(hex) / 2;
+    if (n >= sizeof(cmd) || !get_hex(hex, (byte_t *)cmd, n)) {
+        strcpy(out, "E01");
+        return;
+    }
+    cmd[n] = '\0';
+
+    char text[128];
+    if (strcmp(cmd, "count") == 0) {
+        snprintf(text, sizeof(text), "%" PRIu64 " instructions\n",
+                 target.count);
+    } else if (strcmp(cmd, "state") == 0) {
+        snprintf(text, sizeof(text), "PC 0x%04" PRIx64 " %s, %" PRIu64
+                 " instructions\n", target.cpu.pc,
+                 y86_stat_name(target.cpu.stat),
+                 target.count);
+    } else {
+        snprintf(text, sizeof(text), "monitor commands: count, state\n");
+    }
+    out[0] = 'O';
+    put_hex(out + 1, (const byte_t *)text, strlen(text));
+    put_packet(out);
+    strcpy(out, "OK");
+}
+
+static void read_memory (const char *args, char *out)
+{
+    unsigned long addr, len;
+    if (sscanf(args, "%lx,%lx", &addr, &len) != 2 || addr >= MEMSIZE) {
+        strcpy(out, "E01");
+        return;
+    }
+    if (len > MEMSIZE - addr) {
+        len = MEMSIZE - addr;
+    }
+    if (len > MAXPACKET / 2 - 1) {
+        len = MAXPACKET / 2 - 1;
+    }
+    put_hex(out, &target.memory[addr], len);
+}
+
+static void write_memory (const char *args, char *out)
+{
+    unsigned long addr, len;
+    const char *data = strchr(args, ':');
+    if (sscanf(args, "%lx,%lx", &addr, &len) != 2 || data == NULL ||
+            addr >= MEMSIZE || len > MEMSIZE - addr ||
+            strlen(data + 1) != 2 * len ||
+            !get_hex(data + 1, &target.memory[addr], len)) {
+        strcpy(out, "E01");
+        return;
+    }
+    engine_flush(target.eng);   // the bytes may hold decoded code
+    strcpy(out, "OK");
+}
+
+/* Z/z: type 0 is a software breakpoint, type 2 a write watchpoint */
+static void set_point (const char *args, bool insert, char *out)
+{
+    unsigned type;
+    unsigned long addr, kind;
+    if (sscanf(args, "%u,%lx,%lx", &type, &addr, &kind) != 3) {
+        strcpy(out, "E01");
+        return;
+    }
+    bool ok;
+    if (type == 0) {
+        ok = engine_set_break(target.eng, addr, insert);
+    } else if (type == 2) {
+        ok = insert ? engine_add_watch(target.eng, addr, kind)
+                    : engine_remove_watch(target.eng, addr, kind);
+    } else {
+        out[0] = '\0';          // not supported
+        return;
+    }
+    strcpy(out, ok ? "OK" : "E01");
+}
+
+/* Handle one packet; returns false when the session ends */
+static bool handle (char *in, char *out)
+{
+    byte_t bytes[8];
+    unsigned long n;
+    out[0] = '\0';
+
+    switch (in[0]) {
+        case '?':
+            stop_reply(out, SIGNAL_TRAP);
+            break;
+
+        case 'g': {
+            char *p = out;
+            for (int r = 0; r < NUM_GDB_REGS; r++) {
+                p = put_hex(p, bytes, reg_bytes(r, bytes));
+            }
+            break;
+        }
+
+        case 'G': {
+            // every register, or none of them
+            byte_t regs[NUM_GDB_REGS][8];
+            size_t sizes[NUM_GDB_REGS], total = 0;
+            for (int r = 0; r < NUM_GDB_REGS; r++) {
+                sizes[r] = reg_bytes(r, bytes);
+                total += sizes[r];
+            }
+            const char *p = in + 1;
+            bool ok = strlen(p) == 2 * total;
+            for (int r = 0; ok && r < NUM_GDB_REGS; r++) {
+                ok = get_hex(p, regs[r], sizes[r]);
+                p += 2 * sizes[r];
+            }
+            for (int r = 0; ok && r < NUM_GDB_REGS; r++) {
+                set_reg(r, regs[r]);
+            }
+            strcpy(out, ok ? "OK" : "E01");
+            break;
+        }
+
+        case 'p':
+            n = strtoul(in + 1, NULL, 16);
+            if (n < NUM_GDB_REGS) {
+                put_hex(out, bytes, reg_bytes(n, bytes));
+            } else {
+                strcpy(out, "E01");
+            }
+            break;
+
+        case 'P': {
+            char *eq;
+            n = strtoul(in + 1, &eq, 16);
+            size_t size = n < NUM_GDB_REGS ? reg_bytes(n, bytes) : 0;
+            if (*eq == '=' && size > 0 && strlen(eq + 1) >= 2 * size &&
+                    get_hex(eq + 1, bytes, size)) {
+                set_reg(n, bytes);
+                strcpy(out, "OK");
+            } else {
+                strcpy(out, "E01");
+            }
+            break;
+        }
+
+        case 'm':
+            read_memory(in + 1, out);
+            break;
+
+        case 'M':
+            write_memory(in + 1, out);
+            break;
+
+        case 'c':
+        case 's':
+            if (in[1] != '\0') {
+                target.cpu.pc = strtoull(in + 1, NULL, 16);
+            }
+            resume(out, in[0] == 's');
+            break;
+
+        case 'Z':
+        case 'z':
+            set_point(in + 1, in[0] == 'Z', out);
+            break;
+
+        case 'H':
+            strcpy(out, "OK");      // one thread
+            break;
+
+        case 'T':
+            strcpy(out, "OK");
+            break;
+
+        case 'q':
+            if (strncmp(in, "qSupported", 10) == 0) {
+                sprintf(out, "PacketSize=%x;qXfer:features:read+;"
+                        "QStartNoAckMode+", MAXPACKET);
+            } else if (strncmp(in, "qXfer:features:read:", 20) == 0) {
+                read_features(in + 20, out);
+            } else if (strcmp(in, "qAttached") == 0) {
+                strcpy(out, "1");
+            } else if (strcmp(in, "qC") == 0) {
+                strcpy(out, "QC1");
+            } else if (strcmp(in, "qfThreadInfo") == 0) {
+                strcpy(out, "m1");
+            } else if (strcmp(in, "qsThreadInfo") == 0) {
+                strcpy(out, "l");
+            } else if (strncmp(in, "qRcmd,", 6) == 0) {
+                monitor(in + 6, out);
+            }
+            break;
+
+        case 'Q':
+            if (strcmp(in, "QStartNoAckMode") == 0) {
+                put_packet("OK");
+                target.no_ack = true;
+                return true;
+            }
+            break;
+
+        case 'D':
+            put_packet("OK");
+            return false;
+
+        case 'k':
+            return false;
+
+        case '\x03':
+            stop_reply(out, 2);
+            break;
+
+        default:
+            break;                  // empty reply: not supported
+    }
+    put_packet(out);
+    return true;
+}
+
+/**********************************************************************
+ *                              DRIVER
+ *********************************************************************/
+
+static bool load_file (const char *path, elf_hdr_t *hdr)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = load_program(file, target.memory, hdr);
+    fclose(file);
+    return ok;
+}
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> mini-elf-file\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -p port     Local TCP port to wait for GDB on (default %d)\n",
+           DEFAULT_PORT);
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    int port = DEFAULT_PORT;
+
+    while ((opt = getopt(argc, argv, "hp:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || port <= 0 || port > 65535) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    elf_hdr_t hdr;
+    if (!load_file(argv[optind], &hdr)) {
+        printf("Failed to read file\n");
+        return EXIT_FAILURE;
+    }
+    target.cpu.pc = hdr.e_entry;
+    target.cpu.stat = AOK;
+    target.eng = engine_new();
+    if (target.eng == NULL) {
+        printf("Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // local connections only
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int one = 1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 ||
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(sock, 1) < 0) {
+        perror("listen");
+        return EXIT_FAILURE;
+    }
+    printf("Waiting for GDB on localhost:%d\n", port);
+    fflush(stdout);
+
+    target.fd = accept(sock, NULL, NULL);
+    close(sock);
+    if (target.fd < 0) {
+        perror("accept");
+        return EXIT_FAILURE;
+    }
+    setsockopt(target.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    static char in[MAXPACKET + 1], out[2 * MAXPACKET + 1];
+    while (get_packet(in, sizeof(in)) && handle(in, out)) {
+    }
+    close(target.fd);
+    engine_free(target.eng);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,825 @@
+/*
+ * CS 261: Static binary optimizer
+ *
+ * Name: Aiden Smith
+ *
+ * Reads a Mini-ELF file, recovers its control-flow graph, removes work that
+ * cannot change the program's result and writes a new Mini-ELF with the
+ * code compacted and every jump and call retargeted. Both programs are then
+ * run to compare their final state and instruction counts.
+ *
+ * Build: gcc -O2 -o y86-opt y86-opt.c cfg.c engine.c outbuf.c p1-check.c
+ *            p2-load.c p3-disas.c
+ */
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "p3-disas.h"
+#include "cfg.h"
+#include "engine.h"
+
+#define DEFAULT_LIMIT 100000000ULL
+#define MAXPHDRS      64
+#define MAXSYMS       1024
+#define MAXPASSES     32
+
+/* Liveness sets: one bit per register plus one for the condition codes */
+#define LIVE_FLAGS (1u << 15)
+#define LIVE_ALL   0xFFFFu
+
+/* Instruction being optimized; jump and call targets are still the
+   original addresses until the code is laid out again */
+typedef struct opt_inst {
+    y86_inst_t inst;
+    address_t addr;             // original address
+    bool dead;                  // removed from the program
+    uint16_t live_after;        // registers and flags live after it
+} opt_inst_t;
+
+typedef struct opt_block {
+    y86_bblock_t *blk;          // block in the original program
+    int first, count;           // instructions in insts[]
+    int seg;                    // index of the code segment holding it
+    uint16_t live_in, live_out;
+    address_t fall;             // where control continues after the block
+    bool has_fall;
+    bool add_jump;              // needs a jmp to reach its fall-through
+    address_t new_addr;
+} opt_block_t;
+
+static y86_cfg_t cfg;
+static opt_inst_t insts[MEMSIZE];
+static opt_block_t blocks[MEMSIZE];
+static int ninsts, nblocks;
+
+/* Assume that memory accesses never fault (enables stack rewrites) */
+static bool assume_safe = false;
+
+/**********************************************************************
+ *                             LIVENESS
+ *********************************************************************/
+
+static inline uint16_t reg_bit (y86_regnum_t r)
+{
+    return (r < NOREG) ? (1u << r) : 0;
+}
+
+/* Instructions that can stop the program with ADR */
+static bool may_fault (const y86_inst_t *in)
+{
+    switch (in->icode) {
+        case RMMOVQ: case MRMOVQ: case CALL: case RET: case PUSHQ: case POPQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Registers an instruction reads and writes, and whether it does anything
+ * besides writing them (memory, control flow, I/O or a possible fault).
+ */
+static void use_def (const y86_inst_t *in, uint16_t *use, uint16_t *def,
+        bool *effect)
+{
+    *use = *def = 0;
+    *effect = false;
+
+    switch (in->icode) {
+        case NOP:
+            break;
+        case CMOV:
+            *use = reg_bit(in->ra);
+            *def = reg_bit(in->rb);
+            if (in->ifun.cmov != RRMOVQ) {
+                *use |= reg_bit(in->rb) | LIVE_FLAGS;
+            }
+            break;
+        case IRMOVQ:
+            *def = reg_bit(in->rb);
+            break;
+        case RMMOVQ:
+            *use = reg_bit(in->ra) | reg_bit(in->rb);
+            *effect = true;
+            break;
+        case MRMOVQ:
+            *use = reg_bit(in->rb);
+            *def = reg_bit(in->ra);
+            *effect = true;
+            break;
+        case OPQ:
+            *use = reg_bit(in->ra) | reg_bit(in->rb);
+            *def = reg_bit(in->rb) | LIVE_FLAGS;
+            break;
+        case JUMP:
+            *use = (in->ifun.jump != JMP) ? LIVE_FLAGS : 0;
+            *effect = true;
+            break;
+        case CALL:
+            *use = *def = reg_bit(RSP);
+            *effect = true;
+            break;
+        case PUSHQ:
+            *use = reg_bit(in->ra) | reg_bit(RSP);
+            *def = reg_bit(RSP);
+            *effect = true;
+            break;
+        case POPQ:
+            *use = reg_bit(RSP);
+            *def = reg_bit(RSP) | reg_bit(in->ra);
+            *effect = true;
+            break;
+        default:
+            // halt, ret and iotrap: the whole state is observable (or
+            // returned to code that is not analyzed here)
+            *use = LIVE_ALL;
+            *effect = true;
+            break;
+    }
+
+    // a fault ends the program, so everything is observable there
+    if (!assume_safe && may_fault(in)) {
+        *use = LIVE_ALL;
+    }
+}
+
+static uint16_t live_at_target (address_t target)
+{
+    y86_bblock_t *blk = cfg_block_at(&cfg, target);
+    return blk ? blocks[blk - cfg.blocks].live_in : LIVE_ALL;
+}
+
+/*
+ * Backward dataflow over the CFG to a fixed point. A return edge carries
+ * nothing since ret already treats everything as live.
+ */
+static void compute_liveness (void)
+{
+    for (int b = 0; b < nblocks; b++) {
+        blocks[b].live_in = 0;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = nblocks - 1; b >= 0; b--) {
+            opt_block_t *ob = &blocks[b];
+            uint16_t live = ob->blk->invalid ? LIVE_ALL : 0;
+
+            for (int s = 0; s < ob->blk->nsuccs; s++) {
+                if (ob->blk->succs[s].kind != EDGE_RETURN) {
+                    live |= live_at_target(ob->blk->succs[s].target);
+                }
+            }
+            ob->live_out = live;
+
+            for (int i = ob->first + ob->count - 1; i >= ob->first; i--) {
+                insts[i].live_after = live;
+                if (insts[i].dead) {
+                    continue;
+                }
+                uint16_t use, def;
+                bool effect;
+                use_def(&insts[i].inst, &use, &def, &effect);
+                live = (live & ~def) | use;
+            }
+            if (live != ob->live_in) {
+                ob->live_in = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Remove instructions whose only effect is writing dead registers */
+static int eliminate_dead_code (void)
+{
+    int removed = 0;
+
+    for (int i = 0; i < ninsts; i++) {
+        uint16_t use, def;
+        bool effect;
+        if (insts[i].dead) {
+            continue;
+        }
+        use_def(&insts[i].inst, &use, &def, &effect);
+        if (!effect && (def & insts[i].live_after) == 0) {
+            insts[i].dead = true;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/**********************************************************************
+ *                            PEEPHOLE
+ *********************************************************************/
+
+/* Per-block value numbers: registers with equal numbers hold equal values */
+typedef struct {
+    int vn[NOREG];
+    bool known[NOREG];
+    int64_t val[NOREG];
+    int next;
+} values_t;
+
+static void set_unknown (values_t *v, y86_regnum_t r)
+{
+    v->vn[r] = v->next++;
+    v->known[r] = false;
+}
+
+static void set_const (values_t *v, y86_regnum_t r, int64_t val)
+{
+    v->vn[r] = v->next++;
+    for (int s = 0; s < NOREG; s++) {
+        if (s != (int)r && v->known[s] && v->val[s] == val) {
+            v->vn[r] = v->vn[s];
+            break;
+        }
+    }
+    v->known[r] = true;
+    v->val[r] = val;
+}
+
+static int64_t fold_op (y86_op_t op, int64_t a, int64_t b)
+{
+    switch (op) {
+        case ADD: return (int64_t)((uint64_t)b + (uint64_t)a);
+        case SUB: return (int64_t)((uint64_t)b - (uint64_t)a);
+        case AND: return b & a;
+        default:  return b ^ a;
+    }
+}
+
+/*
+ * Simplify one block: drop nops and moves of a value into a register that
+ * already holds it, fold operations on known constants into irmovq (when
+ * the condition codes they set are dead) and, when memory accesses are
+ * assumed safe, turn an adjacent pushq/popq pair into a register move.
+ */
+static int peephole (opt_block_t *ob)
+{
+    values_t v = { .next = NOREG };
+    opt_inst_t *prev = NULL;
+    int changes = 0;
+
+    for (int r = 0; r < NOREG; r++) {
+        v.vn[r] = r;
+        v.known[r] = false;
+    }
+
+    for (int i = ob->first; i < ob->first + ob->count; i++) {
+        opt_inst_t *oi = &insts[i];
+        y86_inst_t *in = &oi->inst;
+        if (oi->dead) {
+            continue;
+        }
+
+        if (in->icode == POPQ && assume_safe && prev != NULL &&
+                prev->inst.icode == PUSHQ) {
+            y86_regnum_t src = prev->inst.ra;
+            prev->dead = true;
+            in->icode = CMOV;
+            in->ifun.cmov = RRMOVQ;
+            in->rb = in->ra;
+            in->ra = src;
+            changes++;
+        }
+
+        switch (in->icode) {
+            case NOP:
+                oi->dead = true;
+                break;
+
+            case IRMOVQ:
+                if (v.known[in->rb] && v.val[in->rb] == in->valC.d) {
+                    oi->dead = true;
+                } else {
+                    set_const(&v, in->rb, in->valC.d);
+                }
+                break;
+
+            case CMOV:
+                if (v.vn[in->ra] == v.vn[in->rb]) {
+                    oi->dead = true;        // moves a value onto itself
+                } else if (in->ifun.cmov == RRMOVQ) {
+                    v.vn[in->rb] = v.vn[in->ra];
+                    v.known[in->rb] = v.known[in->ra];
+                    v.val[in->rb] = v.val[in->ra];
+                } else {
+                    set_unknown(&v, in->rb);
+                }
+                break;
+
+            case OPQ:
+                if (v.known[in->ra] && v.known[in->rb] &&
+                        !(oi->live_after & LIVE_FLAGS)) {
+                    int64_t val = fold_op(in->ifun.op, v.val[in->ra],
+                                          v.val[in->rb]);
+                    in->icode = IRMOVQ;
+                    in->ifun.b = 0;
+                    in->ra = NOREG;
+                    in->valC.d = val;
+                    set_const(&v, in->rb, val);
+                    changes++;
+                } else {
+                    set_unknown(&v, in->rb);
+                }
+                break;
+
+            case MRMOVQ:
+                set_unknown(&v, in->ra);
+                break;
+
+            case POPQ:
+                set_unknown(&v, in->ra);
+                set_unknown(&v, RSP);
+                break;
+
+            case PUSHQ:
+            case CALL:
+            case RET:
+                set_unknown(&v, RSP);
+                break;
+
+            default:
+                break;
+        }
+        if (oi->dead) {
+            changes++;
+        } else {
+            prev = oi;
+        }
+    }
+    return changes;
+}
+
+/**********************************************************************
+ *                      LAYOUT AND RELOCATION
+ *********************************************************************/
+
+static int find_segment (elf_phdr_t *phdrs, int nphdrs, y86_bblock_t *blk)
+{
+    for (int s = 0; s < nphdrs; s++) {
+        if (phdrs[s].p_type == CODE && blk->start >= phdrs[s].p_vaddr &&
+                blk->end <= phdrs[s].p_vaddr + phdrs[s].p_size) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+static address_t relocate (address_t target)
+{
+    y86_bblock_t *blk = cfg_block_at(&cfg, target);
+    return blk ? blocks[blk - cfg.blocks].new_addr : target;
+}
+
+static opt_inst_t *last_live (opt_block_t *ob)
+{
+    for (int i = ob->first + ob->count - 1; i >= ob->first; i--) {
+        if (!insts[i].dead) {
+            return &insts[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Place the blocks of each code segment back to back in their original
+ * order. An unconditional jump to the next block is dropped; a block whose
+ * fall-through (or return site) no longer follows it gets a jmp. Returns
+ * false if a segment no longer fits where it was.
+ */
+static bool layout (elf_phdr_t *phdrs, int nphdrs, address_t *seg_size)
+{
+    for (int b = 0; b < nblocks; b++) {
+        opt_block_t *ob = &blocks[b];
+        bool has_next = b + 1 < nblocks && blocks[b + 1].seg == ob->seg;
+        address_t next = has_next ? blocks[b + 1].blk->start : 0;
+
+        opt_inst_t *last = last_live(ob);
+        if (last && last->inst.icode == JUMP && last->inst.ifun.jump == JMP &&
+                has_next && last->inst.valC.dest == next) {
+            last->dead = true;
+            ob->has_fall = true;
+            ob->fall = next;
+        }
+        ob->add_jump = ob->has_fall && !(has_next && ob->fall == next);
+    }
+
+    for (int s = 0; s < nphdrs; s++) {
+        seg_size[s] = (phdrs[s].p_type == CODE) ? 0 : phdrs[s].p_size;
+    }
+
+    address_t addr = 0;
+    for (int b = 0; b < nblocks; b++) {
+        opt_block_t *ob = &blocks[b];
+        if (b == 0 || blocks[b - 1].seg != ob->seg) {
+            addr = phdrs[ob->seg].p_vaddr;
+        }
+        ob->new_addr = addr;
+        for (int i = ob->first; i < ob->first + ob->count; i++) {
+            if (!insts[i].dead) {
+                addr += opcode_table[(insts[i].inst.icode << 4) |
+                                     insts[i].inst.ifun.b].len;
+            }
+        }
+        if (ob->add_jump) {
+            addr += 9;
+        }
+        seg_size[ob->seg] = addr - phdrs[ob->seg].p_vaddr;
+    }
+
+    // a grown segment must not run into another one
+    for (int s = 0; s < nphdrs; s++) {
+        address_t end = phdrs[s].p_vaddr + seg_size[s];
+        if (end > MEMSIZE) {
+            return false;
+        }
+        for (int t = 0; t < nphdrs && seg_size[s] > phdrs[s].p_size; t++) {
+            if (t != s && phdrs[t].p_size > 0 && phdrs[t].p_vaddr < end &&
+                    phdrs[t].p_vaddr + phdrs[t].p_size > phdrs[s].p_vaddr) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Encode the laid-out code of segment s into out */
+static void emit_code (int s, address_t base, byte_t *out)
+{
+    for (int b = 0; b < nblocks; b++) {
+        opt_block_t *ob = &blocks[b];
+        if (ob->seg != s) {
+            continue;
+        }
+        address_t at = ob->new_addr - base;
+        for (int i = ob->first; i < ob->first + ob->count; i++) {
+            if (insts[i].dead) {
+                continue;
+            }
+            y86_inst_t in = insts[i].inst;
+            if (in.icode == JUMP || in.icode == CALL) {
+                in.valC.dest = relocate(in.valC.dest);
+            }
+            at += encode_inst(&in, &out[at]);
+        }
+        if (ob->add_jump) {
+            y86_inst_t jmp = { .icode = JUMP, .ifun.jump = JMP,
+                               .ra = NOREG, .rb = NOREG };
+            jmp.valC.dest = relocate(ob->fall);
+            at += encode_inst(&jmp, &out[at]);
+        }
+    }
+}
+
+/**********************************************************************
+ *                            FILE I/O
+ *********************************************************************/
+
+/* Whole input file with its parsed headers */
+typedef struct image {
+    byte_t *data;
+    size_t size;
+    elf_hdr_t hdr;
+    elf_phdr_t phdrs[MAXPHDRS];
+    elf_sym_t syms[MAXSYMS];
+    int nsyms;
+    byte_t memory[MEMSIZE];
+} image_t;
+
+static bool load_file (const char *path, image_t *img)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = read_header(file, &img->hdr) && img->hdr.e_num_phdr <= MAXPHDRS;
+    memset(img->memory, 0, MEMSIZE);
+    for (int i = 0; ok && i < img->hdr.e_num_phdr; i++) {
+        ok = read_phdr(file, img->hdr.e_phdr_start + i * sizeof(elf_phdr_t),
+                       &img->phdrs[i]) &&
+             load_segment(file, img->memory, &img->phdrs[i]);
+    }
+    if (ok) {
+        img->nsyms = read_symbols(file, &img->hdr, img->syms, MAXSYMS);
+        fseek(file, 0, SEEK_END);
+        img->size = ftell(file);
+        img->data = malloc(img->size);
+        rewind(file);
+        ok = img->data != NULL &&
+             fread(img->data, 1, img->size, file) == img->size;
+    }
+    fclose(file);
+    return ok;
+}
+
+/*
+ * Write the optimized image: header, program headers, the segments back to
+ * back (code segments replaced by code), then the symbol and string tables
+ * copied with code symbols relocated.
+ */
+static bool write_file (const char *path, image_t *img, address_t *seg_size)
+{
+    elf_hdr_t hdr = img->hdr;
+    int nphdrs = hdr.e_num_phdr;
+    elf_phdr_t phdrs[MAXPHDRS];
+    static byte_t code[MEMSIZE];
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint32_t offset = sizeof(elf_hdr_t) + nphdrs * sizeof(elf_phdr_t);
+    hdr.e_entry = relocate(hdr.e_entry);
+    hdr.e_phdr_start = sizeof(elf_hdr_t);
+    for (int s = 0; s < nphdrs; s++) {
+        phdrs[s] = img->phdrs[s];
+        phdrs[s].p_offset = offset;
+        phdrs[s].p_size = seg_size[s];
+        offset += seg_size[s];
+    }
+
+    // symbol table and string table (which runs to the end of the file)
+    size_t strtab_len = 0;
+    hdr.e_symtab = 0;
+    if (img->nsyms > 0) {
+        hdr.e_symtab = offset;
+        offset += img->nsyms * sizeof(elf_sym_t);
+    }
+    if (hdr.e_strtab != 0 && hdr.e_strtab < img->size) {
+        strtab_len = img->size - img->hdr.e_strtab;
+        hdr.e_strtab = offset;
+        offset += strtab_len;
+    } else {
+        hdr.e_strtab = 0;
+    }
+    if (offset > UINT16_MAX) {
+        fclose(file);
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+              fwrite(phdrs, sizeof(elf_phdr_t), nphdrs, file) == (size_t)nphdrs;
+    for (int s = 0; ok && s < nphdrs; s++) {
+        const byte_t *bytes = &img->memory[img->phdrs[s].p_vaddr];
+        if (img->phdrs[s].p_type == CODE) {
+            memset(code, 0, sizeof(code));
+            emit_code(s, img->phdrs[s].p_vaddr, code);
+            bytes = code;
+        }
+        ok = fwrite(bytes, 1, seg_size[s], file) == seg_size[s];
+    }
+    for (int i = 0; ok && i < img->nsyms; i++) {
+        elf_sym_t sym = img->syms[i];
+        sym.st_value = relocate(sym.st_value);
+        ok = fwrite(&sym, sizeof(sym), 1, file) == 1;
+    }
+    if (ok && strtab_len > 0) {
+        ok = fwrite(&img->data[img->hdr.e_strtab], 1, strtab_len, file) ==
+             strtab_len;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+/**********************************************************************
+ *                           VERIFICATION
+ *********************************************************************/
+
+static bool in_segment (image_t *img, elf_segtype_t type, address_t addr)
+{
+    for (int s = 0; s < img->hdr.e_num_phdr; s++) {
+        elf_phdr_t *p = &img->phdrs[s];
+        if (p->p_type == type && addr >= p->p_vaddr &&
+                addr < p->p_vaddr + p->p_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Run an image from its entry point; returns the instruction count */
+static uint64_t run_image (image_t *img, y86_t *cpu, byte_t *memory,
+        uint64_t limit)
+{
+    y86_engine_t *eng = engine_new();
+    uint64_t count = 0;
+
+    memcpy(memory, img->memory, MEMSIZE);
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->pc = img->hdr.e_entry;
+    cpu->stat = AOK;
+    if (eng != NULL) {
+        count = engine_run(eng, cpu, memory, limit);
+        engine_free(eng);
+    }
+    return count;
+}
+
+/*
+ * Compare the final states: status, registers, flags and every byte of
+ * memory outside the code segments and outside the part of the stack
+ * segment below the final %rsp. The PC moves with the code, and so do the
+ * return addresses left behind on the stack, so both are skipped.
+ */
+static bool same_state (image_t *a, y86_t *ca, byte_t *ma, image_t *b,
+        y86_t *cb, byte_t *mb)
+{
+    if (ca->stat != cb->stat || ca->zf != cb->zf || ca->sf != cb->sf ||
+            ca->of != cb->of || memcmp(ca->reg, cb->reg, sizeof(ca->reg))) {
+        return false;
+    }
+    for (address_t addr = 0; addr < MEMSIZE; addr++) {
+        if (ma[addr] == mb[addr] || in_segment(a, CODE, addr) ||
+                in_segment(b, CODE, addr)) {
+            continue;
+        }
+        if (addr < ca->reg[RSP] &&
+                in_segment(a, STACK, addr)) {
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/**********************************************************************
+ *                              DRIVER
+ *********************************************************************/
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> input-file output-file\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -S          Assume memory accesses never fault (allows stack\n");
+    printf("              rewrites such as removing pushq/popq pairs)\n");
+    printf("  -i insts    Instruction limit for the comparison runs "
+           "(default %llu)\n", DEFAULT_LIMIT);
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    uint64_t limit = DEFAULT_LIMIT;
+
+    while ((opt = getopt(argc, argv, "hSi:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'S':
+                assume_safe = true;
+                break;
+            case 'i':
+                limit = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 2 != argc) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    static image_t in, out;
+    if (!load_file(argv[optind], &in)) {
+        printf("Failed to read file\n");
+        return EXIT_FAILURE;
+    }
+    int nphdrs = in.hdr.e_num_phdr;
+
+    // recover the code from the entry point and the code symbols
+    address_t roots[MAXSYMS + 1];
+    int nroots = 0;
+    roots[nroots++] = in.hdr.e_entry;
+    for (int i = 0; i < in.nsyms; i++) {
+        for (int s = 0; s < nphdrs; s++) {
+            elf_phdr_t *p = &in.phdrs[s];
+            if (p->p_type == CODE && in.syms[i].st_value >= p->p_vaddr &&
+                    in.syms[i].st_value < p->p_vaddr + p->p_size) {
+                roots[nroots++] = in.syms[i].st_value;
+                break;
+            }
+        }
+    }
+    cfg_build(&cfg, in.memory, roots, nroots);
+
+    nblocks = cfg.nblocks;
+    ninsts = 0;
+    for (int b = 0; b < nblocks; b++) {
+        opt_block_t *ob = &blocks[b];
+        ob->blk = &cfg.blocks[b];
+        ob->seg = find_segment(in.phdrs, nphdrs, ob->blk);
+        if (ob->seg < 0) {
+            printf("Code at 0x%03lx lies outside the code segments\n",
+                   ob->blk->start);
+            return EXIT_FAILURE;
+        }
+        for (int s = 0; s < ob->blk->nsuccs; s++) {
+            y86_edge_t kind = ob->blk->succs[s].kind;
+            if (kind == EDGE_FALL || kind == EDGE_RETURN) {
+                ob->has_fall = true;
+                ob->fall = ob->blk->succs[s].target;
+            }
+        }
+
+        ob->first = ninsts;
+        address_t pc = ob->blk->start;
+        for (int i = 0; i < ob->blk->ninsts; i++) {
+            y86_stat_t stat;
+            insts[ninsts].inst = decode(in.memory, pc, &stat);
+            insts[ninsts].addr = pc;
+            insts[ninsts].dead = false;
+            pc = insts[ninsts++].inst.valP;
+        }
+        ob->count = ninsts - ob->first;
+    }
+
+    // a block that runs into an invalid instruction must still fault there
+    for (int b = 0; b < nblocks; b++) {
+        if (blocks[b].blk->invalid) {
+            printf("Code at 0x%03lx runs into an invalid instruction\n",
+                   blocks[b].blk->end);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // optimize to a fixed point
+    for (int pass = 0; pass < MAXPASSES; pass++) {
+        int changes = 0;
+        compute_liveness();
+        changes += eliminate_dead_code();
+        compute_liveness();
+        for (int b = 0; b < nblocks; b++) {
+            changes += peephole(&blocks[b]);
+        }
+        if (changes == 0) {
+            break;
+        }
+    }
+
+    address_t seg_size[MAXPHDRS];
+    if (!layout(in.phdrs, nphdrs, seg_size)) {
+        printf("Optimized code does not fit in its segment\n");
+        return EXIT_FAILURE;
+    }
+    if (!write_file(argv[optind + 1], &in, seg_size)) {
+        printf("Failed to write file\n");
+        return EXIT_FAILURE;
+    }
+    if (!load_file(argv[optind + 1], &out)) {
+        printf("Failed to read back the optimized file\n");
+        return EXIT_FAILURE;
+    }
+
+    // static counts: every reachable instruction before, emitted ones after
+    int kept = 0, jumps_added = 0;
+    address_t old_bytes = 0, new_bytes = 0;
+    for (int i = 0; i < ninsts; i++) {
+        kept += !insts[i].dead;
+    }
+    for (int b = 0; b < nblocks; b++) {
+        jumps_added += blocks[b].add_jump;
+    }
+    for (int s = 0; s < nphdrs; s++) {
+        if (in.phdrs[s].p_type == CODE) {
+            old_bytes += in.phdrs[s].p_size;
+            new_bytes += seg_size[s];
+        }
+    }
+    kept += jumps_added;
+
+    printf("Static:  %d -> %d instructions (%+.1f%%), %lu -> %lu code bytes, "
+           "%d blocks\n", ninsts, kept,
+           ninsts ? 100.0 * (kept - ninsts) / ninsts : 0.0,
+           old_bytes, new_bytes, nblocks);
+
+    // dynamic counts and final state
+    static byte_t mem_a[MEMSIZE], mem_b[MEMSIZE];
+    y86_t cpu_a, cpu_b;
+    uint64_t count_a = run_image(&in, &cpu_a, mem_a, limit);
+    uint64_t count_b = run_image(&out, &cpu_b, mem_b, limit);
+
+    printf("Dynamic: %lu -> %lu instructions (%+.1f%%)\n", count_a, count_b,
+           count_a ? 100.0 * ((double)count_b - count_a) / count_a : 0.0);
+
+    if (cpu_a.stat == AOK || cpu_b.stat == AOK) {
+        printf("Final state: not compared (still running after %lu "
+               "instructions)\n", limit);
+        return EXIT_SUCCESS;
+    }
+    if (!same_state(&in, &cpu_a, mem_a, &out, &cpu_b, mem_b)) {
+        printf("Final state: DIFFERENT\n");
+        return EXIT_FAILURE;
+    }
+    printf("Final state: identical\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/*
+ * CS 261: VM scheduler driver
+ *
+ * Name: Aiden Smith
+ *
+ * Runs many copies of a Mini-ELF program on a few worker threads. Every
+ * copy reads the same input file through IOTRAP. The driver queues the
+ * whole file for every copy as soon as they are added, in -c sized chunks,
+ * and reports how each copy ended.
+ *
+ * Build: gcc -O2 -pthread -o y86-sched y86-sched.c sched.c io.c engine.c
+ *            outbuf.c p1-check.c p2-load.c p3-disas.c
+ */
+
+#include <inttypes.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "sched.h"
+
+#define DEFAULT_VMS     64
+#define DEFAULT_THREADS 4
+#define DEFAULT_CHUNK   16
+
+static bool load_file (const char *path, byte_t *memory, elf_hdr_t *hdr)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = load_program(file, memory, hdr);
+    fclose(file);
+    return ok;
+}
+
+static byte_t *read_input (const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    byte_t *data = malloc(*size + 1);
+    if (data != NULL && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> mini-elf-file\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -n vms      Number of copies to run (default %d)\n",
+           DEFAULT_VMS);
+    printf("  -t threads  Worker threads (default %d)\n", DEFAULT_THREADS);
+    printf("  -q insts    Instructions per turn (default %d)\n",
+           DEFAULT_QUANTUM);
+    printf("  -l insts    Instruction limit per copy (default none)\n");
+    printf("  -T secs     Time limit per copy (default none)\n");
+    printf("  -i file     Input for every copy (default none)\n");
+    printf("  -c bytes    Input chunk size (default %d)\n", DEFAULT_CHUNK);
+    printf("  -o          Print the output of the first copy\n");
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    int nvms = DEFAULT_VMS, nthreads = DEFAULT_THREADS;
+    uint64_t quantum = DEFAULT_QUANTUM, limit = 0;
+    size_t chunk = DEFAULT_CHUNK;
+    double timeout = 0;
+    const char *input_path = NULL;
+    bool show_output = false;
+
+    while ((opt = getopt(argc, argv, "hn:t:q:l:T:i:c:o")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'n':
+                nvms = atoi(optarg);
+                break;
+            case 't':
+                nthreads = atoi(optarg);
+                break;
+            case 'q':
+                quantum = strtoull(optarg, NULL, 0);
+                break;
+            case 'l':
+                limit = strtoull(optarg, NULL, 0);
+                break;
+            case 'T':
+                timeout = atof(optarg);
+                break;
+            case 'i':
+                input_path = optarg;
+                break;
+            case 'c':
+                chunk = strtoull(optarg, NULL, 0);
+                break;
+            case 'o':
+                show_output = true;
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || nvms < 1 || nthreads < 1 || chunk == 0) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    static byte_t image[MEMSIZE];
+    elf_hdr_t hdr;
+    if (!load_file(argv[optind], image, &hdr)) {
+        printf("Failed to read file\n");
+        return EXIT_FAILURE;
+    }
+    size_t input_size = 0;
+    byte_t *input = NULL;
+    if (input_path != NULL &&
+            (input = read_input(input_path, &input_size)) == NULL) {
+        printf("Failed to read input\n");
+        return EXIT_FAILURE;
+    }
+
+    y86_vm_t **vms = calloc(nvms, sizeof(y86_vm_t *));
+    y86_sched_t *sched = sched_new(nthreads, quantum);
+    if (vms == NULL || sched == NULL) {
+        printf("Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    uint64_t start = y86_clock_ns();
+    for (int i = 0; i < nvms; i++) {
+        vms[i] = vm_new(image, hdr.e_entry);
+        if (vms[i] == NULL) {
+            printf("Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        vms[i]->limit = limit;
+        if (timeout > 0) {
+            vms[i]->eng->deadline = start + (uint64_t)(timeout * 1e9);
+        }
+        sched_add(sched, vms[i]);
+    }
+
+    // queue the input a chunk at a time; copies already running may read
+    // past what has been queued so far, and park until the rest arrives
+    for (size_t pos = 0; pos < input_size; pos += chunk) {
+        size_t len = input_size - pos < chunk ? input_size - pos : chunk;
+        for (int i = 0; i < nvms; i++) {
+            sched_input(sched, vms[i], input + pos, len, false);
+        }
+    }
+    for (int i = 0; i < nvms; i++) {
+        sched_input(sched, vms[i], NULL, 0, true);
+    }
+    sched_wait(sched);
+    double secs = (y86_clock_ns() - start) / 1e9;
+
+    uint64_t total = 0;
+    int ended[TMO + 1] = { 0 };
+    for (int i = 0; i < nvms; i++) {
+        total += vms[i]->count;
+        ended[vms[i]->cpu.stat]++;
+    }
+    if (show_output) {
+        fwrite(vms[0]->io.out, 1, vms[0]->io.out_len, stdout);
+        printf("\n");
+    }
+    printf("%d VMs on %d threads: %" PRIu64 " instructions in %.3f s "
+           "(%.1f MIPS)\n", nvms, nthreads, total, secs, total / secs / 1e6);
+    printf("%" PRIu64 " turns, %" PRIu64 " waits for input\n",
+           sched->switches, sched->parks);
+    for (int s = AOK; s <= TMO; s++) {
+        if (ended[s] > 0) {
+            printf("  %s: %d\n", y86_stat_name(s), ended[s]);
+        }
+    }
+
+    sched_free(sched);
+    for (int i = 0; i < nvms; i++) {
+        vm_free(vms[i]);
+    }
+    free(vms);
+    free(input);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,450 @@
+/*
+ * CS 261: Local execution server
+ *
+ * Name: Aiden Smith
+ *
+ * Long-running daemon that runs Mini-ELF programs for clients on a Unix
+ * domain socket (protocol in proto.h). Loaded images are cached by SHA-256
+ * digest, so a client can send just the digest after the first request, and
+ * finished VMs go back to a pool to be reused with their memory, buffers
+ * and decoded code instead of being allocated again. Requests are run by
+ * the scheduler in sched.c.
+ *
+ * Build: gcc -O2 -pthread -o y86-server y86-server.c proto.c sched.c io.c
+ *            engine.c outbuf.c p1-check.c p2-load.c p3-disas.c
+ */
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "p1-check.h"
+#include "p2-load.h"
+#include "proto.h"
+#include "sched.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_LIMIT   100000000ULL
+#define DEFAULT_CACHE   64
+#define CACHE_BUCKETS   256
+
+/* Loaded image, ready to be copied into a VM */
+typedef struct cached {
+    proto_digest_t digest;
+    address_t entry;
+    uint64_t used;              // last use, for eviction
+    struct cached *next;        // bucket chain
+    byte_t memory[MEMSIZE];
+} cached_t;
+
+/* VM kept for reuse, with the image it last ran */
+typedef struct pooled {
+    y86_vm_t *vm;
+    proto_digest_t digest;
+    struct pooled *next;
+} pooled_t;
+
+/* Request in flight */
+typedef struct job {
+    pooled_t *slot;
+    bool finished;
+} job_t;
+
+static struct {
+    pthread_mutex_t lock;       // cache, pool and job completion
+    pthread_cond_t finished;
+    cached_t *buckets[CACHE_BUCKETS];
+    int ncached, max_cached;
+    uint64_t clock;
+    pooled_t *pool;
+    y86_sched_t *sched;
+    uint64_t max_limit;
+} srv = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+
+/**********************************************************************
+ *                            IMAGE CACHE
+ *********************************************************************/
+
+static bool same_digest (const proto_digest_t *a, const proto_digest_t *b)
+{
+    return memcmp(a->b, b->b, PROTO_DIGEST) == 0;
+}
+
+/* Cache bucket of an image; the digest is already uniformly distributed */
+static unsigned bucket (const proto_digest_t *digest)
+{
+    return digest->b[0] % CACHE_BUCKETS;
+}
+
+/* Find a cached image, matching the whole digest; called with the lock
+   held */
+static cached_t *cache_find (const proto_digest_t *digest)
+{
+    for (cached_t *c = srv.buckets[bucket(digest)]; c; c = c->next) {
+        if (same_digest(&c->digest, digest)) {
+            c->used = ++srv.clock;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/* Drop the least recently used image; called with the lock held */
+static void cache_evict (void)
+{
+    cached_t **victim = NULL;
+    for (int b = 0; b < CACHE_BUCKETS; b++) {
+        for (cached_t **c = &srv.buckets[b]; *c; c = &(*c)->next) {
+            if (victim == NULL || (*c)->used < (*victim)->used) {
+                victim = c;
+            }
+        }
+    }
+    cached_t *dead = *victim;
+    *victim = dead->next;
+    free(dead);
+    srv.ncached--;
+}
+
+/* Parse a Mini-ELF file held in memory */
+static bool load_image (byte_t *data, size_t len, cached_t *c)
+{
+    FILE *file = fmemopen(data, len, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    elf_hdr_t hdr;
+    bool ok = load_program(file, c->memory, &hdr);
+    fclose(file);
+    c->entry = hdr.e_entry;
+    return ok;
+}
+
+/* Load and cache an image unless it is cached already */
+static proto_result_t cache_add (byte_t *data, size_t len,
+        const proto_digest_t *digest)
+{
+    pthread_mutex_lock(&srv.lock);
+    bool known = cache_find(digest) != NULL;
+    pthread_mutex_unlock(&srv.lock);
+    if (known) {
+        return PROTO_OK;
+    }
+
+    cached_t *c = malloc(sizeof(cached_t));
+    if (c == NULL) {
+        return PROTO_BUSY;
+    }
+    if (!load_image(data, len, c)) {
+        free(c);
+        return PROTO_BAD_IMAGE;
+    }
+    c->digest = *digest;
+
+    pthread_mutex_lock(&srv.lock);
+    if (cache_find(digest) != NULL) {
+        free(c);                // another connection loaded it meanwhile
+    } else {
+        if (srv.ncached >= srv.max_cached) {
+            cache_evict();
+        }
+        c->used = ++srv.clock;
+        c->next = srv.buckets[bucket(digest)];
+        srv.buckets[bucket(digest)] = c;
+        srv.ncached++;
+    }
+    pthread_mutex_unlock(&srv.lock);
+    return PROTO_OK;
+}
+
+/**********************************************************************
+ *                              VM POOL
+ *********************************************************************/
+
+/* Whether the code a VM has decoded is unchanged from the image, so that
+   its decoded blocks stay valid once the image is copied back */
+static bool code_intact (y86_vm_t *vm, const byte_t *image)
+{
+    for (int p = 0; p < NUMPAGES; p++) {
+        if ((vm->eng->code_pages[p / 64] >> (p % 64)) & 1) {
+            size_t at = (size_t)p << PAGEBITS;
+            if (memcmp(&vm->memory[at], &image[at], 1 << PAGEBITS) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Take a VM from the pool (preferring one that last ran the same image, so
+ * its decoded code can be kept) and reset it to the start of the image.
+ */
+static pooled_t *pool_get (const proto_digest_t *digest, uint64_t limit,
+        uint32_t timeout_ms)
+{
+    pthread_mutex_lock(&srv.lock);
+    cached_t *c = cache_find(digest);
+    if (c == NULL) {
+        pthread_mutex_unlock(&srv.lock);
+        return NULL;
+    }
+    pooled_t **pick = &srv.pool;
+    for (pooled_t **p = &srv.pool; *p; p = &(*p)->next) {
+        if (same_digest(&(*p)->digest, digest)) {
+            pick = p;
+            break;
+        }
+    }
+    pooled_t *slot = *pick;
+    if (slot != NULL) {
+        *pick = slot->next;
+    } else if ((slot = calloc(1, sizeof(pooled_t))) == NULL ||
+            (slot->vm = vm_new(c->memory, c->entry)) == NULL) {
+        free(slot);
+        pthread_mutex_unlock(&srv.lock);
+        return NULL;
+    }
+
+    y86_vm_t *vm = slot->vm;
+    if (!same_digest(&slot->digest, digest) || !code_intact(vm, c->memory)) {
+        engine_flush(vm->eng);
+    }
+    memcpy(vm->memory, c->memory, MEMSIZE);
+    memset(&vm->cpu, 0, sizeof(y86_t));
+    vm->cpu.pc = c->entry;
+    pthread_mutex_unlock(&srv.lock);
+
+    vm->cpu.stat = AOK;
+    vm->count = 0;
+    vm->limit = limit;
+    vm->eng->deadline = timeout_ms ? y86_clock_ns() + timeout_ms * 1000000ULL
+                                   : 0;
+    vm->state = VM_NEW;
+    io_reset(&vm->io);
+    io_reset(&vm->pending);
+    slot->digest = *digest;
+    return slot;
+}
+
+static void pool_put (pooled_t *slot)
+{
+    pthread_mutex_lock(&srv.lock);
+    slot->next = srv.pool;
+    srv.pool = slot;
+    pthread_mutex_unlock(&srv.lock);
+}
+
+/**********************************************************************
+ *                             REQUESTS
+ *********************************************************************/
+
+/* Scheduler callback: wake the connection waiting for this VM */
+static void vm_done (y86_sched_t *sched, y86_vm_t *vm)
+{
+    (void)sched;
+    job_t *job = vm->user;
+    pthread_mutex_lock(&srv.lock);
+    job->finished = true;
+    pthread_cond_broadcast(&srv.finished);
+    pthread_mutex_unlock(&srv.lock);
+}
+
+static bool send_reply (int fd, proto_reply_t *reply, y86_vm_t *vm,
+        bool memory)
+{
+    reply->magic = PROTO_MAGIC;
+    if (vm == NULL) {
+        return proto_send(fd, reply, sizeof(*reply));
+    }
+    reply->count = vm->count;
+    reply->cpu = vm->cpu;
+    reply->output_len = vm->io.out_len;
+    reply->memory_len = memory ? MEMSIZE : 0;
+    return proto_send(fd, reply, sizeof(*reply)) &&
+           proto_send(fd, vm->io.out, vm->io.out_len) &&
+           proto_send(fd, vm->memory, reply->memory_len);
+}
+
+/* Run one request; returns false if the connection should be closed */
+static bool handle (int fd, proto_request_t *req, byte_t *image,
+        byte_t *input)
+{
+    proto_reply_t reply;
+    memset(&reply, 0, sizeof(reply));
+
+    reply.digest = (req->flags & PROTO_CACHED) ? req->digest
+                 : proto_digest(image, req->image_len);
+    if (!(req->flags & PROTO_CACHED)) {
+        reply.result = cache_add(image, req->image_len, &reply.digest);
+        if (reply.result != PROTO_OK) {
+            return send_reply(fd, &reply, NULL, false);
+        }
+    }
+
+    uint64_t limit = req->limit;
+    if (limit == 0 || limit > srv.max_limit) {
+        limit = srv.max_limit;
+    }
+    pooled_t *slot = pool_get(&reply.digest, limit, req->timeout_ms);
+    if (slot == NULL) {
+        pthread_mutex_lock(&srv.lock);
+        reply.result = cache_find(&reply.digest) ? PROTO_BUSY : PROTO_UNKNOWN;
+        pthread_mutex_unlock(&srv.lock);
+        return send_reply(fd, &reply, NULL, false);
+    }
+
+    y86_vm_t *vm = slot->vm;
+    job_t job = { .slot = slot, .finished = false };
+    vm->user = &job;
+    if (!io_input(&vm->io, input, req->input_len, true)) {
+        reply.result = PROTO_BUSY;
+        pool_put(slot);
+        return send_reply(fd, &reply, NULL, false);
+    }
+    sched_add(srv.sched, vm);
+
+    pthread_mutex_lock(&srv.lock);
+    while (!job.finished) {
+        pthread_cond_wait(&srv.finished, &srv.lock);
+    }
+    pthread_mutex_unlock(&srv.lock);
+
+    bool ok = send_reply(fd, &reply, vm, req->flags & PROTO_MEMORY);
+    pool_put(slot);
+    return ok;
+}
+
+/* Connection thread: requests one after another until the client leaves */
+static void *serve (void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    byte_t *image = malloc(PROTO_MAXIMAGE);
+    byte_t *input = NULL;
+    size_t input_cap = 0;
+    proto_request_t req;
+
+    while (image != NULL && proto_recv(fd, &req, sizeof(req))) {
+        if (req.magic != PROTO_MAGIC || req.image_len > PROTO_MAXIMAGE ||
+                req.input_len > PROTO_MAXINPUT ||
+                ((req.flags & PROTO_CACHED) && req.image_len != 0)) {
+            proto_reply_t reply = { .result = PROTO_BAD_REQUEST };
+            send_reply(fd, &reply, NULL, false);
+            break;
+        }
+        if (req.input_len > input_cap) {
+            byte_t *p = realloc(input, req.input_len);
+            if (p == NULL) {
+                break;
+            }
+            input = p;
+            input_cap = req.input_len;
+        }
+        if (!proto_recv(fd, image, req.image_len) ||
+                !proto_recv(fd, input, req.input_len) ||
+                !handle(fd, &req, image, input)) {
+            break;
+        }
+    }
+    close(fd);
+    free(image);
+    free(input);
+    return NULL;
+}
+
+/**********************************************************************
+ *                              DRIVER
+ *********************************************************************/
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)>\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -s path     Socket to listen on (default %s)\n", PROTO_SOCKET);
+    printf("  -t threads  Worker threads (default %d)\n", DEFAULT_THREADS);
+    printf("  -q insts    Instructions per turn (default %d)\n",
+           DEFAULT_QUANTUM);
+    printf("  -l insts    Largest instruction budget (default %llu)\n",
+           DEFAULT_LIMIT);
+    printf("  -c images   Images to keep cached (default %d)\n",
+           DEFAULT_CACHE);
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    const char *path = PROTO_SOCKET;
+    int nthreads = DEFAULT_THREADS;
+    uint64_t quantum = DEFAULT_QUANTUM;
+
+    srv.max_limit = DEFAULT_LIMIT;
+    srv.max_cached = DEFAULT_CACHE;
+    while ((opt = getopt(argc, argv, "hs:t:q:l:c:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 's':
+                path = optarg;
+                break;
+            case 't':
+                nthreads = atoi(optarg);
+                break;
+            case 'q':
+                quantum = strtoull(optarg, NULL, 0);
+                break;
+            case 'l':
+                srv.max_limit = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                srv.max_cached = atoi(optarg);
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || nthreads < 1 || srv.max_cached < 1 ||
+            srv.max_limit == 0 || strlen(path) >= sizeof(((struct
+            sockaddr_un *)0)->sun_path)) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    srv.sched = sched_new(nthreads, quantum);
+    if (srv.sched == NULL) {
+        printf("Failed to start worker threads\n");
+        return EXIT_FAILURE;
+    }
+    srv.sched->done = vm_done;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(sock, SOMAXCONN) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    while (true) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * CS 261: Live state viewer
+ *
+ * Name: Aiden Smith
+ *
+ * Shows the state that a run started with "y86 -e -v name" publishes to
+ * shared memory: PC, status, flags and registers, the instruction count and
+ * rate, and with -P the hottest addresses. Reading never stops or slows the
+ * run; each refresh takes one consistent snapshot.
+ *
+ * Build: gcc -O2 -o y86-top y86-top.c snap.c
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "snap.h"
+
+#define DEFAULT_DELAY 1.0
+
+static const char *reg_names[NUMREGS] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14"
+};
+
+/* Print one snapshot; rate is in instructions per second (< 0: unknown) */
+static void show (const y86_snap_t *s, double rate, bool clear)
+{
+    if (clear) {
+        printf("\033[H\033[J");
+    }
+    printf("%s\n", s->file);
+    printf("    PC: %016" PRIx64 "   flags: Z%d S%d O%d     %s\n",
+           s->cpu.pc, s->cpu.zf, s->cpu.sf, s->cpu.of,
+           y86_stat_name(s->cpu.stat));
+    for (int r = 0; r < NUMREGS; r++) {
+        printf("  %%%-3s: %016" PRIx64 "%s", reg_names[r], s->cpu.reg[r],
+               r % 2 == 1 || r == NUMREGS - 1 ? "\n" : "  ");
+    }
+    printf("Instructions: %" PRIu64, s->count);
+    if (rate >= 0) {
+        printf("  (%.2f million per second)", rate / 1e6);
+    }
+    printf("\n");
+    if (s->nhot > 0) {
+        printf("Hottest addresses:\n");
+        for (uint32_t i = 0; i < s->nhot; i++) {
+            printf("  0x%03" PRIx64 ": %12" PRIu64 "  %5.1f%%\n",
+                   s->hot[i].pc, s->hot[i].count,
+                   s->count ? 100.0 * s->hot[i].count / s->count : 0.0);
+        }
+    }
+    fflush(stdout);
+}
+
+static void usage (char **argv)
+{
+    printf("Usage: %s <option(s)> name\n", argv[0]);
+    printf(" Options are:\n");
+    printf("  -h          Display usage\n");
+    printf("  -d secs     Time between refreshes (default %.0f)\n",
+           DEFAULT_DELAY);
+    printf("  -n times    Refresh this many times, then exit (default: "
+           "until the run ends)\n");
+    printf("  -b          Batch mode: don't clear the screen between "
+           "refreshes\n");
+}
+
+int main (int argc, char **argv)
+{
+    int opt;
+    double delay = DEFAULT_DELAY;
+    long times = -1;
+    bool clear = true;
+
+    while ((opt = getopt(argc, argv, "hd:n:b")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(argv);
+                return EXIT_SUCCESS;
+            case 'd':
+                delay = atof(optarg);
+                break;
+            case 'n':
+                times = atol(optarg);
+                break;
+            case 'b':
+                clear = false;
+                break;
+            default:
+                usage(argv);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || delay <= 0) {
+        usage(argv);
+        return EXIT_FAILURE;
+    }
+
+    y86_snap_t *snap = snap_open(argv[optind]);
+    if (snap == NULL) {
+        printf("No snapshots published as %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    static y86_snap_t now, last;
+    bool have_last = false;
+    for (long i = 0; times < 0 || i < times; i++) {
+        if (i > 0) {
+            usleep(delay * 1e6);
+        }
+        snap_read(snap, &now);
+
+        // rate over the last refresh, from the writer's own timestamps
+        double rate = -1;
+        if (have_last && now.time_ns > last.time_ns && now.count >= last.count) {
+            rate = (now.count - last.count) * 1e9 / (now.time_ns - last.time_ns);
+        }
+        show(&now, rate, clear);
+        last = now;
+        have_last = true;
+
+        if (times < 0 && now.cpu.stat != AOK) {
+            break;              // the run is over
+        }
+    }
+
+    snap_close(snap);
+    return EXIT_SUCCESS;
+}
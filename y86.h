@@ -3,19 +3,35 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 #define VADDRBITS 12
 #define MEMSIZE (1 << VADDRBITS)
 #define NUMREGS 15
 
+/* guest memory is tracked in pages of (1 << PAGEBITS) bytes */
+#define PAGEBITS 6
+#define NUMPAGES (MEMSIZE >> PAGEBITS)
+#define PAGEWORDS ((NUMPAGES + 63) / 64)
+
 /* type declarations */
 typedef uint8_t  byte_t;        // byte
 typedef uint64_t y86_reg_t;     // register
 typedef uint64_t address_t;     // address
 typedef bool     flag_t;        // CPU flag
 
-/* possible CPU statuses */
-typedef enum { AOK = 1, HLT, ADR, INS } y86_stat_t;
+/* possible CPU statuses; TMO means the host stopped the program because
+   it used up its instruction budget or time */
+typedef enum { AOK = 1, HLT, ADR, INS, TMO } y86_stat_t;
+
+/* Name of a status as printed in CPU state dumps ("UNK" if not valid) */
+static inline const char *y86_stat_name (y86_stat_t stat)
+{
+    static const char *const names[] = {
+        "UNK", "AOK", "HLT", "ADR", "INS", "TMO"
+    };
+    return (stat >= AOK && stat <= TMO) ? names[stat] : "UNK";
+}
 
 /* y86 CPU data storage structure */
 typedef struct y86 {
@@ -32,6 +48,14 @@ typedef struct y86 {
 
 } y86_t;
 
+/* Host monotonic clock in nanoseconds, for run deadlines and timing */
+static inline uint64_t y86_clock_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 /* These enums are specified to match the order of the numbers for all Y86
    instructions and operands. As such, they can be used as constants throughout
    the code. */
@@ -94,4 +118,16 @@ typedef struct y86_inst {
 
 } y86_inst_t;
 
+/* Compact decoded instruction (16 bytes) for predecoded execution. Four fit
+   in a cache line, against one and a half y86_inst_t. The instruction's own
+   address is implied by where it is stored, so valP is pc + len. */
+typedef struct y86_pinst {
+    byte_t opcode;              // icode (high 4 bits) and ifun (low 4 bits)
+    byte_t regs;                // rA and rB (0xff if there is no register byte)
+    byte_t len;                 // length in bytes
+    byte_t flags;               // reserved for the execution engine
+    uint32_t aux;               // reserved for the execution engine
+    int64_t valC;               // valC (0 if there is none)
+} y86_pinst_t;
+
 #endif